@@ -6,13 +6,12 @@
 
 namespace kh
 {
-static SoundIoRingBuffer* ring_buffer{nullptr};
-
+// Both streams get the ring buffer as their userdata.
 void read_callback(SoundIoInStream* instream, int frame_count_min, int frame_count_max)
 {
     // Using KH_CHANNEL_COUNT (i.e., 2) to pick the first two channels of the Azure Kinect microphone.
     // Use (instream->bytes_per_frame / instream->bytes_per_sample) as channel_count for full usage of channels.
-    write_instream_to_buffer(instream, frame_count_min, frame_count_max, ring_buffer, KH_CHANNEL_COUNT);
+    write_instream_to_buffer(instream, frame_count_min, frame_count_max, static_cast<SoundIoRingBuffer*>(instream->userdata), KH_CHANNEL_COUNT);
 }
 
 void overflow_callback(struct SoundIoInStream* instream) {
@@ -22,7 +21,7 @@ void overflow_callback(struct SoundIoInStream* instream) {
 
 void write_callback(SoundIoOutStream* outstream, int frame_count_min, int frame_count_max)
 {
-    write_buffer_to_outstream(outstream, frame_count_min, frame_count_max, ring_buffer);
+    write_buffer_to_outstream(outstream, frame_count_min, frame_count_max, static_cast<SoundIoRingBuffer*>(outstream->userdata));
 }
 
 void underflow_callback(struct SoundIoOutStream* outstream) {
@@ -37,19 +36,16 @@ int main()
     auto kinect_microphone{find_kinect_microphone(sound_io)};
     auto default_speaker{get_sound_io_default_output_device(sound_io)};
 
-    auto kinect_microphone_stream{create_kinect_microphone_stream(sound_io, read_callback, overflow_callback)};
-    auto default_speaker_stream{create_default_speaker_stream(sound_io, write_callback, underflow_callback)};
-
     constexpr int capacity{gsl::narrow<int>(KH_LATENCY_SECONDS * 2 * KH_BYTES_PER_SECOND)};
+    auto ring_buffer{create_sound_io_ring_buffer(sound_io, capacity)};
 
-    ring_buffer = soundio_ring_buffer_create(sound_io.get(), capacity);
-    if (!ring_buffer)
-        throw std::runtime_error("Failed in soundio_ring_buffer_create()...");
+    auto kinect_microphone_stream{create_kinect_microphone_stream(sound_io, read_callback, overflow_callback, ring_buffer.get())};
+    auto default_speaker_stream{create_default_speaker_stream(sound_io, write_callback, underflow_callback, ring_buffer.get())};
     
-    char* write_ptr{soundio_ring_buffer_write_ptr(ring_buffer)};
+    char* write_ptr{soundio_ring_buffer_write_ptr(ring_buffer.get())};
     constexpr int fill_count{gsl::narrow<int>(KH_LATENCY_SECONDS * KH_BYTES_PER_SECOND)};
     memset(write_ptr, 0, fill_count);
-    soundio_ring_buffer_advance_write_ptr(ring_buffer, fill_count);
+    soundio_ring_buffer_advance_write_ptr(ring_buffer.get(), fill_count);
 
     if (int error = soundio_instream_start(kinect_microphone_stream.get()))
         throw std::runtime_error(std::string("Failed to start AudioInStream: ") + std::to_string(error));
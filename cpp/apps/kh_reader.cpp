@@ -1,8 +1,21 @@
+#include <cmath>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <random>
+#include <thread>
 #include "native/tt_native.h"
 #include "sender/video_pipeline.h"
+#include "sender/audio_bundler.h"
+#include "sender/receiver_packet_classifier.h"
+#include "sender/video_packet_fan_out.h"
+#include "receiver/audio_jitter_buffer.h"
+#include "receiver/audio_mixer.h"
 #include "receiver/video_renderer.h"
+#include "external/FloorDetector.h"
+#include "external/PointCloudGenerator.h"
 #include "utils/filesystem_utils.h"
+#include "win32/soundio_utils.h"
 
 namespace kh
 {
@@ -12,7 +25,7 @@ void read_frames(KinectInterface& kinect_interface)
     const int width{calibration.depth_camera_calibration.resolution_width};
     const int height{calibration.depth_camera_calibration.resolution_height};
 
-    VideoPipeline video_pipeline{calibration};
+    VideoPipeline video_pipeline{calibration, VideoPipelineOptions{}};
     VideoRenderer video_renderer{width, height};
 
     tt::Profiler profiler;
@@ -21,8 +34,1293 @@ void read_frames(KinectInterface& kinect_interface)
         if (!kinect_frame)
             continue;
 
-        auto frame{video_pipeline.process(*kinect_frame, false, profiler)};
-        video_renderer.render(frame.vp8_frame, frame.trvl_frame, frame.keyframe);
+        auto frame{video_pipeline.process(*kinect_frame, false, ColorCodec::Vp8, DepthCodec::Trvl, DepthQuantization::None, profiler)};
+        video_renderer.render(frame.vp8_frame, frame.trvl_frame, frame.color_codec, frame.depth_codec, frame.depth_quantization, frame.keyframe);
+    }
+}
+
+// A depth codec with its own encoder and decoder for compare_depth_codecs().
+struct DepthCodecCandidate
+{
+    std::string name;
+    std::function<std::vector<std::byte>(gsl::span<int16_t>, bool)> encode;
+    std::function<std::vector<int16_t>(std::vector<std::byte>&, bool)> decode;
+    // Candidates preprocessing depth pixels (e.g., quantization) do not reconstruct the same pixels as the others.
+    bool preprocessed;
+};
+
+std::vector<DepthCodecCandidate> create_depth_codec_candidates(int width, int height, tt::Profiler& profiler)
+{
+    std::vector<DepthCodecCandidate> candidates;
+
+    auto trvl_encoder{std::make_shared<tt::TrvlEncoder>(width * height, TRVL_CHANGE_THRESHOLD, TRVL_INVALID_THRESHOLD)};
+    auto trvl_decoder{std::make_shared<tt::TrvlDecoder>(width * height)};
+    candidates.push_back({"TRVL",
+                          [trvl_encoder](gsl::span<int16_t> depth_pixels, bool keyframe) { return trvl_encoder->encode(depth_pixels, keyframe); },
+                          [trvl_decoder](std::vector<std::byte>& frame, bool keyframe) { return trvl_decoder->decode(frame, keyframe); },
+                          false});
+
+    for (std::optional<int> zstd_level : {std::optional<int>{}, std::optional<int>{1}, std::optional<int>{3}}) {
+        auto tiled_trvl_encoder{std::make_shared<TiledTrvlEncoder>(width, height, TRVL_CHANGE_THRESHOLD, TRVL_INVALID_THRESHOLD)};
+        auto tiled_trvl_decoder{std::make_shared<TiledTrvlDecoder>(width, height)};
+        const std::string name{zstd_level ? "Tiled TRVL + zstd " + std::to_string(*zstd_level) : "Tiled TRVL"};
+        candidates.push_back({name,
+                              [tiled_trvl_encoder, zstd_level](gsl::span<int16_t> depth_pixels, bool keyframe) {
+                                  return tiled_trvl_encoder->encode(depth_pixels, keyframe, zstd_level, std::nullopt);
+                              },
+                              [tiled_trvl_decoder, zstd_level](std::vector<std::byte>& frame, bool keyframe) {
+                                  return tiled_trvl_decoder->decode(frame, keyframe, zstd_level.has_value());
+                              },
+                              false});
+    }
+
+    auto quantized_tiled_trvl_encoder{std::make_shared<TiledTrvlEncoder>(width, height, KH_QUANTIZED_TRVL_CHANGE_THRESHOLD, TRVL_INVALID_THRESHOLD)};
+    auto quantized_tiled_trvl_decoder{std::make_shared<TiledTrvlDecoder>(width, height)};
+    auto depth_quantizer{std::make_shared<DepthQuantizer>()};
+    auto depth_codes{std::make_shared<std::vector<int16_t>>(width * height)};
+    candidates.push_back({"Tiled TRVL + zstd " + std::to_string(KH_TILED_TRVL_ZSTD_LEVEL) + " + inverse depth",
+                          [quantized_tiled_trvl_encoder, depth_quantizer, depth_codes](gsl::span<int16_t> depth_pixels, bool keyframe) {
+                              depth_quantizer->quantize(depth_pixels, *depth_codes);
+                              return quantized_tiled_trvl_encoder->encode(*depth_codes, keyframe, KH_TILED_TRVL_ZSTD_LEVEL, std::nullopt);
+                          },
+                          [quantized_tiled_trvl_decoder, depth_quantizer](std::vector<std::byte>& frame, bool keyframe) {
+                              auto pixels{quantized_tiled_trvl_decoder->decode(frame, keyframe, true)};
+                              depth_quantizer->dequantize(pixels);
+                              return pixels;
+                          },
+                          true});
+
+    auto denoised_tiled_trvl_encoder{std::make_shared<TiledTrvlEncoder>(width, height, TRVL_CHANGE_THRESHOLD, TRVL_INVALID_THRESHOLD)};
+    auto denoised_tiled_trvl_decoder{std::make_shared<TiledTrvlDecoder>(width, height)};
+    auto depth_denoiser{std::make_shared<DepthDenoiser>(width * height)};
+    auto denoised_depth_pixels{std::make_shared<std::vector<int16_t>>(width * height)};
+    const std::string denoised_name{"Tiled TRVL + zstd " + std::to_string(KH_TILED_TRVL_ZSTD_LEVEL) + " + denoising"};
+    candidates.push_back({denoised_name,
+                          [denoised_tiled_trvl_encoder, depth_denoiser, denoised_depth_pixels, denoised_name, &profiler](gsl::span<int16_t> depth_pixels, bool keyframe) {
+                              denoised_depth_pixels->assign(depth_pixels.begin(), depth_pixels.end());
+                              profiler.addNumber(denoised_name + "-delayed", depth_denoiser->denoise(*denoised_depth_pixels));
+                              return denoised_tiled_trvl_encoder->encode(*denoised_depth_pixels, keyframe, KH_TILED_TRVL_ZSTD_LEVEL, std::nullopt);
+                          },
+                          [denoised_tiled_trvl_decoder](std::vector<std::byte>& frame, bool keyframe) {
+                              return denoised_tiled_trvl_decoder->decode(frame, keyframe, true);
+                          },
+                          true});
+
+    return candidates;
+}
+
+// Errors of decoded depth pixels are binned per meter, with the last bin for all pixels beyond.
+constexpr int DEPTH_ERROR_BIN_COUNT{5};
+
+// Adds squared errors of decoded pixels against the Kinect ones per meter of distance.
+// Pixels invalid in either are left out since TRVL invalidates pixels on purpose.
+void add_depth_errors(const std::string& name, gsl::span<const int16_t> depth_pixels, gsl::span<const int16_t> decoded_pixels, tt::Profiler& profiler)
+{
+    std::array<float, DEPTH_ERROR_BIN_COUNT> squared_errors{};
+    std::array<int, DEPTH_ERROR_BIN_COUNT> pixel_counts{};
+    for (size_t i{0}; i < depth_pixels.size(); ++i) {
+        if (depth_pixels[i] <= 0 || decoded_pixels[i] <= 0)
+            continue;
+
+        const int bin{std::min(depth_pixels[i] / 1000, DEPTH_ERROR_BIN_COUNT - 1)};
+        const float error{static_cast<float>(decoded_pixels[i] - depth_pixels[i])};
+        squared_errors[bin] += error * error;
+        ++pixel_counts[bin];
+    }
+
+    for (int bin{0}; bin < DEPTH_ERROR_BIN_COUNT; ++bin) {
+        profiler.addNumber(name + "-squared-error-" + std::to_string(bin), squared_errors[bin]);
+        profiler.addNumber(name + "-error-pixel-" + std::to_string(bin), pixel_counts[bin]);
+    }
+}
+
+// Encodes and decodes the same depth frames with each depth codec
+// to compare bytes per frame against encoding and decoding time and errors per distance.
+void compare_depth_codecs(KinectInterface& kinect_interface)
+{
+    constexpr int SUMMARY_FRAME_COUNT{300};
+
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    tt::Profiler profiler;
+    auto candidates{create_depth_codec_candidates(width, height, profiler)};
+
+    for (int frame_count{0};;) {
+        auto kinect_frame{kinect_interface.getFrame()};
+        if (!kinect_frame)
+            continue;
+
+        gsl::span<int16_t> depth_pixels{reinterpret_cast<int16_t*>(kinect_frame->depth_image.get_buffer()),
+                                        gsl::narrow<size_t>(width * height)};
+        const bool keyframe{frame_count == 0};
+
+        std::vector<int16_t> first_candidate_pixels;
+        for (auto& candidate : candidates) {
+            const auto encode_start{tt::TimePoint::now()};
+            auto frame{candidate.encode(depth_pixels, keyframe)};
+            profiler.addNumber(candidate.name + "-encode", encode_start.elapsed_time().ms());
+
+            const auto decode_start{tt::TimePoint::now()};
+            auto pixels{candidate.decode(frame, keyframe)};
+            profiler.addNumber(candidate.name + "-decode", decode_start.elapsed_time().ms());
+            profiler.addNumber(candidate.name + "-byte", frame.size());
+            add_depth_errors(candidate.name, depth_pixels, pixels, profiler);
+
+            // All candidates without preprocessing should reconstruct the same pixels since they differ only after the TRVL stage.
+            if (candidate.preprocessed)
+                continue;
+
+            if (first_candidate_pixels.empty()) {
+                first_candidate_pixels = std::move(pixels);
+            } else if (pixels != first_candidate_pixels) {
+                profiler.addNumber(candidate.name + "-mismatch", 1);
+            }
+        }
+
+        if (++frame_count % SUMMARY_FRAME_COUNT != 0)
+            continue;
+
+        std::cout << "Depth Codec Summary (" << SUMMARY_FRAME_COUNT << " frames):\n";
+        for (auto& candidate : candidates) {
+            std::cout << "  " << candidate.name << ":\n";
+            std::cout << "    Bytes Per Frame: " << profiler.getNumber(candidate.name + "-byte") / SUMMARY_FRAME_COUNT << "\n";
+            std::cout << "    Encode Time Average: " << profiler.getNumber(candidate.name + "-encode") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+            std::cout << "    Decode Time Average: " << profiler.getNumber(candidate.name + "-decode") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+            std::cout << "    Mismatched Frames: " << profiler.getNumber(candidate.name + "-mismatch") << "\n";
+            std::cout << "    Delayed Pixels Per Frame: " << profiler.getNumber(candidate.name + "-delayed") / SUMMARY_FRAME_COUNT << "\n";
+            std::cout << "    RMS Error Per Distance:";
+            for (int bin{0}; bin < DEPTH_ERROR_BIN_COUNT; ++bin) {
+                const float pixel_count{profiler.getNumber(candidate.name + "-error-pixel-" + std::to_string(bin))};
+                const float squared_error{profiler.getNumber(candidate.name + "-squared-error-" + std::to_string(bin))};
+                std::cout << " [" << bin << (bin + 1 < DEPTH_ERROR_BIN_COUNT ? "-" + std::to_string(bin + 1) : "+") << " m] "
+                          << (pixel_count > 0.0f ? std::sqrt(squared_error / pixel_count) : 0.0f) << " mm";
+            }
+            std::cout << "\n";
+        }
+        profiler.reset();
+    }
+}
+
+// A color codec with its own encoder and decoder for compare_color_codec_candidates().
+struct ColorCodecCandidate
+{
+    std::string name;
+    // Whether color pixels without depth get filled before encoding.
+    bool filled;
+    std::unique_ptr<ColorEncoder> encoder;
+    std::unique_ptr<ColorDecoder> decoder;
+};
+
+// fill_color_pixels_without_depth() without SSE2, to check and time the SSE2 one against.
+int fill_color_pixels_without_depth_without_sse2(uint8_t* bgra_buffer, int stride_bytes, gsl::span<const int16_t> depth_pixels, int width, int height)
+{
+    int filled_pixel_count{0};
+    for (int row{0}; row < height; ++row) {
+        uint8_t* bgra_row{bgra_buffer + row * stride_bytes};
+        const int16_t* depth_row{depth_pixels.data() + row * width};
+
+        int first_valid_col{-1};
+        uint32_t last_valid_color{0};
+        for (int col{0}; col < width; ++col) {
+            if (depth_row[col] > 0) {
+                memcpy(&last_valid_color, bgra_row + col * 4, 4);
+                if (first_valid_col < 0)
+                    first_valid_col = col;
+            } else if (first_valid_col >= 0) {
+                memcpy(bgra_row + col * 4, &last_valid_color, 4);
+                ++filled_pixel_count;
+            }
+        }
+
+        if (first_valid_col < 0)
+            continue;
+
+        for (int col{0}; col < first_valid_col; ++col)
+            memcpy(bgra_row + col * 4, bgra_row + first_valid_col * 4, 4);
+        filled_pixel_count += first_valid_col;
+    }
+    return filled_pixel_count;
+}
+
+// Encodes and decodes the same color frames with each candidate
+// to compare bytes per frame and encoding and decoding time against the PSNR of the luma pixels with valid depth, the ones receivers keep.
+// Since the encoders have target bitrates, PSNR tells the quality each gets for its bytes.
+void compare_color_codec_candidates(KinectInterface& kinect_interface, std::vector<ColorCodecCandidate>& candidates)
+{
+    constexpr int SUMMARY_FRAME_COUNT{300};
+
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    k4a::transformation transformation{calibration};
+    OcclusionRemover occlusion_remover{calibration, DepthRayTable::create(calibration, std::nullopt)};
+
+    tt::Profiler profiler;
+    for (int frame_count{0};;) {
+        auto kinect_frame{kinect_interface.getFrame()};
+        if (!kinect_frame)
+            continue;
+
+        gsl::span<int16_t> depth_pixels{reinterpret_cast<int16_t*>(kinect_frame->depth_image.get_buffer()),
+                                        gsl::narrow<size_t>(width * height)};
+        occlusion_remover.remove(depth_pixels);
+
+        auto color_image{transformation.color_image_to_depth_camera(kinect_frame->depth_image, kinect_frame->color_image)};
+        const auto yuv_image{tt::YuvFrame::createFromAzureKinectBgraBuffer(color_image.get_buffer(), width, height, color_image.get_stride_bytes())};
+
+        // The fill without SSE2 runs on a copy, which the SSE2 one should match.
+        const int color_buffer_size{color_image.get_stride_bytes() * height};
+        std::vector<uint8_t> color_buffer_without_sse2(color_image.get_buffer(), color_image.get_buffer() + color_buffer_size);
+        const auto fill_without_sse2_start{tt::TimePoint::now()};
+        fill_color_pixels_without_depth_without_sse2(color_buffer_without_sse2.data(), color_image.get_stride_bytes(), depth_pixels, width, height);
+        profiler.addNumber("fill-without-sse2", fill_without_sse2_start.elapsed_time().ms());
+
+        const auto fill_start{tt::TimePoint::now()};
+        fill_color_pixels_without_depth(color_image.get_buffer(), color_image.get_stride_bytes(), depth_pixels, width, height);
+        profiler.addNumber("fill", fill_start.elapsed_time().ms());
+        if (!std::equal(color_buffer_without_sse2.begin(), color_buffer_without_sse2.end(), color_image.get_buffer()))
+            profiler.addNumber("fill-mismatch", 1);
+        const auto filled_yuv_image{tt::YuvFrame::createFromAzureKinectBgraBuffer(color_image.get_buffer(), width, height, color_image.get_stride_bytes())};
+
+        const bool keyframe{frame_count == 0};
+        for (auto& candidate : candidates) {
+            const auto encode_start{tt::TimePoint::now()};
+            auto frame{candidate.encoder->encode(candidate.filled ? filled_yuv_image : yuv_image, keyframe)};
+            profiler.addNumber(candidate.name + "-encode", encode_start.elapsed_time().ms());
+            profiler.addNumber(candidate.name + "-byte", frame.size());
+
+            const auto decode_start{tt::TimePoint::now()};
+            const auto decoded_yuv_image{candidate.decoder->decode(frame)};
+            profiler.addNumber(candidate.name + "-decode", decode_start.elapsed_time().ms());
+
+            // All get compared against the unfilled luma since only pixels with valid depth count.
+            float squared_error{0.0f};
+            int pixel_count{0};
+            for (size_t j{0}; j < depth_pixels.size(); ++j) {
+                if (depth_pixels[j] <= 0)
+                    continue;
+
+                const float error{static_cast<float>(decoded_yuv_image.y_channel()[j]) - yuv_image.y_channel()[j]};
+                squared_error += error * error;
+                ++pixel_count;
+            }
+            profiler.addNumber(candidate.name + "-squared-error", squared_error);
+            profiler.addNumber(candidate.name + "-pixel", pixel_count);
+        }
+
+        if (++frame_count % SUMMARY_FRAME_COUNT != 0)
+            continue;
+
+        std::cout << "Color Codec Summary (" << SUMMARY_FRAME_COUNT << " frames):\n";
+        std::cout << "  Fill Time Average: " << profiler.getNumber("fill") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+        std::cout << "  Fill without SSE2 Time Average: " << profiler.getNumber("fill-without-sse2") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+        std::cout << "  Fill Frames Differing without SSE2: " << profiler.getNumber("fill-mismatch") << "\n";
+        for (auto& candidate : candidates) {
+            const float mean_squared_error{profiler.getNumber(candidate.name + "-squared-error") / profiler.getNumber(candidate.name + "-pixel")};
+            std::cout << "  " << candidate.name << ":\n";
+            std::cout << "    Bytes Per Frame: " << profiler.getNumber(candidate.name + "-byte") / SUMMARY_FRAME_COUNT << "\n";
+            std::cout << "    Encode Time Average: " << profiler.getNumber(candidate.name + "-encode") / SUMMARY_FRAME_COUNT << " ms\n";
+            std::cout << "    Decode Time Average: " << profiler.getNumber(candidate.name + "-decode") / SUMMARY_FRAME_COUNT << " ms\n";
+            std::cout << "    Luma PSNR of Pixels with Depth: " << 10.0f * std::log10(255.0f * 255.0f / mean_squared_error) << " dB\n";
+        }
+        profiler.reset();
+    }
+}
+
+// Compares each color codec with and without filling color pixels without depth.
+void compare_color_codecs(KinectInterface& kinect_interface)
+{
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    std::vector<ColorCodecCandidate> candidates;
+    candidates.push_back({"VP8", false, create_color_encoder(ColorCodec::Vp8, width, height, std::nullopt), create_color_decoder(ColorCodec::Vp8)});
+    candidates.push_back({"VP8 + fill", true, create_color_encoder(ColorCodec::Vp8, width, height, std::nullopt), create_color_decoder(ColorCodec::Vp8)});
+    candidates.push_back({"VP9 + fill", true, create_color_encoder(ColorCodec::Vp9, width, height, std::nullopt), create_color_decoder(ColorCodec::Vp9)});
+    candidates.push_back({"Tiled VP9 + fill", true, create_color_encoder(ColorCodec::TiledVp9, width, height, std::nullopt), create_color_decoder(ColorCodec::TiledVp9)});
+    compare_color_codec_candidates(kinect_interface, candidates);
+}
+
+// Sweeps libvpx VP8 settings, first the thread count and token partitions and then the speed,
+// against the defaults of tt::Vp8Encoder to pick the VP8 profile of kh_sender.
+void compare_vp8_profiles(KinectInterface& kinect_interface)
+{
+    constexpr unsigned int TARGET_BITRATE_KBPS{2000};
+    constexpr unsigned int MIN_QUANTIZER{4};
+    constexpr unsigned int MAX_QUANTIZER{56};
+
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    std::vector<std::pair<std::string, ColorEncoderProfile>> profiles;
+    for (unsigned int thread_count : {1u, 2u, 4u}) {
+        for (int token_partitions_log2 : {0, 2}) {
+            profiles.push_back({"threads " + std::to_string(thread_count) + ", partitions " + std::to_string(1 << token_partitions_log2),
+                                ColorEncoderProfile{thread_count, token_partitions_log2, 0, 8, TARGET_BITRATE_KBPS, MIN_QUANTIZER, MAX_QUANTIZER, true, false}});
+        }
+    }
+    for (int speed : {4, 12, 16})
+        profiles.push_back({"threads 4, partitions 4, speed " + std::to_string(speed),
+                            ColorEncoderProfile{4, 2, 0, speed, TARGET_BITRATE_KBPS, MIN_QUANTIZER, MAX_QUANTIZER, true, false}});
+    profiles.push_back({"threads 4, partitions 4, without error resilience",
+                        ColorEncoderProfile{4, 2, 0, 8, TARGET_BITRATE_KBPS, MIN_QUANTIZER, MAX_QUANTIZER, false, false}});
+
+    std::vector<ColorCodecCandidate> candidates;
+    candidates.push_back({"tt::Vp8Encoder", true, create_color_encoder(ColorCodec::Vp8, width, height, std::nullopt), create_color_decoder(ColorCodec::Vp8)});
+    for (auto& [name, profile] : profiles)
+        candidates.push_back({name, true, create_color_encoder(ColorCodec::Vp8, width, height, profile), create_color_decoder(ColorCodec::Vp8)});
+    compare_color_codec_candidates(kinect_interface, candidates);
+}
+
+// Generates point clouds from the same depth frames with Samples::PointCloudGenerator and PointCloudGenerator at each step
+// to compare their time per frame and check the points of PointCloudGenerator against the ones of the Azure Kinect SDK.
+// The SDK rounds its points to millimeters, so a half millimeter of error is expected.
+void compare_point_cloud_generators(KinectInterface& kinect_interface)
+{
+    constexpr int SUMMARY_FRAME_COUNT{300};
+    constexpr std::array<int, 3> STEPS{1, 2, 4};
+
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    Samples::PointCloudGenerator sdk_point_cloud_generator{calibration};
+    PointCloudGenerator point_cloud_generator{DepthRayTable::create(calibration, std::nullopt)};
+
+    tt::Profiler profiler;
+    for (int frame_count{0};;) {
+        auto kinect_frame{kinect_interface.getFrame()};
+        if (!kinect_frame)
+            continue;
+
+        gsl::span<const int16_t> depth_pixels{reinterpret_cast<const int16_t*>(kinect_frame->depth_image.get_buffer()),
+                                              gsl::narrow<size_t>(width * height)};
+        for (int step : STEPS) {
+            const std::string name{"step " + std::to_string(step)};
+
+            const auto sdk_start{tt::TimePoint::now()};
+            sdk_point_cloud_generator.Update(kinect_frame->depth_image.handle());
+            const auto& sdk_points{sdk_point_cloud_generator.GetCloudPoints(step)};
+            profiler.addNumber(name + "-sdk", sdk_start.elapsed_time().ms());
+
+            const auto start{tt::TimePoint::now()};
+            const auto& points{point_cloud_generator.generate(depth_pixels, step)};
+            profiler.addNumber(name + "-kh", start.elapsed_time().ms());
+
+            // Both leave out invalid pixels in the same order, so their points pair up when their counts match.
+            if (points.size() != sdk_points.size()) {
+                profiler.addNumber(name + "-count-mismatch", 1);
+                continue;
+            }
+
+            float max_error{0.0f};
+            for (size_t i{0}; i < points.size(); ++i) {
+                for (int k{0}; k < 3; ++k)
+                    max_error = std::max(max_error, std::abs(points[i].v[k] - sdk_points[i].v[k]));
+            }
+            profiler.addNumber(name + "-max-error", max_error);
+        }
+
+        if (++frame_count % SUMMARY_FRAME_COUNT != 0)
+            continue;
+
+        std::cout << "Point Cloud Generator Summary (" << SUMMARY_FRAME_COUNT << " frames):\n";
+        for (int step : STEPS) {
+            const std::string name{"step " + std::to_string(step)};
+            const float matched_frame_count{SUMMARY_FRAME_COUNT - profiler.getNumber(name + "-count-mismatch")};
+            std::cout << "  Step " << step << ":\n";
+            std::cout << "    Samples::PointCloudGenerator Time Average: " << profiler.getNumber(name + "-sdk") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+            std::cout << "    PointCloudGenerator Time Average: " << profiler.getNumber(name + "-kh") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+            std::cout << "    Frames with Point Count Mismatches: " << profiler.getNumber(name + "-count-mismatch") << "\n";
+            std::cout << "    Max Error Average: " << profiler.getNumber(name + "-max-error") * 1000.0f / matched_frame_count << " mm\n";
+        }
+        profiler.reset();
+    }
+}
+
+// Detects floors in the same point clouds with Samples::FloorDetector and FloorDetector
+// to compare their time per frame and how often and how differently they detect floors.
+void compare_floor_detectors(KinectInterface& kinect_interface)
+{
+    constexpr int SUMMARY_FRAME_COUNT{300};
+    // The parameters of VideoPipeline.
+    constexpr int DOWNSAMPLE_STEP{2};
+    constexpr size_t MINIMUM_FLOOR_POINT_COUNT{1024 / (DOWNSAMPLE_STEP * DOWNSAMPLE_STEP)};
+
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    PointCloudGenerator point_cloud_generator{DepthRayTable::create(calibration, std::nullopt)};
+    FloorDetector floor_detector{calibration};
+    FloorTracker floor_tracker{calibration};
+
+    // For the jitter of the planes between frames.
+    std::optional<std::array<float, 4>> last_floor;
+    std::optional<std::array<float, 4>> last_tracked_floor;
+    tt::Profiler profiler;
+    for (int frame_count{0};;) {
+        auto kinect_frame{kinect_interface.getFrame()};
+        if (!kinect_frame)
+            continue;
+
+        gsl::span<const int16_t> depth_pixels{reinterpret_cast<const int16_t*>(kinect_frame->depth_image.get_buffer()),
+                                              gsl::narrow<size_t>(width * height)};
+        const auto& cloud_points{point_cloud_generator.generate(depth_pixels, DOWNSAMPLE_STEP)};
+
+        const auto sdk_start{tt::TimePoint::now()};
+        const auto sdk_floor{Samples::FloorDetector::TryDetectFloorPlane(cloud_points, kinect_frame->imu_sample, calibration, MINIMUM_FLOOR_POINT_COUNT)};
+        profiler.addNumber("sdk", sdk_start.elapsed_time().ms());
+
+        const auto start{tt::TimePoint::now()};
+        const auto floor{floor_detector.detect(cloud_points, kinect_frame->imu_sample, MINIMUM_FLOOR_POINT_COUNT)};
+        profiler.addNumber("kh", start.elapsed_time().ms());
+
+        const auto tracker_start{tt::TimePoint::now()};
+        const auto tracked_floor{floor_tracker.track(cloud_points, kinect_frame->imu_sample)};
+        profiler.addNumber("tracker", tracker_start.elapsed_time().ms());
+
+        profiler.addNumber("sdk-detected", sdk_floor ? 1 : 0);
+        profiler.addNumber("kh-detected", floor ? 1 : 0);
+        profiler.addNumber("tracker-detected", tracked_floor ? 1 : 0);
+        profiler.addNumber("tracker-verified", floor_tracker.verified() ? 1 : 0);
+        if (sdk_floor && floor) {
+            profiler.addNumber("both-detected", 1);
+            profiler.addNumber("c-error", std::abs(sdk_floor->C - (*floor)[3]));
+        }
+        if (last_floor && floor) {
+            profiler.addNumber("kh-consecutive", 1);
+            profiler.addNumber("kh-c-change", std::abs((*last_floor)[3] - (*floor)[3]));
+        }
+        if (last_tracked_floor && tracked_floor) {
+            profiler.addNumber("tracker-consecutive", 1);
+            profiler.addNumber("tracker-c-change", std::abs((*last_tracked_floor)[3] - (*tracked_floor)[3]));
+        }
+        last_floor = floor;
+        last_tracked_floor = tracked_floor;
+
+        if (++frame_count % SUMMARY_FRAME_COUNT != 0)
+            continue;
+
+        std::cout << "Floor Detector Summary (" << SUMMARY_FRAME_COUNT << " frames):\n";
+        std::cout << "  Samples::FloorDetector Time Average: " << profiler.getNumber("sdk") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+        std::cout << "  FloorDetector Time Average: " << profiler.getNumber("kh") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+        std::cout << "  Samples::FloorDetector Detected Frames: " << profiler.getNumber("sdk-detected") << "\n";
+        std::cout << "  FloorDetector Detected Frames: " << profiler.getNumber("kh-detected") << "\n";
+        std::cout << "  Plane Constant Error Average: " << profiler.getNumber("c-error") * 1000.0f / profiler.getNumber("both-detected") << " mm\n";
+        std::cout << "  FloorTracker Time Average: " << profiler.getNumber("tracker") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+        std::cout << "  FloorTracker Detected Frames: " << profiler.getNumber("tracker-detected") << "\n";
+        std::cout << "  FloorTracker Verified Frames: " << profiler.getNumber("tracker-verified") << "\n";
+        std::cout << "  FloorDetector Plane Constant Change Average: " << profiler.getNumber("kh-c-change") * 1000.0f / profiler.getNumber("kh-consecutive") << " mm\n";
+        std::cout << "  FloorTracker Plane Constant Change Average: " << profiler.getNumber("tracker-c-change") * 1000.0f / profiler.getNumber("tracker-consecutive") << " mm\n";
+        profiler.reset();
+    }
+}
+
+// Runs VideoPipelines with and without RegionOfInterests on the same frames
+// to compare the time spent filtering and encoding and the bandwidth of the encoded frames.
+// The floor range starts from the floor of the frame, so it only applies once a floor gets detected.
+// Also checks that the floor stays where the full frame finds it, since a region above the floor
+// must not invalidate the floor pixels before the floor gets detected, with and without the FloorTracker.
+void compare_regions_of_interest(KinectInterface& kinect_interface)
+{
+    constexpr int SUMMARY_FRAME_COUNT{300};
+    constexpr float FRAME_PER_SECOND{30.0f};
+
+    struct Candidate
+    {
+        std::string name;
+        std::optional<RegionOfInterest> region_of_interest;
+        bool floor_tracking;
+    };
+
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    RegionOfInterest depth_range;
+    depth_range.min_depth = 500;
+    depth_range.max_depth = 2500;
+    depth_range.max_abs_x = 1000.0f;
+    RegionOfInterest floor_range{depth_range};
+    floor_range.floor_height_range = std::pair<float, float>{0.05f, 2.2f};
+    // The middle quarter of the frame, with even coordinates and sizes for YUV420.
+    RegionOfInterest crop{depth_range};
+    crop.crop = DepthCrop{(width / 4) & ~1, (height / 4) & ~1, (width / 2) & ~1, (height / 2) & ~1};
+
+    // The full frame comes first as the reference of the floor.
+    const std::vector<Candidate> candidates{{"Full Frame", std::nullopt, false},
+                                            {"Depth Range", depth_range, false},
+                                            {"Depth Range + Floor", floor_range, false},
+                                            {"Depth Range + Floor + FloorTracker", floor_range, true},
+                                            {"Depth Range + Crop", crop, false}};
+    std::vector<std::unique_ptr<VideoPipeline>> video_pipelines;
+    for (auto& candidate : candidates) {
+        VideoPipelineOptions options;
+        options.depth_masked_color = true;
+        options.region_of_interest = candidate.region_of_interest;
+        options.floor_tracking = candidate.floor_tracking;
+        video_pipelines.push_back(std::make_unique<VideoPipeline>(calibration, options));
+    }
+    std::vector<tt::Profiler> profilers(candidates.size());
+    // In meters, over the frames of each summary.
+    std::vector<float> min_floor_elevations(candidates.size(), std::numeric_limits<float>::max());
+    std::vector<float> max_floor_elevations(candidates.size(), std::numeric_limits<float>::lowest());
+    std::vector<float> max_floor_elevation_diffs(candidates.size(), 0.0f);
+
+    for (int frame_count{0};;) {
+        auto kinect_frame{kinect_interface.getFrame()};
+        if (!kinect_frame)
+            continue;
+
+        // The filter invalidates depth pixels in place, so each pipeline starts from a copy of the original ones.
+        gsl::span<int16_t> depth_pixels{reinterpret_cast<int16_t*>(kinect_frame->depth_image.get_buffer()),
+                                        gsl::narrow<size_t>(width * height)};
+        const std::vector<int16_t> original_depth_pixels(depth_pixels.begin(), depth_pixels.end());
+        std::optional<float> full_frame_floor_elevation;
+        for (size_t i{0}; i < candidates.size(); ++i) {
+            std::copy(original_depth_pixels.begin(), original_depth_pixels.end(), depth_pixels.begin());
+            const auto process_start{tt::TimePoint::now()};
+            const auto frame{video_pipelines[i]->process(*kinect_frame, frame_count == 0, ColorCodec::Vp8, DepthCodec::Trvl, DepthQuantization::None, profilers[i])};
+            profilers[i].addNumber("process", process_start.elapsed_time().ms());
+
+            if (!frame.floor)
+                continue;
+
+            const float floor_elevation{get_floor_elevation(*frame.floor)};
+            profilers[i].addNumber("floor-detected", 1);
+            min_floor_elevations[i] = std::min(min_floor_elevations[i], floor_elevation);
+            max_floor_elevations[i] = std::max(max_floor_elevations[i], floor_elevation);
+            if (i == 0) {
+                full_frame_floor_elevation = floor_elevation;
+            } else if (full_frame_floor_elevation) {
+                max_floor_elevation_diffs[i] = std::max(max_floor_elevation_diffs[i], std::abs(floor_elevation - *full_frame_floor_elevation));
+            }
+        }
+
+        if (++frame_count % SUMMARY_FRAME_COUNT != 0)
+            continue;
+
+        std::cout << "Region of Interest Summary (" << SUMMARY_FRAME_COUNT << " frames):\n";
+        for (size_t i{0}; i < candidates.size(); ++i) {
+            auto& profiler{profilers[i]};
+            const float frame_byte{(profiler.getNumber("pipeline-vp8byte") + profiler.getNumber("pipeline-trvlbyte")) / SUMMARY_FRAME_COUNT};
+            std::cout << "  " << candidates[i].name << " (" << video_pipelines[i]->width() << "x" << video_pipelines[i]->height() << "):\n";
+            std::cout << "    Filter Time Average: " << profiler.getNumber("pipeline-roi") * 1000.0f / SUMMARY_FRAME_COUNT << " us\n";
+            std::cout << "    Invalidated Pixels Per Frame: " << profiler.getNumber("pipeline-roi-invalidated") / SUMMARY_FRAME_COUNT << "\n";
+            std::cout << "    VP8 Time Average: " << profiler.getNumber("pipeline-vp8") / SUMMARY_FRAME_COUNT << " ms\n";
+            std::cout << "    TRVL Time Average: " << profiler.getNumber("pipeline-trvl") / SUMMARY_FRAME_COUNT << " ms\n";
+            std::cout << "    Process Time Average: " << profiler.getNumber("process") / SUMMARY_FRAME_COUNT << " ms\n";
+            std::cout << "    VP8 Bytes Per Frame: " << profiler.getNumber("pipeline-vp8byte") / SUMMARY_FRAME_COUNT << "\n";
+            std::cout << "    TRVL Bytes Per Frame: " << profiler.getNumber("pipeline-trvlbyte") / SUMMARY_FRAME_COUNT << "\n";
+            std::cout << "    Bandwidth at " << FRAME_PER_SECOND << " FPS: " << frame_byte * 8.0f * FRAME_PER_SECOND / 1000.0f << " kbps\n";
+            std::cout << "    Floor Detected Frames: " << profiler.getNumber("floor-detected") << "\n";
+            if (profiler.getNumber("floor-detected") > 0) {
+                std::cout << "    Floor Elevation Range: " << (max_floor_elevations[i] - min_floor_elevations[i]) * 1000.0f << " mm\n";
+                if (i > 0)
+                    std::cout << "    Max Floor Elevation Difference from Full Frame: " << max_floor_elevation_diffs[i] * 1000.0f << " mm\n";
+            }
+            profiler.reset();
+            min_floor_elevations[i] = std::numeric_limits<float>::max();
+            max_floor_elevations[i] = std::numeric_limits<float>::lowest();
+            max_floor_elevation_diffs[i] = 0.0f;
+        }
+    }
+}
+
+// Runs VideoPipelines on the same frames with the codecs of kh_sender to compare the sizes of frames
+// between catching receivers up with keyframes and refreshing a stripe of each frame with tiled codecs.
+// Keyframes come every CATCH_UP_FRAME_INTERVAL frames as if a receiver fell behind that often.
+// Tiled color with keyframes separates the bytes tiling costs from the ones refreshing costs.
+void compare_intra_refresh(KinectInterface& kinect_interface)
+{
+    constexpr int SUMMARY_FRAME_COUNT{300};
+    constexpr int CATCH_UP_FRAME_INTERVAL{15};
+
+    struct Candidate
+    {
+        std::string name;
+        ColorCodec color_codec;
+        bool intra_refresh;
+    };
+    const std::vector<Candidate> candidates{{"VP9 + Catch-up Keyframes", ColorCodec::Vp9, false},
+                                            {"Tiled VP9 + Catch-up Keyframes", ColorCodec::TiledVp9, false},
+                                            {"Tiled VP9 + Intra Refresh", ColorCodec::TiledVp9, true}};
+
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+
+    std::vector<std::unique_ptr<VideoPipeline>> video_pipelines;
+    for (auto& candidate : candidates) {
+        VideoPipelineOptions options;
+        options.depth_masked_color = true;
+        options.vp9_profile = create_default_vp9_color_encoder_profile();
+        options.vp9_profile->intra_refresh = candidate.intra_refresh;
+        options.intra_refresh = candidate.intra_refresh;
+        video_pipelines.push_back(std::make_unique<VideoPipeline>(calibration, options));
+    }
+    std::vector<tt::Profiler> profilers(candidates.size());
+    std::vector<float> max_frame_kilobytes(candidates.size(), 0.0f);
+
+    for (int frame_count{0};;) {
+        auto kinect_frame{kinect_interface.getFrame()};
+        if (!kinect_frame)
+            continue;
+
+        // Each pipeline starts from a copy of the original depth pixels, which pipelines change in place.
+        gsl::span<int16_t> depth_pixels{reinterpret_cast<int16_t*>(kinect_frame->depth_image.get_buffer()),
+                                        gsl::narrow<size_t>(width * height)};
+        const std::vector<int16_t> original_depth_pixels(depth_pixels.begin(), depth_pixels.end());
+        for (size_t i{0}; i < candidates.size(); ++i) {
+            std::copy(original_depth_pixels.begin(), original_depth_pixels.end(), depth_pixels.begin());
+            const bool keyframe{frame_count == 0 || (!candidates[i].intra_refresh && frame_count % CATCH_UP_FRAME_INTERVAL == 0)};
+            const auto frame{video_pipelines[i]->process(*kinect_frame, keyframe, candidates[i].color_codec,
+                                                         DepthCodec::TiledTrvlZstd, DepthQuantization::InverseDepth, profilers[i])};
+            max_frame_kilobytes[i] = std::max(max_frame_kilobytes[i], (frame.vp8_frame.size() + frame.trvl_frame.size()) / 1024.0f);
+        }
+
+        if (++frame_count % SUMMARY_FRAME_COUNT != 0)
+            continue;
+
+        std::cout << "Intra Refresh Summary (" << SUMMARY_FRAME_COUNT << " frames):\n";
+        for (size_t i{0}; i < candidates.size(); ++i) {
+            auto& profiler{profilers[i]};
+            const float frame_kilobyte_mean{profiler.getNumber("pipeline-framekilobyte") / SUMMARY_FRAME_COUNT};
+            const float frame_kilobyte_squared_mean{profiler.getNumber("pipeline-framekilobyte-squared") / SUMMARY_FRAME_COUNT};
+            std::cout << "  " << candidates[i].name << ":\n";
+            std::cout << "    Keyframes: " << profiler.getNumber("pipeline-keyframe") << "\n";
+            std::cout << "    Color Encode Time Average: " << profiler.getNumber("pipeline-vp8") / SUMMARY_FRAME_COUNT << " ms\n";
+            std::cout << "    Frame Size Average: " << frame_kilobyte_mean << " KB\n";
+            std::cout << "    Frame Size Standard Deviation: "
+                      << std::sqrt(std::max(frame_kilobyte_squared_mean - frame_kilobyte_mean * frame_kilobyte_mean, 0.0f)) << " KB\n";
+            std::cout << "    Frame Size Max: " << max_frame_kilobytes[i] << " KB\n";
+            profiler.reset();
+            max_frame_kilobytes[i] = 0.0f;
+        }
+    }
+}
+
+// Times the startup work of the rays of depth pixels: unprojecting pixels one at a time as the sender used to,
+// computing a DepthRayTable in parallel, and mapping its cache file, which gets written to a temporary folder first.
+void compare_depth_ray_tables(KinectInterface& kinect_interface)
+{
+    const auto calibration{kinect_interface.getCalibration()};
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+    const std::string cache_folder_path{(std::filesystem::temp_directory_path() / "KinectToHololensReader").string()};
+    std::filesystem::remove_all(cache_folder_path);
+
+    const auto serial_start{tt::TimePoint::now()};
+    std::vector<float> unit_depth_x(width * height);
+    k4a_float3_t point;
+    for (int j{0}; j < height; ++j) {
+        for (int i{0}; i < width; ++i) {
+            if (calibration.convert_2d_to_3d(k4a_float2_t{gsl::narrow<float>(i), gsl::narrow<float>(j)}, 1.0f,
+                                             K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH, &point)) {
+                unit_depth_x[i + j * width] = point.xyz.x;
+            }
+        }
+    }
+    const float serial_time_ms{serial_start.elapsed_time().ms()};
+
+    const auto parallel_start{tt::TimePoint::now()};
+    const auto computed_table{DepthRayTable::create(calibration, std::nullopt)};
+    const float parallel_time_ms{parallel_start.elapsed_time().ms()};
+
+    const auto written_start{tt::TimePoint::now()};
+    const auto written_table{DepthRayTable::create(calibration, cache_folder_path)};
+    const float written_time_ms{written_start.elapsed_time().ms()};
+
+    const auto mapped_start{tt::TimePoint::now()};
+    const auto mapped_table{DepthRayTable::create(calibration, cache_folder_path)};
+    const float mapped_time_ms{mapped_start.elapsed_time().ms()};
+
+    const bool identical{mapped_table->mapped()
+                         && std::equal(unit_depth_x.begin(), unit_depth_x.end(), mapped_table->x().begin())
+                         && std::equal(computed_table->y().begin(), computed_table->y().end(), mapped_table->y().begin())
+                         && std::equal(computed_table->valid().begin(), computed_table->valid().end(), mapped_table->valid().begin())};
+
+    std::cout << "Depth Ray Table Summary:\n";
+    std::cout << "  Serial Unprojection Time: " << serial_time_ms << " ms\n";
+    std::cout << "  Parallel Unprojection Time: " << parallel_time_ms << " ms\n";
+    std::cout << "  Parallel Unprojection and Cache File Writing Time: " << written_time_ms << " ms\n";
+    std::cout << "  Cache File Mapping Time: " << mapped_time_ms << " ms\n";
+    std::cout << "  Mapped Table Identical: " << (identical ? "yes" : "no") << "\n";
+}
+
+// Copies synthetic callbacks of float32 samples between SoundIoChannelArea buffers and interleaved stereo samples
+// a sample at a time, as the audio callbacks used to, and with read_channel_areas() and write_channel_areas()
+// to check that both copy the same samples and compare their time per callback.
+// Areas of 7 channels are the layout of the Kinect microphone and areas of 2 channels are the one of stereo speakers.
+void compare_channel_area_copies()
+{
+    constexpr int CALLBACK_COUNT{10000};
+    constexpr int BYTES_PER_SAMPLE{sizeof(float)};
+    constexpr std::array<int, 2> AREA_CHANNEL_COUNTS{7, 2};
+
+    std::cout << "Channel Area Copy Summary (" << CALLBACK_COUNT << " callbacks of " << KH_SAMPLES_PER_FRAME << " frames):\n";
+    for (const int area_channel_count : AREA_CHANNEL_COUNTS) {
+        std::vector<float> area_samples(KH_SAMPLES_PER_FRAME * area_channel_count);
+        for (size_t i{0}; i < area_samples.size(); ++i)
+            area_samples[i] = static_cast<float>(i);
+
+        std::vector<SoundIoChannelArea> areas(area_channel_count);
+        for (int ch{0}; ch < area_channel_count; ++ch)
+            areas[ch] = SoundIoChannelArea{reinterpret_cast<char*>(area_samples.data() + ch), area_channel_count * BYTES_PER_SAMPLE};
+
+        std::vector<float> per_sample_samples(KH_SAMPLES_PER_FRAME * KH_CHANNEL_COUNT);
+        const auto per_sample_read_start{tt::TimePoint::now()};
+        for (int callback{0}; callback < CALLBACK_COUNT; ++callback) {
+            char* samples{reinterpret_cast<char*>(per_sample_samples.data())};
+            for (int frame{0}; frame < KH_SAMPLES_PER_FRAME; ++frame) {
+                for (int ch{0}; ch < KH_CHANNEL_COUNT; ++ch) {
+                    memcpy(samples, areas[ch].ptr + frame * areas[ch].step, BYTES_PER_SAMPLE);
+                    samples += BYTES_PER_SAMPLE;
+                }
+            }
+        }
+        const float per_sample_read_time_ms{per_sample_read_start.elapsed_time().ms()};
+
+        std::vector<float> samples(KH_SAMPLES_PER_FRAME * KH_CHANNEL_COUNT);
+        const auto read_start{tt::TimePoint::now()};
+        for (int callback{0}; callback < CALLBACK_COUNT; ++callback)
+            read_channel_areas(areas.data(), KH_CHANNEL_COUNT, BYTES_PER_SAMPLE, KH_SAMPLES_PER_FRAME, reinterpret_cast<char*>(samples.data()));
+        const float read_time_ms{read_start.elapsed_time().ms()};
+        const bool read_matched{samples == per_sample_samples};
+
+        std::vector<float> per_sample_area_samples(area_samples.size(), 0.0f);
+        for (int ch{0}; ch < area_channel_count; ++ch)
+            areas[ch].ptr = reinterpret_cast<char*>(per_sample_area_samples.data() + ch);
+        const auto per_sample_write_start{tt::TimePoint::now()};
+        for (int callback{0}; callback < CALLBACK_COUNT; ++callback) {
+            const char* source{reinterpret_cast<const char*>(samples.data())};
+            for (int frame{0}; frame < KH_SAMPLES_PER_FRAME; ++frame) {
+                for (int ch{0}; ch < KH_CHANNEL_COUNT; ++ch) {
+                    memcpy(areas[ch].ptr + frame * areas[ch].step, source, BYTES_PER_SAMPLE);
+                    source += BYTES_PER_SAMPLE;
+                }
+            }
+        }
+        const float per_sample_write_time_ms{per_sample_write_start.elapsed_time().ms()};
+
+        std::vector<float> written_area_samples(area_samples.size(), 0.0f);
+        for (int ch{0}; ch < area_channel_count; ++ch)
+            areas[ch].ptr = reinterpret_cast<char*>(written_area_samples.data() + ch);
+        const auto write_start{tt::TimePoint::now()};
+        for (int callback{0}; callback < CALLBACK_COUNT; ++callback)
+            write_channel_areas(reinterpret_cast<const char*>(samples.data()), KH_CHANNEL_COUNT, BYTES_PER_SAMPLE, KH_SAMPLES_PER_FRAME, areas.data());
+        const float write_time_ms{write_start.elapsed_time().ms()};
+        const bool write_matched{written_area_samples == per_sample_area_samples};
+
+        std::cout << "  Areas of " << area_channel_count << " Channels:\n";
+        std::cout << "    Per-Sample Read Time Average: " << per_sample_read_time_ms * 1000000.0f / CALLBACK_COUNT << " ns\n";
+        std::cout << "    read_channel_areas() Time Average: " << read_time_ms * 1000000.0f / CALLBACK_COUNT << " ns\n";
+        std::cout << "    Read Samples Matched: " << (read_matched ? "yes" : "no") << "\n";
+        std::cout << "    Per-Sample Write Time Average: " << per_sample_write_time_ms * 1000000.0f / CALLBACK_COUNT << " ns\n";
+        std::cout << "    write_channel_areas() Time Average: " << write_time_ms * 1000000.0f / CALLBACK_COUNT << " ns\n";
+        std::cout << "    Written Samples Matched: " << (write_matched ? "yes" : "no") << "\n";
+    }
+}
+
+// Plays a synthetic packet trace with jitter, delay spikes, random and burst loss, and a sender clock running fast
+// through an AudioJitterBuffer and a simulated speaker consuming a frame from the ring buffer every 20 ms.
+// Checks that frames come out in order with the packets they should decode, and reports how the frames got filled.
+void test_audio_jitter_buffer()
+{
+    constexpr int FRAME_COUNT{3000};
+    constexpr float TICK_MS{5.0f};
+    constexpr float BASE_DELAY_MS{30.0f};
+    constexpr float MAX_JITTER_MS{40.0f};
+    constexpr float SPIKE_PROBABILITY{0.01f};
+    constexpr float SPIKE_MS{120.0f};
+    constexpr float LOSS_PROBABILITY{0.03f};
+    constexpr float BURST_LOSS_PROBABILITY{0.005f};
+    constexpr int BURST_LOSS_FRAME_COUNT{3};
+    constexpr float SENDER_CLOCK_RATIO{1.001f};
+    constexpr int RING_BUFFER_CAPACITY_FRAME_COUNT{20};
+
+    struct TracePacket
+    {
+        float arrival_ms;
+        int frame_id;
+    };
+
+    std::mt19937 random_engine{3773};
+    std::uniform_real_distribution<float> unit_distribution{0.0f, 1.0f};
+    std::vector<TracePacket> trace;
+    for (int frame_id{0}; frame_id < FRAME_COUNT;) {
+        if (unit_distribution(random_engine) < BURST_LOSS_PROBABILITY) {
+            frame_id += BURST_LOSS_FRAME_COUNT;
+            continue;
+        }
+        if (unit_distribution(random_engine) >= LOSS_PROBABILITY) {
+            float delay_ms{BASE_DELAY_MS + unit_distribution(random_engine) * MAX_JITTER_MS};
+            if (unit_distribution(random_engine) < SPIKE_PROBABILITY)
+                delay_ms += SPIKE_MS;
+            trace.push_back(TracePacket{frame_id * KH_AUDIO_FRAME_MS / SENDER_CLOCK_RATIO + delay_ms, frame_id});
+        }
+        ++frame_id;
+    }
+    std::sort(trace.begin(), trace.end(), [](const TracePacket& a, const TracePacket& b) { return a.arrival_ms < b.arrival_ms; });
+
+    AudioJitterBuffer jitter_buffer;
+    std::deque<int> ring_buffer_frame_ids;
+    auto trace_it{trace.begin()};
+    std::optional<int> last_frame_id;
+    int mismatch_count{0};
+    int underflow_count{0};
+    int played_frame_count{0};
+    float delay_ms_sum{0.0f};
+    float target_delay_frame_count_sum{0.0f};
+    float next_playback_ms{0.0f};
+    for (float time_ms{0.0f}; trace_it != trace.end() || !ring_buffer_frame_ids.empty(); time_ms += TICK_MS) {
+        for (; trace_it != trace.end() && trace_it->arrival_ms <= time_ms; ++trace_it) {
+            std::vector<std::byte> opus_frame(sizeof(int));
+            memcpy(opus_frame.data(), &trace_it->frame_id, sizeof(int));
+            jitter_buffer.add(trace_it->frame_id, std::move(opus_frame), trace_it->arrival_ms);
+        }
+
+        while (ring_buffer_frame_ids.size() < RING_BUFFER_CAPACITY_FRAME_COUNT) {
+            const auto frame{jitter_buffer.pop(gsl::narrow<int>(ring_buffer_frame_ids.size()))};
+            if (!frame)
+                break;
+
+            // Frames only move forward, and the packets to decode are the ones of the frames or the next frames for FEC.
+            if (last_frame_id && frame->frame_id <= *last_frame_id)
+                ++mismatch_count;
+            if (frame->source != AudioFrameSource::Concealment) {
+                int packet_frame_id;
+                memcpy(&packet_frame_id, frame->opus_frame.data(), sizeof(int));
+                if (packet_frame_id != frame->frame_id + (frame->source == AudioFrameSource::ForwardErrorCorrection ? 1 : 0))
+                    ++mismatch_count;
+            }
+            last_frame_id = frame->frame_id;
+            ring_buffer_frame_ids.push_back(frame->frame_id);
+        }
+
+        target_delay_frame_count_sum += jitter_buffer.target_delay_frame_count();
+        if (time_ms < next_playback_ms)
+            continue;
+        next_playback_ms += KH_AUDIO_FRAME_MS;
+
+        if (ring_buffer_frame_ids.empty()) {
+            if (last_frame_id)
+                ++underflow_count;
+            continue;
+        }
+        delay_ms_sum += time_ms - ring_buffer_frame_ids.front() * KH_AUDIO_FRAME_MS / SENDER_CLOCK_RATIO;
+        ++played_frame_count;
+        ring_buffer_frame_ids.pop_front();
+    }
+
+    const auto& stats{jitter_buffer.stats()};
+    const float tick_count{(trace.back().arrival_ms + TICK_MS) / TICK_MS};
+    std::cout << "Audio Jitter Buffer Test (" << FRAME_COUNT << " frames, " << trace.size() << " packets):\n";
+    std::cout << "  Mismatched Frames: " << mismatch_count << "\n";
+    std::cout << "  Packet Frames: " << stats.packet_frame_count << "\n";
+    std::cout << "  FEC Frames: " << stats.fec_frame_count << "\n";
+    std::cout << "  Concealed Frames: " << stats.concealed_frame_count << "\n";
+    std::cout << "  Late Packets: " << stats.late_packet_count << "\n";
+    std::cout << "  Drift Dropped Frames: " << stats.drift_dropped_frame_count << "\n";
+    std::cout << "  Underflows: " << underflow_count << "\n";
+    std::cout << "  Jitter: " << jitter_buffer.jitter_ms() << " ms\n";
+    std::cout << "  Target Delay Average: " << target_delay_frame_count_sum / tick_count << " frames\n";
+    std::cout << "  Playback Delay Average: " << delay_ms_sum / played_frame_count << " ms\n";
+}
+
+// Bundles synthetic Opus frames with an AudioBundler for each bundle frame count and fans each bundle out to several receivers.
+// Checks that every receiver reads the frames back in order with frame IDs advancing once per frame and the time stamps of bundles,
+// including bundles completed early by frames too large to fit, and reports the packet rates.
+void test_audio_bundler()
+{
+    constexpr int FRAME_COUNT{3000};
+    constexpr int RECEIVER_COUNT{3};
+    constexpr int MIN_OPUS_FRAME_SIZE{60};
+    constexpr int MAX_OPUS_FRAME_SIZE{400};
+    constexpr float LARGE_OPUS_FRAME_PROBABILITY{0.02f};
+
+    std::cout << "Audio Bundler Test (" << FRAME_COUNT << " frames, " << RECEIVER_COUNT << " receivers):\n";
+    for (int bundle_frame_count{1}; bundle_frame_count <= KH_MAX_AUDIO_BUNDLE_FRAME_COUNT; ++bundle_frame_count) {
+        std::mt19937 random_engine{3773};
+        std::uniform_int_distribution<int> size_distribution{MIN_OPUS_FRAME_SIZE, MAX_OPUS_FRAME_SIZE};
+        std::uniform_real_distribution<float> unit_distribution{0.0f, 1.0f};
+
+        AudioBundler bundler{0, bundle_frame_count};
+        std::vector<std::byte> opus_frame(tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE);
+        std::array<int, RECEIVER_COUNT> next_frame_ids{};
+        int mismatch_count{0};
+        int packet_count{0};
+        int early_packet_count{0};
+        size_t byte_count{0};
+        for (int i{0}; i < FRAME_COUNT; ++i) {
+            // Frames of the largest size make bundles get completed before them.
+            const int opus_frame_size{unit_distribution(random_engine) < LARGE_OPUS_FRAME_PROBABILITY ? tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE
+                                                                                                      : size_distribution(random_engine)};
+            for (int j{0}; j < opus_frame_size; ++j)
+                opus_frame[j] = static_cast<std::byte>(i + j);
+
+            if (bundler.add(gsl::span<const std::byte>{opus_frame.data(), gsl::narrow<size_t>(opus_frame_size)}, i * KH_AUDIO_FRAME_MS) != i)
+                ++mismatch_count;
+
+            const auto bundle{bundler.completed_bundle()};
+            if (!bundle)
+                continue;
+
+            ++packet_count;
+            byte_count += bundle->size();
+            for (int receiver_index{0}; receiver_index < RECEIVER_COUNT; ++receiver_index) {
+                const auto audio_bundle_packet{read_audio_bundle_sender_packet(*bundle)};
+                const auto& audio_packets{audio_bundle_packet.audio_packets};
+                const auto first_frame_time_stamp{audio_bundle_packet.first_frame_time_stamp};
+                if (first_frame_time_stamp.time_stamp != first_frame_time_stamp.frame_id * KH_AUDIO_FRAME_MS)
+                    ++mismatch_count;
+                if (receiver_index == 0 && gsl::narrow<int>(audio_packets.size()) < bundle_frame_count)
+                    ++early_packet_count;
+                for (const auto& audio_packet : audio_packets) {
+                    if (audio_packet.frame_id != next_frame_ids[receiver_index]++)
+                        ++mismatch_count;
+                    for (gsl::index j{0}; j < audio_packet.opus_frame.size(); ++j) {
+                        if (audio_packet.opus_frame[j] != static_cast<std::byte>(audio_packet.frame_id + j)) {
+                            ++mismatch_count;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        // Frames of the bundle being built when the test stops are the only ones not received.
+        for (int next_frame_id : next_frame_ids) {
+            if (FRAME_COUNT - next_frame_id >= bundle_frame_count)
+                ++mismatch_count;
+        }
+
+        std::cout << "  Bundle Frame Count " << bundle_frame_count << ":\n";
+        std::cout << "    Mismatches: " << mismatch_count << "\n";
+        std::cout << "    Packets Per Second: " << packet_count / (FRAME_COUNT * KH_AUDIO_FRAME_MS / 1000.0f) << "\n";
+        std::cout << "    Packets Completed Early: " << early_packet_count << "\n";
+        std::cout << "    Packet Size Average: " << byte_count / static_cast<float>(packet_count) << " bytes\n";
+    }
+}
+
+// Decodes synthetic Opus streams of tones and mixes them for 1, 4, and 8 streams, as AudioReceiver does for several senders,
+// with a scalar loop of gains and clamping, as the receiver used to for one sender, and with mix_audio_samples() and an AudioLimiter.
+// Checks that both mix the same samples before limiting and reports the time per frame and the peaks.
+void compare_audio_mixers()
+{
+    constexpr int FRAME_COUNT{500};
+    constexpr std::array<int, 3> STREAM_COUNTS{1, 4, 8};
+    constexpr int FRAME_SAMPLE_COUNT{KH_SAMPLES_PER_FRAME * KH_CHANNEL_COUNT};
+    constexpr double PI{3.14159265358979323846};
+    // Loud enough with KH_DEFAULT_AUDIO_GAIN for a few streams to clip without limiting.
+    constexpr double TONE_AMPLITUDE{0.05};
+
+    std::cout << "Audio Mixer Summary (" << FRAME_COUNT << " frames of " << KH_AUDIO_FRAME_MS << " ms):\n";
+    for (const int stream_count : STREAM_COUNTS) {
+        // Streams of tones at different frequencies, encoded before the timing starts since senders encode them.
+        std::vector<std::vector<std::vector<std::byte>>> opus_frames(stream_count);
+        std::vector<float> tone_pcm(FRAME_SAMPLE_COUNT);
+        for (int s{0}; s < stream_count; ++s) {
+            auto opus_encoder{tt::create_opus_encoder_handle(KH_SAMPLE_RATE, KH_CHANNEL_COUNT)};
+            const double frequency{220.0 * (s + 1)};
+            for (int f{0}; f < FRAME_COUNT; ++f) {
+                for (int i{0}; i < KH_SAMPLES_PER_FRAME; ++i) {
+                    const double t{(f * KH_SAMPLES_PER_FRAME + i) / static_cast<double>(KH_SAMPLE_RATE)};
+                    const float sample{static_cast<float>(TONE_AMPLITUDE * std::sin(2.0 * PI * frequency * t))};
+                    for (int ch{0}; ch < KH_CHANNEL_COUNT; ++ch)
+                        tone_pcm[i * KH_CHANNEL_COUNT + ch] = sample;
+                }
+
+                std::vector<std::byte> opus_frame(tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE);
+                const int opus_frame_size{tt::encode_opus(opus_encoder, opus_frame.data(), tone_pcm.data(), KH_SAMPLES_PER_FRAME,
+                                                          tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE)};
+                if (opus_frame_size < 0)
+                    throw std::runtime_error(std::string("Failed to encode audio: ") + opus_strerror(opus_frame_size));
+                opus_frame.resize(opus_frame_size);
+                opus_frames[s].push_back(std::move(opus_frame));
+            }
+        }
+
+        std::vector<tt::OpusDecoderHandle> opus_decoders;
+        for (int s{0}; s < stream_count; ++s)
+            opus_decoders.push_back(tt::create_opus_decoder_handle(KH_SAMPLE_RATE, KH_CHANNEL_COUNT));
+        std::vector<std::vector<float>> stream_pcms(stream_count, std::vector<float>(FRAME_SAMPLE_COUNT));
+        std::vector<float> scalar_mix(FRAME_SAMPLE_COUNT);
+        std::vector<float> mix(FRAME_SAMPLE_COUNT);
+        AudioLimiter limiter;
+
+        float decode_time_ms{0.0f};
+        float scalar_mix_time_ms{0.0f};
+        float mix_time_ms{0.0f};
+        float max_mix_difference{0.0f};
+        int clipped_frame_count{0};
+        float max_limited_peak{0.0f};
+        for (int f{0}; f < FRAME_COUNT; ++f) {
+            const auto decode_start{tt::TimePoint::now()};
+            for (int s{0}; s < stream_count; ++s) {
+                const int frame_size{tt::decode_opus(opus_decoders[s], opus_frames[s][f], stream_pcms[s].data(), KH_SAMPLES_PER_FRAME, 0)};
+                if (frame_size < 0)
+                    throw std::runtime_error(std::string("Failed to decode audio: ") + opus_strerror(frame_size));
+            }
+            decode_time_ms += decode_start.elapsed_time().ms();
+
+            const auto scalar_mix_start{tt::TimePoint::now()};
+            std::fill(scalar_mix.begin(), scalar_mix.end(), 0.0f);
+            for (int s{0}; s < stream_count; ++s) {
+                for (gsl::index i{0}; i < FRAME_SAMPLE_COUNT; ++i)
+                    scalar_mix[i] += stream_pcms[s][i] * KH_DEFAULT_AUDIO_GAIN;
+            }
+            for (gsl::index i{0}; i < FRAME_SAMPLE_COUNT; ++i)
+                scalar_mix[i] = std::clamp(scalar_mix[i], -1.0f, 1.0f);
+            scalar_mix_time_ms += scalar_mix_start.elapsed_time().ms();
+
+            // The time stops while checking the mix before limiting.
+            const auto mix_start{tt::TimePoint::now()};
+            std::fill(mix.begin(), mix.end(), 0.0f);
+            for (int s{0}; s < stream_count; ++s)
+                mix_audio_samples(stream_pcms[s], KH_DEFAULT_AUDIO_GAIN, mix);
+            mix_time_ms += mix_start.elapsed_time().ms();
+
+            for (gsl::index i{0}; i < FRAME_SAMPLE_COUNT; ++i)
+                max_mix_difference = std::max(max_mix_difference, std::abs(std::clamp(mix[i], -1.0f, 1.0f) - scalar_mix[i]));
+            if (find_audio_peak(mix) > 1.0f)
+                ++clipped_frame_count;
+
+            const auto limiter_start{tt::TimePoint::now()};
+            limiter.apply(mix);
+            mix_time_ms += limiter_start.elapsed_time().ms();
+            max_limited_peak = std::max(max_limited_peak, find_audio_peak(mix));
+        }
+
+        std::cout << "  " << stream_count << " Streams:\n";
+        std::cout << "    Decode Time Average: " << decode_time_ms / FRAME_COUNT << " ms\n";
+        std::cout << "    Scalar Mix Time Average: " << scalar_mix_time_ms * 1000.0f / FRAME_COUNT << " us\n";
+        std::cout << "    SIMD Mix and Limiter Time Average: " << mix_time_ms * 1000.0f / FRAME_COUNT << " us\n";
+        std::cout << "    Max Mix Difference: " << max_mix_difference << "\n";
+        std::cout << "    Frames Clipping Without Limiter: " << clipped_frame_count << "\n";
+        std::cout << "    Peak With Limiter: " << max_limited_peak << "\n";
+        std::cout << "    Audio Thread Load: " << (decode_time_ms + mix_time_ms) / (FRAME_COUNT * KH_AUDIO_FRAME_MS) * 100.0f << " %\n";
+    }
+}
+
+// Fans out the packets of synthetic video frames from a sender socket to 1, 4, and 8 receivers on loopback
+// with unicast and with a multicast group as kh_sender does, and reports the bandwidth of the sender at 30 fps.
+// Also checks that every receiver gets every packet, which covers the multicast group looping back to this machine.
+void compare_video_fan_outs()
+{
+    constexpr std::array<int, 3> RECEIVER_COUNTS{1, 4, 8};
+    constexpr int FRAME_COUNT{90};
+    constexpr float FRAME_RATE{30.0f};
+    // About 10 Mbps at 30 fps, which is in the range of the sender with VP8 and TRVL.
+    constexpr int VIDEO_MESSAGE_SIZE{40000};
+    // A port other than the one of kh_sender not to disturb a sender running on this machine.
+    constexpr const char* MULTICAST_ADDRESS{"239.255.37.73"};
+    constexpr unsigned short MULTICAST_PORT{3780};
+    constexpr int RECEIVER_RECEIVE_BUFFER_SIZE{1024 * 1024};
+
+    asio::io_context io_context;
+    const asio::ip::udp::endpoint multicast_endpoint{asio::ip::make_address(MULTICAST_ADDRESS), MULTICAST_PORT};
+    const std::vector<std::byte> video_message_bytes(VIDEO_MESSAGE_SIZE);
+
+    std::cout << "Video Fan-Out Summary (" << FRAME_COUNT << " frames of " << VIDEO_MESSAGE_SIZE << " bytes):\n";
+    for (const bool multicast : {false, true}) {
+        for (const int receiver_count : RECEIVER_COUNTS) {
+            asio::ip::udp::socket sender_socket{io_context, asio::ip::udp::endpoint{asio::ip::address_v4::loopback(), 0}};
+            sender_socket.set_option(asio::ip::multicast::hops{1});
+            sender_socket.set_option(asio::ip::multicast::enable_loopback{true});
+            sender_socket.set_option(asio::ip::multicast::outbound_interface{asio::ip::address_v4::loopback()});
+            tt::UdpSocket sender_udp_socket{std::move(sender_socket)};
+
+            RemoteReceiverRegistry remote_receivers{1.0f, 5.0f};
+            std::vector<std::unique_ptr<tt::UdpSocket>> receiver_udp_sockets;
+            for (int receiver_id{0}; receiver_id < receiver_count; ++receiver_id) {
+                asio::ip::udp::socket receiver_socket{io_context, asio::ip::udp::endpoint{asio::ip::address_v4::loopback(), 0}};
+                receiver_socket.set_option(asio::socket_base::receive_buffer_size{RECEIVER_RECEIVE_BUFFER_SIZE});
+                auto& remote_receiver{remote_receivers.add(RemoteReceiver{receiver_socket.local_endpoint(), receiver_id, true, false})};
+                remote_receiver.multicast = multicast;
+
+                // Receivers in the multicast group get video packets through another socket as kh_receiver does.
+                if (multicast) {
+                    receiver_socket = asio::ip::udp::socket{io_context, asio::ip::udp::v4()};
+                    receiver_socket.set_option(asio::ip::udp::socket::reuse_address{true});
+                    receiver_socket.set_option(asio::socket_base::receive_buffer_size{RECEIVER_RECEIVE_BUFFER_SIZE});
+                    receiver_socket.bind(asio::ip::udp::endpoint{asio::ip::address_v4::any(), MULTICAST_PORT});
+                    receiver_socket.set_option(asio::ip::multicast::join_group{multicast_endpoint.address().to_v4(), asio::ip::address_v4::loopback()});
+                }
+                receiver_udp_sockets.push_back(std::make_unique<tt::UdpSocket>(std::move(receiver_socket)));
+            }
+
+            tt::Profiler profiler;
+            int sent_packet_count{0};
+            std::vector<int> received_packet_counts(receiver_count, 0);
+            for (int frame_id{0}; frame_id < FRAME_COUNT; ++frame_id) {
+                auto video_packets{tt::split_video_sender_message_bytes(0, frame_id, video_message_bytes)};
+                auto parity_packets{tt::create_parity_sender_packets(0, frame_id, video_packets)};
+                std::vector<tt::Packet*> packet_ptrs;
+                for (auto& video_packet : video_packets)
+                    packet_ptrs.push_back(&video_packet);
+                for (auto& parity_packet : parity_packets)
+                    packet_ptrs.push_back(&parity_packet);
+                sent_packet_count += gsl::narrow<int>(packet_ptrs.size());
+
+                fan_out_video_packets(packet_ptrs, frame_id, sender_udp_socket, multicast ? std::optional{multicast_endpoint} : std::nullopt,
+                                      remote_receivers, profiler);
+
+                // Loopback delivers within a millisecond.
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                for (int receiver_id{0}; receiver_id < receiver_count; ++receiver_id) {
+                    while (receiver_udp_sockets[receiver_id]->receive(tt::KH_PACKET_SIZE))
+                        ++received_packet_counts[receiver_id];
+                }
+            }
+
+            const int min_received_packet_count{*std::min_element(received_packet_counts.begin(), received_packet_counts.end())};
+            std::cout << "  " << (multicast ? "Multicast" : "Unicast") << " to " << receiver_count << " Receivers:\n";
+            std::cout << "    Sender Bandwidth: " << profiler.getNumber("send-video-byte") * FRAME_RATE / FRAME_COUNT / (1024.0f * 1024.0f / 8.0f) << " Mbps\n";
+            std::cout << "    Packets Received by Every Receiver: " << (min_received_packet_count == sent_packet_count ? "yes" : "no")
+                      << " (" << min_received_packet_count << " of " << sent_packet_count << " for the receiver missing the most)\n";
+        }
+    }
+}
+
+// Connects simulated receivers through loopback sockets to a RemoteReceiverRegistry as kh_sender does
+// and times the parts of the sender loop that serve them: classifying their packets, applying their reports
+// with the minimum video frame ID the registry keeps, compared with scanning every receiver for it,
+// and the timer wheels sending heartbeats and finding timeouts.
+void benchmark_remote_receiver_fleet()
+{
+    constexpr std::array<int, 3> RECEIVER_COUNTS{100, 300, 500};
+    constexpr int LOOP_COUNT{600};
+    constexpr std::chrono::milliseconds LOOP_INTERVAL{5};
+    constexpr float HEARTBEAT_INTERVAL_SEC{1.0f};
+    constexpr float HEARTBEAT_TIME_OUT_SEC{5.0f};
+    constexpr int SENDER_RECEIVE_BUFFER_SIZE{4 * 1024 * 1024};
+    // Receivers report frames up to this many frames behind the newest one.
+    constexpr int REPORT_LAG_FRAME_COUNT{4};
+
+    asio::io_context io_context;
+    std::cout << "Remote Receiver Fleet Benchmark (" << LOOP_COUNT << " loops " << LOOP_INTERVAL.count() << " ms apart):\n";
+    for (const int receiver_count : RECEIVER_COUNTS) {
+        asio::ip::udp::socket sender_socket{io_context, asio::ip::udp::endpoint{asio::ip::address_v4::loopback(), 0}};
+        sender_socket.set_option(asio::socket_base::receive_buffer_size{SENDER_RECEIVE_BUFFER_SIZE});
+        const auto sender_endpoint{sender_socket.local_endpoint()};
+        tt::UdpSocket sender_udp_socket{std::move(sender_socket)};
+
+        std::vector<std::unique_ptr<tt::UdpSocket>> receiver_udp_sockets;
+        for (int receiver_id{0}; receiver_id < receiver_count; ++receiver_id) {
+            asio::ip::udp::socket receiver_socket{io_context, asio::ip::udp::endpoint{asio::ip::address_v4::loopback(), 0}};
+            receiver_udp_sockets.push_back(std::make_unique<tt::UdpSocket>(std::move(receiver_socket)));
+            receiver_udp_sockets.back()->send(tt::create_connect_receiver_packet(receiver_id, true, false).bytes, sender_endpoint);
+        }
+
+        RemoteReceiverRegistry remote_receivers{HEARTBEAT_INTERVAL_SEC, HEARTBEAT_TIME_OUT_SEC};
+        for (int attempt{0}; attempt < 100 && gsl::narrow<int>(remote_receivers.size()) < receiver_count; ++attempt) {
+            for (auto& connect_packet_info : ReceiverPacketClassifier::classify(sender_udp_socket, remote_receivers).connect_packet_infos) {
+                const auto& connect_packet{connect_packet_info.connect_packet};
+                if (!remote_receivers.find(connect_packet.receiver_id)) {
+                    remote_receivers.add(RemoteReceiver{connect_packet_info.receiver_endpoint, connect_packet.receiver_id,
+                                                        connect_packet.video_requested, connect_packet.audio_requested});
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+
+        std::vector<int> heartbeat_receiver_ids;
+        std::vector<int> timed_out_receiver_ids;
+        float classify_time_ms{0.0f};
+        float report_time_ms{0.0f};
+        float scan_time_ms{0.0f};
+        float timer_time_ms{0.0f};
+        int heartbeat_count{0};
+        int timed_out_count{0};
+        int mismatch_count{0};
+        const auto benchmark_start{tt::TimePoint::now()};
+        for (int loop{0}; loop < LOOP_COUNT; ++loop) {
+            for (int receiver_id{0}; receiver_id < receiver_count; ++receiver_id) {
+                receiver_udp_sockets[receiver_id]->send(tt::create_report_receiver_packet(receiver_id, loop - receiver_id % REPORT_LAG_FRAME_COUNT).bytes,
+                                                        sender_endpoint);
+            }
+
+            const auto classify_start{tt::TimePoint::now()};
+            auto receiver_packet_collection{ReceiverPacketClassifier::classify(sender_udp_socket, remote_receivers)};
+            classify_time_ms += classify_start.elapsed_time().ms();
+
+            const auto report_start{tt::TimePoint::now()};
+            for (auto& receiver_packet_info : receiver_packet_collection.receiver_packet_infos) {
+                auto& remote_receiver{*remote_receivers.find(receiver_packet_info.receiver_id)};
+                for (auto& report_packet : receiver_packet_info.report_packets) {
+                    if (!remote_receiver.video_frame_id || report_packet.frame_id > *remote_receiver.video_frame_id)
+                        remote_receivers.set_video_frame_id(remote_receiver, report_packet.frame_id);
+                }
+                remote_receiver.last_packet_time = tt::TimePoint::now();
+            }
+            const auto min_video_frame_id{remote_receivers.min_video_frame_id()};
+            report_time_ms += report_start.elapsed_time().ms();
+
+            // What the registry saves every loop.
+            const auto scan_start{tt::TimePoint::now()};
+            std::optional<int> scanned_min_video_frame_id;
+            for (auto& remote_receiver : remote_receivers) {
+                if (remote_receiver.video_frame_id && (!scanned_min_video_frame_id || *remote_receiver.video_frame_id < *scanned_min_video_frame_id))
+                    scanned_min_video_frame_id = remote_receiver.video_frame_id;
+            }
+            scan_time_ms += scan_start.elapsed_time().ms();
+            if (scanned_min_video_frame_id != min_video_frame_id)
+                ++mismatch_count;
+
+            const auto timer_start{tt::TimePoint::now()};
+            heartbeat_receiver_ids.clear();
+            timed_out_receiver_ids.clear();
+            remote_receivers.update_timers(heartbeat_receiver_ids, timed_out_receiver_ids);
+            for (int receiver_id : heartbeat_receiver_ids)
+                sender_udp_socket.send(tt::create_heartbeat_sender_packet(0).bytes, remote_receivers.find(receiver_id)->endpoint);
+            timer_time_ms += timer_start.elapsed_time().ms();
+            heartbeat_count += gsl::narrow<int>(heartbeat_receiver_ids.size());
+            timed_out_count += gsl::narrow<int>(timed_out_receiver_ids.size());
+
+            // Receivers drain their heartbeats outside the timing.
+            for (auto& receiver_udp_socket : receiver_udp_sockets) {
+                while (receiver_udp_socket->receive(tt::KH_PACKET_SIZE)) {}
+            }
+            std::this_thread::sleep_for(LOOP_INTERVAL);
+        }
+        const float benchmark_time_sec{benchmark_start.elapsed_time().sec()};
+
+        std::cout << "  " << receiver_count << " Receivers:\n";
+        std::cout << "    Connected: " << remote_receivers.size() << "\n";
+        std::cout << "    Classify Time Average: " << classify_time_ms * 1000.0f / LOOP_COUNT << " us\n";
+        std::cout << "    Report and Min Frame ID Time Average: " << report_time_ms * 1000.0f / LOOP_COUNT << " us\n";
+        std::cout << "    Min Frame ID Scan Time Average: " << scan_time_ms * 1000.0f / LOOP_COUNT << " us\n";
+        std::cout << "    Timer Wheel and Heartbeat Time Average: " << timer_time_ms * 1000.0f / LOOP_COUNT << " us\n";
+        std::cout << "    Heartbeats Per Second: " << heartbeat_count / benchmark_time_sec << "\n";
+        std::cout << "    Timed Out: " << timed_out_count << "\n";
+        std::cout << "    Min Frame ID Mismatches: " << mismatch_count << "\n";
+    }
+}
+
+// Runs a comparison with a device for the bare command or with a file when a filename index follows the command.
+void run_comparison(const std::string& line,
+                    const std::string& command,
+                    const std::optional<DataFolder>& data_folder,
+                    const std::function<void(KinectInterface&)>& comparison)
+{
+    if (line == command) {
+        KinectDevice kinect_device;
+        kinect_device.start();
+        comparison(kinect_device);
+    } else if (data_folder) {
+        try {
+            KinectPlayback playback{data_folder->folder_path + data_folder->filenames.at(stoi(line.substr(command.size())))};
+            comparison(playback);
+        } catch (std::exception) {
+            std::cout << "invalid input\n";
+        }
     }
 }
 
@@ -125,8 +1423,50 @@ void main()
         std::getline(std::cin, line);
 
         // If "calibration" is entered, prints calibration information instead of displaying frames.
+        // If "depth" is entered, optionally followed by a filename index, compares depth codecs instead of displaying frames.
+        // If "color" is entered, likewise, compares color codecs with and without filling color pixels without depth.
+        // If "vp8" is entered, likewise, compares VP8 encoder settings.
+        // If "cloud" is entered, likewise, compares point cloud generators.
+        // If "floor" is entered, likewise, compares floor detectors.
+        // If "table" is entered, likewise, times the ways to obtain the rays of depth pixels.
+        // If "refresh" is entered, likewise, compares frame sizes between catch-up keyframes and intra refresh.
+        // If "roi" is entered, likewise, compares filtering and encoding time, bandwidth, and floor stability with and without RegionOfInterests.
+        // If "audio" is entered, compares copies of synthetic audio callbacks without a device.
+        // If "jitter" is entered, tests AudioJitterBuffer with a synthetic packet trace.
+        // If "bundle" is entered, tests AudioBundler with synthetic Opus frames.
+        // If "fanout" is entered, compares sending video to receivers on loopback with unicast and multicast.
+        // If "fleet" is entered, times serving hundreds of simulated receivers through loopback sockets.
+        // If "mixer" is entered, compares mixing synthetic Opus streams with and without SIMD and limiting.
         if (line == "calibration") {
             read_device_calibration();
+        } else if (line == "audio") {
+            compare_channel_area_copies();
+        } else if (line == "jitter") {
+            test_audio_jitter_buffer();
+        } else if (line == "bundle") {
+            test_audio_bundler();
+        } else if (line == "fanout") {
+            compare_video_fan_outs();
+        } else if (line == "fleet") {
+            benchmark_remote_receiver_fleet();
+        } else if (line == "mixer") {
+            compare_audio_mixers();
+        } else if (line.rfind("depth", 0) == 0) {
+            run_comparison(line, "depth", data_folder, compare_depth_codecs);
+        } else if (line.rfind("color", 0) == 0) {
+            run_comparison(line, "color", data_folder, compare_color_codecs);
+        } else if (line.rfind("vp8", 0) == 0) {
+            run_comparison(line, "vp8", data_folder, compare_vp8_profiles);
+        } else if (line.rfind("cloud", 0) == 0) {
+            run_comparison(line, "cloud", data_folder, compare_point_cloud_generators);
+        } else if (line.rfind("floor", 0) == 0) {
+            run_comparison(line, "floor", data_folder, compare_floor_detectors);
+        } else if (line.rfind("table", 0) == 0) {
+            run_comparison(line, "table", data_folder, compare_depth_ray_tables);
+        } else if (line.rfind("refresh", 0) == 0) {
+            run_comparison(line, "refresh", data_folder, compare_intra_refresh);
+        } else if (line.rfind("roi", 0) == 0) {
+            run_comparison(line, "roi", data_folder, compare_regions_of_interest);
         } else if (!data_folder || line == "") {
             read_device_frames();
         } else {
@@ -1,11 +1,13 @@
 #include <iostream>
 #include <random>
+#include <sstream>
 #include <thread>
 #include "native/tt_native.h"
 #include "receiver/video_renderer.h"
 #include "receiver/sender_packet_classifier.h"
 #include "receiver/audio_receiver.h"
 #include "receiver/video_receiver_storage.h"
+#include "receiver/video_presentation_scheduler.h"
 
 namespace kh
 {
@@ -42,17 +44,53 @@ void request_packets(int receiver_id, tt::UdpSocket& udp_socket,
     }
 }
 
-std::optional<std::pair<int, std::shared_ptr<tt::VideoSenderMessage>>> find_frame_to_render(std::map<int, std::shared_ptr<tt::VideoSenderMessage>>& video_messages,
-                                                                                            std::optional<int> last_frame_id)
+std::unique_ptr<tt::UdpSocket> create_multicast_udp_socket(asio::io_context& io_context,
+                                                           asio::ip::udp::endpoint multicast_endpoint,
+                                                           int receive_buffer_size)
+{
+    asio::ip::udp::socket socket(io_context, asio::ip::udp::v4());
+    // Allows multiple receivers in the same machine to join the group.
+    socket.set_option(asio::ip::udp::socket::reuse_address{true});
+    socket.set_option(asio::socket_base::receive_buffer_size{receive_buffer_size});
+    socket.bind(asio::ip::udp::endpoint{asio::ip::address_v4::any(), multicast_endpoint.port()});
+    socket.set_option(asio::ip::multicast::join_group{multicast_endpoint.address()});
+    return std::make_unique<tt::UdpSocket>(std::move(socket));
+}
+
+// A sender only listened to, whose audio gets mixed with the audio of the sender of the video.
+// Each gets its own socket, which keeps its SessionInfo apart from the one of the sender of the video.
+struct AudioOnlySender
+{
+    asio::ip::udp::endpoint endpoint;
+    std::unique_ptr<tt::UdpSocket> udp_socket;
+};
+
+// A sender newer than this receiver can have codecs unknown to it.
+bool is_session_info_supported(const SessionInfo& session_info)
+{
+    const bool color_codec_supported{session_info.color_codec == ColorCodec::Vp8 || session_info.color_codec == ColorCodec::Vp9 ||
+                                     is_tiled_color_codec(session_info.color_codec)};
+    const bool depth_codec_supported{session_info.depth_codec == DepthCodec::Trvl ||
+                                     session_info.depth_codec == DepthCodec::TiledTrvl ||
+                                     session_info.depth_codec == DepthCodec::TiledTrvlZstd};
+    const bool depth_quantization_supported{session_info.depth_quantization == DepthQuantization::None ||
+                                            session_info.depth_quantization == DepthQuantization::InverseDepth};
+    return color_codec_supported && depth_codec_supported && depth_quantization_supported;
+}
+
+// keyframe_needed is for decoders that failed and only recover with a keyframe.
+std::optional<std::pair<int, std::shared_ptr<VideoMessage>>> find_frame_to_render(std::map<int, std::shared_ptr<VideoMessage>>& video_messages,
+                                                                                  std::optional<int> last_frame_id,
+                                                                                  bool keyframe_needed)
 {
     if (video_messages.empty())
         return std::nullopt;
 
     std::optional<int> frame_id_to_render;
-    if (!last_frame_id) {
+    if (!last_frame_id || keyframe_needed) {
         // For the first frame, find a keyframe.
         for (auto& [frame_id, video_message] : video_messages) {
-            if (video_message->keyframe) {
+            if (video_message->sender_message.keyframe) {
                 frame_id_to_render = frame_id;
                 break;
             }
@@ -63,7 +101,7 @@ std::optional<std::pair<int, std::shared_ptr<tt::VideoSenderMessage>>> find_fram
             if (frame_id <= *last_frame_id)
                 continue;
 
-            if (video_message->keyframe)
+            if (video_message->sender_message.keyframe)
                 frame_id_to_render = frame_id;
         }
 
@@ -74,16 +112,27 @@ std::optional<std::pair<int, std::shared_ptr<tt::VideoSenderMessage>>> find_fram
                 frame_id_to_render = *last_frame_id + 1;
             }
         }
+
+        // With intra refresh of both codecs, skip missing frames when falling behind
+        // since the refresh repairs the picture within a stripe count of frames.
+        // Frames of other codecs need a keyframe, which the sender sends to receivers falling behind.
+        if (!frame_id_to_render) {
+            auto& [newest_frame_id, newest_video_message] {*video_messages.rbegin()};
+            const bool intra_refreshed{is_intra_refreshed(newest_video_message->color_codec, newest_video_message->depth_codec, newest_video_message->intra_refresh)};
+            if (intra_refreshed && newest_frame_id - *last_frame_id > KH_CATCH_UP_FRAME_ID_DIFF)
+                frame_id_to_render = newest_frame_id;
+        }
     }
 
     if (!frame_id_to_render)
         return std::nullopt;
 
-    return std::pair<int, std::shared_ptr<tt::VideoSenderMessage>>(*frame_id_to_render, video_messages[*frame_id_to_render]);
+    return std::pair<int, std::shared_ptr<VideoMessage>>(*frame_id_to_render, video_messages[*frame_id_to_render]);
 }
 }
 
-void start_receiver(const std::string ip_address, const unsigned short port, const int receiver_id)
+void start_receiver(const std::string ip_address, const unsigned short port, const int receiver_id, const bool multicast_requested,
+                    const std::vector<std::string>& audio_only_ip_addresses)
 {
     constexpr int RECEIVER_RECEIVE_BUFFER_SIZE{128 * 1024};
     constexpr float HEARTBEAT_INTERVAL_SEC{1.0f};
@@ -98,6 +147,22 @@ void start_receiver(const std::string ip_address, const unsigned short port, con
     
     asio::ip::udp::endpoint sender_endpoint{asio::ip::address::from_string(ip_address), gsl::narrow<unsigned short>(port)};
     udp_socket.send(tt::create_connect_receiver_packet(receiver_id, true, true).bytes, sender_endpoint);
+    if (multicast_requested)
+        udp_socket.send(create_multicast_join_receiver_packet_bytes(receiver_id), sender_endpoint);
+
+    std::vector<AudioOnlySender> audio_only_senders;
+    for (auto& audio_only_ip_address : audio_only_ip_addresses) {
+        asio::ip::udp::socket audio_only_socket(io_context, asio::ip::udp::v4());
+        audio_only_socket.set_option(asio::socket_base::receive_buffer_size{RECEIVER_RECEIVE_BUFFER_SIZE});
+        AudioOnlySender audio_only_sender{asio::ip::udp::endpoint{asio::ip::address::from_string(audio_only_ip_address), gsl::narrow<unsigned short>(port)},
+                                          std::make_unique<tt::UdpSocket>(std::move(audio_only_socket))};
+        audio_only_sender.udp_socket->send(tt::create_connect_receiver_packet(receiver_id, false, true).bytes, audio_only_sender.endpoint);
+        audio_only_senders.push_back(std::move(audio_only_sender));
+    }
+
+    // Video and parity packets come through this socket after joining the multicast group of the sender.
+    std::unique_ptr<tt::UdpSocket> multicast_udp_socket{nullptr};
+    std::optional<int> multicast_sender_id{std::nullopt};
 
     tt::TimePoint last_heartbeat_time{tt::TimePoint::now()};
     tt::TimePoint last_received_any_time{tt::TimePoint::now()};
@@ -105,37 +170,79 @@ void start_receiver(const std::string ip_address, const unsigned short port, con
 
     AudioReceiver audio_receiver;
     std::unique_ptr<VideoRenderer> video_renderer{nullptr};
+    VideoPresentationScheduler video_presentation_scheduler;
     std::optional<int> last_frame_id{std::nullopt};
+    // Set when decoding a frame failed, until a keyframe arrives.
+    bool keyframe_needed{false};
+    // Video frames get synchronized to the audio of their sender, not the one of the audio-only senders.
+    std::optional<int> video_sender_id{std::nullopt};
 
+    // For compact video messages, which leave out properties in SessionInfo.
+    std::optional<SessionInfo> session_info{std::nullopt};
     VideoReceiverStorage video_receiver_storage;
-    std::map<int, std::shared_ptr<tt::VideoSenderMessage>> video_messages;
+    std::map<int, std::shared_ptr<VideoMessage>> video_messages;
 
     for (;;) {
         if (last_heartbeat_time.elapsed_time().sec() > HEARTBEAT_INTERVAL_SEC) {
             udp_socket.send(tt::create_heartbeat_receiver_packet(receiver_id).bytes, sender_endpoint);
+            // Resend until joining since the sender ignores packets before the connect packet.
+            if (multicast_requested && !multicast_udp_socket)
+                udp_socket.send(create_multicast_join_receiver_packet_bytes(receiver_id), sender_endpoint);
+            for (auto& audio_only_sender : audio_only_senders)
+                audio_only_sender.udp_socket->send(tt::create_heartbeat_receiver_packet(receiver_id).bytes, audio_only_sender.endpoint);
             last_heartbeat_time = tt::TimePoint::now();
         }
 
         SenderPacketInfo sender_packet_info;
         try {
             SenderPacketClassifier::classify(udp_socket, sender_packet_info);
+            if (multicast_udp_socket)
+                SenderPacketClassifier::classify(*multicast_udp_socket, sender_packet_info, multicast_sender_id);
+
+            // Acknowledging gets AudioBundle packets, which have time stamps, and no codec matters without video.
+            for (auto& audio_only_sender : audio_only_senders) {
+                SenderPacketInfo audio_only_sender_packet_info;
+                SenderPacketClassifier::classify(*audio_only_sender.udp_socket, audio_only_sender_packet_info);
+                if (audio_only_sender_packet_info.session_info) {
+                    audio_only_sender.udp_socket->send(create_session_info_ack_receiver_packet_bytes(receiver_id, audio_only_sender_packet_info.session_info->version),
+                                                       audio_only_sender.endpoint);
+                }
+                audio_receiver.receive(audio_only_sender_packet_info.audio_packets, audio_only_sender_packet_info.audio_frame_time_stamps);
+            }
         } catch (tt::UdpSocketRuntimeError e) {
             std::cout << "UdpSocketRuntimeError from SenderPacketClassifier::classify\n  " << e.what() << "\n";
             break;
         }
 
+        if (sender_packet_info.multicast_group_packet && !multicast_udp_socket) {
+            auto multicast_endpoint{sender_packet_info.multicast_group_packet->multicast_endpoint};
+            multicast_udp_socket = create_multicast_udp_socket(io_context, multicast_endpoint, RECEIVER_RECEIVE_BUFFER_SIZE);
+            multicast_sender_id = sender_packet_info.multicast_group_packet->sender_id;
+            std::cout << "Joined multicast group " << multicast_endpoint.address().to_string() << ":" << multicast_endpoint.port() << ".\n";
+        }
+
+        // Acknowledge every SessionInfo packet since the sender keeps sending it until an acknowledgement arrives.
+        // Leaving a SessionInfo with unsupported codecs unacknowledged keeps the sender sending messages from telepresence-toolkit.
+        if (sender_packet_info.session_info && is_session_info_supported(*sender_packet_info.session_info)) {
+            session_info = sender_packet_info.session_info;
+            udp_socket.send(create_session_info_ack_receiver_packet_bytes(receiver_id, session_info->version), sender_endpoint);
+        }
+
+        if (!sender_packet_info.video_packets.empty())
+            video_sender_id = sender_packet_info.video_packets.front().sender_id;
+
         for (auto& video_packet : sender_packet_info.video_packets)
             video_receiver_storage.addVideoPacket(std::make_unique<tt::VideoSenderPacket>(video_packet));
 
         for (auto& parity_packet : sender_packet_info.parity_packets)
             video_receiver_storage.addParityPacket(std::make_unique<tt::ParitySenderPacket>(parity_packet));
 
-        video_receiver_storage.build(video_messages);
+        video_receiver_storage.build(video_messages, session_info);
 
         if (!video_renderer && video_messages.size() > 0)
-            video_renderer.reset(new VideoRenderer{video_messages[0]->width, video_messages[0]->height});
+            video_renderer.reset(new VideoRenderer{video_messages[0]->sender_message.width, video_messages[0]->sender_message.height});
 
-        audio_receiver.receive(sender_packet_info.audio_packets);
+        audio_receiver.receive(sender_packet_info.audio_packets, sender_packet_info.audio_frame_time_stamps);
 
         if (sender_packet_info.received_any)
             last_received_any_time = tt::TimePoint::now();
@@ -175,11 +282,27 @@ void start_receiver(const std::string ip_address, const unsigned short port, con
             last_request_time = tt::TimePoint::now();
         }
 
-        auto frame_with_index{find_frame_to_render(video_messages, last_frame_id)};
-        if (frame_with_index) {
-            video_renderer->render(frame_with_index->second->color_encoder_frame,
-                                   frame_with_index->second->depth_encoder_frame,
-                                   frame_with_index->second->keyframe);
+        // Frames ahead of the audio wait for it.
+        auto frame_with_index{find_frame_to_render(video_messages, last_frame_id, keyframe_needed)};
+        const auto audio_playout_time_stamp{video_sender_id ? audio_receiver.playout_time_stamp(*video_sender_id) : std::nullopt};
+        if (frame_with_index && video_presentation_scheduler.is_due(frame_with_index->second->sender_message.frame_time_stamp, audio_playout_time_stamp)) {
+            auto& sender_message{frame_with_index->second->sender_message};
+            video_presentation_scheduler.add_rendered_frame(sender_message.frame_time_stamp, audio_playout_time_stamp);
+            // A decoder fed a corrupted frame or a frame missing its references can fail, leaving its state behind the sender.
+            // The frame counts as rendered, and the sender gets asked for a keyframe.
+            try {
+                video_renderer->render(sender_message.color_encoder_frame,
+                                       sender_message.depth_encoder_frame,
+                                       frame_with_index->second->color_codec,
+                                       frame_with_index->second->depth_codec,
+                                       frame_with_index->second->depth_quantization,
+                                       sender_message.keyframe);
+                keyframe_needed = false;
+            } catch (std::runtime_error& e) {
+                std::cout << "Failed to render frame " << frame_with_index->first << ": " << e.what() << "\n";
+                udp_socket.send(create_keyframe_request_receiver_packet_bytes(receiver_id), sender_endpoint);
+                keyframe_needed = true;
+            }
             last_frame_id = frame_with_index->first;
 
             udp_socket.send(tt::create_report_receiver_packet(receiver_id, *last_frame_id).bytes, sender_endpoint);
@@ -196,6 +319,24 @@ void start_receiver(const std::string ip_address, const unsigned short port, con
             video_receiver_storage.removeObsolete(*last_frame_id);
         }
     }
+
+    for (auto& [audio_sender_id, audio_stats] : audio_receiver.jitter_buffer_stats()) {
+        std::cout << "Audio frames of sender " << audio_sender_id
+                  << " from packets: " << audio_stats.packet_frame_count
+                  << ", FEC: " << audio_stats.fec_frame_count
+                  << ", concealed: " << audio_stats.concealed_frame_count
+                  << ", late packets: " << audio_stats.late_packet_count
+                  << ", drift dropped: " << audio_stats.drift_dropped_frame_count << "\n";
+    }
+
+    const auto& presentation_stats{video_presentation_scheduler.stats()};
+    std::cout << "Video frames rendered: " << presentation_stats.rendered_frame_count
+              << ", synchronized to audio: " << presentation_stats.synchronized_frame_count
+              << ", held for audio: " << presentation_stats.held_count << "\n";
+    if (presentation_stats.synchronized_frame_count > 0) {
+        std::cout << "A/V offset average: " << presentation_stats.offset_ms_sum / presentation_stats.synchronized_frame_count << " ms"
+                  << ", max: " << presentation_stats.max_abs_offset_ms << " ms (positive for video ahead of audio)\n";
+    }
 }
 
 void main()
@@ -211,8 +352,23 @@ void main()
         if (ip_address.empty())
             ip_address = "127.0.0.1";
 
+        // Multicast is for multiple receivers in the same LAN with the sender.
+        std::cout << "Enter y to receive video through multicast: ";
+        std::string multicast_line;
+        std::getline(std::cin, multicast_line);
+        const bool multicast_requested{multicast_line == "y"};
+
+        // The audio of these senders gets mixed with the audio of the sender above, such as from the other Kinects of a room.
+        std::cout << "Enter IP addresses of senders to also hear, separated by spaces: ";
+        std::string audio_only_line;
+        std::getline(std::cin, audio_only_line);
+        std::istringstream audio_only_stream{audio_only_line};
+        std::vector<std::string> audio_only_ip_addresses;
+        for (std::string audio_only_ip_address; audio_only_stream >> audio_only_ip_address;)
+            audio_only_ip_addresses.push_back(audio_only_ip_address);
+
         const int receiver_id{gsl::narrow<const int>(std::random_device{}() % (static_cast<unsigned int>(INT_MAX) + 1))};
-        start_receiver(ip_address, PORT, receiver_id);
+        start_receiver(ip_address, PORT, receiver_id, multicast_requested, audio_only_ip_addresses);
     }
 }
 }
@@ -0,0 +1,420 @@
+#include <iostream>
+#include <random>
+#include <set>
+#include "native/tt_native.h"
+#include "native/profiler.h"
+#include "relay/upstream_connection.h"
+#include "relay/upstream_packet_classifier.h"
+#include "sender/receiver_packet_classifier.h"
+#include "sender/video_sender_storage.h"
+
+namespace kh
+{
+namespace
+{
+// Forwards packets of the newest frames from the upstream sender to the downstream receivers.
+// Packets already stored are duplicates, and packets of frames the relay requested again are repairs for some receivers,
+// so they only get stored and the RetransmissionSchedulers of the receivers that requested them send them.
+void forward_video_packets(std::vector<UpstreamVideoPacket>& upstream_video_packets,
+                           bool parity,
+                           std::optional<int>& upstream_frame_id,
+                           const UpstreamConnection& upstream_connection,
+                           tt::UdpSocket& udp_socket,
+                           VideoSenderStorage& video_sender_storage,
+                           RemoteReceiverRegistry& remote_receivers,
+                           tt::Profiler& profiler)
+{
+    for (auto& upstream_video_packet : upstream_video_packets) {
+        const int frame_id{upstream_video_packet.frame_id};
+        const int packet_index{upstream_video_packet.packet_index};
+        const bool newest{!upstream_frame_id || frame_id >= *upstream_frame_id};
+        if (!upstream_frame_id || frame_id > *upstream_frame_id)
+            upstream_frame_id = frame_id;
+
+        const bool stored{parity ? video_sender_storage.add_parity_packet(frame_id, packet_index,
+                                                                          upstream_video_packet.video_packet_count,
+                                                                          std::move(upstream_video_packet.packet))
+                                 : video_sender_storage.add_video_packet(frame_id, packet_index,
+                                                                         upstream_video_packet.video_packet_count,
+                                                                         std::move(upstream_video_packet.packet))};
+        if (!stored || !newest || upstream_connection.requested(frame_id))
+            continue;
+
+        auto& video_frame_packets{video_sender_storage.find(frame_id)->second};
+        const auto& packet{parity ? video_frame_packets.parity_packets[packet_index] : video_frame_packets.video_packets[packet_index]};
+        for (auto& remote_receiver : remote_receivers) {
+            if (!remote_receiver.video_requested)
+                continue;
+
+            udp_socket.send(packet.bytes, remote_receiver.endpoint);
+            profiler.addNumber("relay-forward-byte", packet.bytes.size());
+
+            // Start a new receiver from this frame, as the sender does.
+            if (!remote_receiver.video_frame_id)
+                remote_receivers.set_video_frame_id(remote_receiver, frame_id - 1);
+        }
+    }
+}
+
+void forward_audio_packets(std::vector<tt::Packet>& audio_packets,
+                           tt::UdpSocket& udp_socket,
+                           RemoteReceiverRegistry& remote_receivers,
+                           tt::Profiler& profiler)
+{
+    for (auto& audio_packet : audio_packets) {
+        for (auto& remote_receiver : remote_receivers) {
+            if (!remote_receiver.audio_requested)
+                continue;
+
+            udp_socket.send(audio_packet.bytes, remote_receiver.endpoint);
+            profiler.addNumber("relay-forward-byte", audio_packet.bytes.size());
+        }
+    }
+}
+
+// Receivers without the extensions get the frames of bundles as audio packets from telepresence-toolkit.
+void forward_audio_bundle_packets(std::vector<tt::Packet>& audio_bundle_packets,
+                                  tt::UdpSocket& udp_socket,
+                                  RemoteReceiverRegistry& remote_receivers,
+                                  tt::Profiler& profiler)
+{
+    for (auto& audio_bundle_packet : audio_bundle_packets) {
+        // Created once per bundle only while a receiver without the extensions requests audio.
+        std::optional<std::vector<tt::Packet>> audio_packets;
+        for (auto& remote_receiver : remote_receivers) {
+            if (!remote_receiver.audio_requested)
+                continue;
+
+            if (remote_receiver.session_info_version) {
+                udp_socket.send(audio_bundle_packet.bytes, remote_receiver.endpoint);
+                profiler.addNumber("relay-forward-byte", audio_bundle_packet.bytes.size());
+                continue;
+            }
+
+            if (!audio_packets) {
+                audio_packets.emplace();
+                for (auto& audio_packet : read_audio_bundle_sender_packet(audio_bundle_packet.bytes).audio_packets)
+                    audio_packets->push_back(tt::create_audio_sender_packet(audio_packet.sender_id, audio_packet.frame_id, audio_packet.opus_frame));
+            }
+            for (auto& audio_packet : *audio_packets) {
+                udp_socket.send(audio_packet.bytes, remote_receiver.endpoint);
+                profiler.addNumber("relay-forward-byte", audio_packet.bytes.size());
+            }
+        }
+    }
+}
+
+// Compact video messages leave out the SessionInfo, so the relay lets the upstream sender send them
+// only while there are downstream receivers of video and all of them have the SessionInfo.
+// Receivers with held video do not count, as in the sender.
+bool is_session_info_supported_downstream(RemoteReceiverRegistry& remote_receivers, const SessionInfo& session_info)
+{
+    if (remote_receivers.video_requested_count() == 0)
+        return false;
+
+    for (auto& remote_receiver : remote_receivers) {
+        if (remote_receiver.video_requested && remote_receiver.session_info_version != session_info.version)
+            return false;
+    }
+    return true;
+}
+
+// Reads the message of a frame once all its video packets are in the storage, for the keyframe flag and the codecs.
+// A compact message without its SessionInfo and a malformed one read as std::nullopt.
+std::optional<VideoMessage> read_stored_video_message(VideoSenderStorage& video_sender_storage, int frame_id, const std::optional<SessionInfo>& session_info)
+{
+    auto video_frame_packets_it{video_sender_storage.find(frame_id)};
+    if (video_frame_packets_it == video_sender_storage.end())
+        return std::nullopt;
+
+    for (auto& video_packet : video_frame_packets_it->second.video_packets) {
+        if (video_packet.bytes.empty())
+            return std::nullopt;
+    }
+
+    try {
+        std::vector<tt::VideoSenderPacket> video_packets;
+        for (auto& video_packet : video_frame_packets_it->second.video_packets)
+            video_packets.push_back(tt::read_video_sender_packet(video_packet.bytes));
+
+        std::vector<tt::VideoSenderPacket*> video_packet_ptrs;
+        for (auto& video_packet : video_packets)
+            video_packet_ptrs.push_back(&video_packet);
+        return read_video_message(tt::merge_video_sender_packets(video_packet_ptrs), session_info);
+    } catch (const std::runtime_error& e) {
+        std::cout << "Failed to read video message " << frame_id << ": " << e.what() << "\n";
+        return std::nullopt;
+    }
+}
+
+void apply_report_packets(std::vector<tt::ReportReceiverPacket>& report_packets,
+                          RemoteReceiver& remote_receiver,
+                          RemoteReceiverRegistry& remote_receivers)
+{
+    for (auto& report_packet : report_packets) {
+        // Ignore if network is somehow out of order and a report comes in out of order.
+        if (remote_receiver.video_frame_id && report_packet.frame_id <= *remote_receiver.video_frame_id)
+            continue;
+
+        remote_receivers.set_video_frame_id(remote_receiver, report_packet.frame_id);
+    }
+}
+
+void print_relay_summary(RemoteReceiverRegistry& remote_receivers, tt::Profiler& profiler)
+{
+    auto elapsed_time{profiler.getElapsedTime()};
+    std::cout << "Relay Summary:\n";
+    std::cout << "  Receiver Count: " << remote_receivers.size() << "\n";
+    std::cout << "  Forward Bandwidth: " << profiler.getNumber("relay-forward-byte") / elapsed_time.sec() / (1024.0f * 1024.0f / 8.0f) << " Mbps\n";
+    std::cout << "  Retransmission Bandwidth: " << profiler.getNumber("retransmit-byte") / elapsed_time.sec() / (1024.0f * 1024.0f / 8.0f) << " Mbps\n";
+    std::cout << "  Upstream Request Per Second: " << profiler.getNumber("relay-upstream-request") / elapsed_time.sec() << "\n";
+}
+}
+
+void start_relay(const std::string ip_address, const unsigned short sender_port, const int receiver_id)
+{
+    constexpr int DEFAULT_PORT{3773};
+    constexpr int RELAY_RECEIVE_BUFFER_SIZE{1024 * 1024};
+    constexpr int RELAY_SEND_BUFFER_SIZE{1024 * 1024};
+    constexpr float HEARTBEAT_INTERVAL_SEC{1.0f};
+    constexpr float UPSTREAM_HEARTBEAT_TIME_OUT_SEC{5.0f};
+    constexpr float DOWNSTREAM_HEARTBEAT_TIME_OUT_SEC{10.0f};
+    constexpr float REQUEST_INTERVAL_SEC{0.1f};
+    // Lost keyframe requests and a sender without catch-up keyframes leave new receivers without a frame to start from.
+    constexpr float KEYFRAME_REQUEST_INTERVAL_SEC{0.5f};
+    // Downstream receivers get held as in the sender.
+    constexpr float SESSION_INFO_ACK_WAIT_SEC{2.0f};
+    constexpr float SUMMARY_INTERVAL_SEC{10.0f};
+
+    std::cout << "Start kinect_relay (receiver_id: " << receiver_id << ").\n";
+
+    asio::io_context io_context;
+
+    // Toward the upstream sender, the relay is a receiver.
+    asio::ip::udp::socket upstream_socket(io_context, asio::ip::udp::v4());
+    upstream_socket.set_option(asio::socket_base::receive_buffer_size{RELAY_RECEIVE_BUFFER_SIZE});
+    tt::UdpSocket upstream_udp_socket{std::move(upstream_socket)};
+
+    // Toward downstream receivers, the relay is a sender.
+    int port{DEFAULT_PORT};
+    std::optional<asio::ip::udp::socket> downstream_socket{};
+    for (int i = 0; i < 10; ++i) {
+        try {
+            downstream_socket = asio::ip::udp::socket(io_context, asio::ip::udp::endpoint(asio::ip::udp::v4(), port));
+            break;
+        } catch (std::system_error e) {
+            // This can happen due to the port being occupied (e.g., by a sender in the same machine). Increment the port and try again.
+            ++port;
+        }
+    }
+    downstream_socket->set_option(asio::socket_base::send_buffer_size{RELAY_SEND_BUFFER_SIZE});
+    tt::UdpSocket downstream_udp_socket{std::move(*downstream_socket)};
+    std::cout << "Receivers can connect to port " << port << ".\n";
+
+    asio::ip::udp::endpoint sender_endpoint{asio::ip::address::from_string(ip_address), sender_port};
+    UpstreamConnection upstream_connection{receiver_id, sender_endpoint};
+    upstream_connection.connect(upstream_udp_socket);
+
+    tt::TimePoint last_received_any_time{tt::TimePoint::now()};
+    // The latest frame ID from the upstream sender.
+    std::optional<int> upstream_frame_id{std::nullopt};
+    // The SessionInfo from the upstream sender, which the relay passes to downstream receivers.
+    std::optional<SessionInfo> session_info{std::nullopt};
+
+    VideoSenderStorage video_packet_storage;
+
+    RemoteReceiverRegistry remote_receivers{HEARTBEAT_INTERVAL_SEC, DOWNSTREAM_HEARTBEAT_TIME_OUT_SEC};
+    std::vector<int> heartbeat_receiver_ids;
+    std::vector<int> timed_out_receiver_ids;
+
+    tt::Profiler profiler;
+
+    for (;;) {
+        upstream_connection.send_heartbeat(upstream_udp_socket, HEARTBEAT_INTERVAL_SEC);
+
+        UpstreamPacketInfo upstream_packet_info;
+        try {
+            UpstreamPacketClassifier::classify(upstream_udp_socket, upstream_packet_info);
+        } catch (tt::UdpSocketRuntimeError e) {
+            std::cout << "UdpSocketRuntimeError from UpstreamPacketClassifier::classify\n  " << e.what() << "\n";
+            break;
+        }
+
+        if (upstream_packet_info.received_any)
+            last_received_any_time = tt::TimePoint::now();
+
+        if (last_received_any_time.elapsed_time().sec() > UPSTREAM_HEARTBEAT_TIME_OUT_SEC) {
+            std::cout << "Timed out after waiting for " << UPSTREAM_HEARTBEAT_TIME_OUT_SEC << " seconds.\n";
+            break;
+        }
+
+        if (upstream_packet_info.confirm_packet && !upstream_connection.sender_id()) {
+            upstream_connection.confirm(*upstream_packet_info.confirm_packet);
+            if (upstream_connection.sender_id())
+                std::cout << "Connected to sender " << *upstream_connection.sender_id() << ".\n";
+        }
+
+        // Receivers get confirmed with the ID of the upstream sender
+        // since packets get forwarded with the ID, so wait for it.
+        if (!upstream_connection.sender_id())
+            continue;
+
+        const int sender_id{*upstream_connection.sender_id()};
+
+        if (upstream_packet_info.session_info)
+            session_info = upstream_packet_info.session_info;
+
+        try {
+            auto receiver_packet_collection{ReceiverPacketClassifier::classify(downstream_udp_socket, remote_receivers)};
+
+            for (auto& connect_packet_info : receiver_packet_collection.connect_packet_infos) {
+                downstream_udp_socket.send(tt::create_confirm_sender_packet(sender_id, connect_packet_info.connect_packet.receiver_id).bytes, connect_packet_info.receiver_endpoint);
+
+                // Skip already existing receivers.
+                if (remote_receivers.find(connect_packet_info.connect_packet.receiver_id))
+                    continue;
+
+                std::cout << "Receiver " << connect_packet_info.connect_packet.receiver_id << " connected.\n";
+                // Video gets held until the receiver acknowledges the SessionInfo or stops being waited for,
+                // so a joining receiver does not withdraw the acknowledgement of the relay only to give it again.
+                RemoteReceiver remote_receiver{connect_packet_info.receiver_endpoint,
+                                               connect_packet_info.connect_packet.receiver_id,
+                                               false,
+                                               connect_packet_info.connect_packet.audio_requested};
+                remote_receiver.video_held = connect_packet_info.connect_packet.video_requested;
+                remote_receivers.add(std::move(remote_receiver));
+                if (session_info)
+                    downstream_udp_socket.send(create_session_info_sender_packet_bytes(sender_id, *session_info), connect_packet_info.receiver_endpoint);
+            }
+
+            heartbeat_receiver_ids.clear();
+            timed_out_receiver_ids.clear();
+            remote_receivers.update_timers(heartbeat_receiver_ids, timed_out_receiver_ids);
+            for (int receiver_id : heartbeat_receiver_ids) {
+                auto remote_receiver_ptr{remote_receivers.find(receiver_id)};
+                downstream_udp_socket.send(tt::create_heartbeat_sender_packet(sender_id).bytes, remote_receiver_ptr->endpoint);
+                // Resend SessionInfo until it gets acknowledged.
+                if (session_info && remote_receiver_ptr->session_info_version != session_info->version)
+                    downstream_udp_socket.send(create_session_info_sender_packet_bytes(sender_id, *session_info), remote_receiver_ptr->endpoint);
+                // A released receiver needs a keyframe to start with.
+                if (remote_receiver_ptr->video_held && remote_receiver_ptr->connect_time.elapsed_time().sec() > SESSION_INFO_ACK_WAIT_SEC) {
+                    std::cout << "Receiver " << receiver_id << " did not acknowledge the SessionInfo and gets video without the extension.\n";
+                    remote_receivers.release_video(*remote_receiver_ptr);
+                    upstream_connection.request_keyframe(upstream_udp_socket, upstream_frame_id);
+                }
+            }
+
+            for (int receiver_id : timed_out_receiver_ids) {
+                std::cout << "Timed out receiver " << receiver_id << " after waiting for " << DOWNSTREAM_HEARTBEAT_TIME_OUT_SEC << " seconds without a received packet.\n";
+                remote_receivers.remove(receiver_id);
+            }
+
+            forward_video_packets(upstream_packet_info.video_packets, false, upstream_frame_id, upstream_connection,
+                                  downstream_udp_socket, video_packet_storage, remote_receivers, profiler);
+            forward_video_packets(upstream_packet_info.parity_packets, true, upstream_frame_id, upstream_connection,
+                                  downstream_udp_socket, video_packet_storage, remote_receivers, profiler);
+            forward_audio_packets(upstream_packet_info.audio_packets, downstream_udp_socket, remote_receivers, profiler);
+            forward_audio_bundle_packets(upstream_packet_info.audio_bundle_packets, downstream_udp_socket, remote_receivers, profiler);
+
+            // Watch frames that got all their video packets for one a new receiver can start from.
+            if (upstream_connection.keyframe_requested()) {
+                std::set<int> frame_ids;
+                for (auto& video_packet : upstream_packet_info.video_packets)
+                    frame_ids.insert(video_packet.frame_id);
+                for (int frame_id : frame_ids) {
+                    if (auto video_message{read_stored_video_message(video_packet_storage, frame_id, session_info)})
+                        upstream_connection.receive_video_message(frame_id, *video_message);
+                }
+            }
+
+            for (auto& receiver_packet_info : receiver_packet_collection.receiver_packet_infos) {
+                // The receiver can be removed above for timing out.
+                auto remote_receiver_ptr{remote_receivers.find(receiver_packet_info.receiver_id)};
+                if (!remote_receiver_ptr)
+                    continue;
+
+                if (receiver_packet_info.session_info_ack_version) {
+                    remote_receiver_ptr->session_info_version = receiver_packet_info.session_info_ack_version;
+                    if (session_info && remote_receiver_ptr->video_held && remote_receiver_ptr->session_info_version == session_info->version) {
+                        remote_receivers.release_video(*remote_receiver_ptr);
+                        upstream_connection.request_keyframe(upstream_udp_socket, upstream_frame_id);
+                    }
+                }
+
+                apply_report_packets(receiver_packet_info.report_packets, *remote_receiver_ptr, remote_receivers);
+                remote_receiver_ptr->retransmission_scheduler.add(receiver_packet_info.request_packets,
+                                                                  remote_receiver_ptr->video_frame_id,
+                                                                  profiler);
+                // Packets missing in the relay get requested to the upstream sender.
+                upstream_connection.add_requests(receiver_packet_info.request_packets, video_packet_storage);
+                remote_receiver_ptr->last_packet_time = tt::TimePoint::now();
+            }
+
+            for (auto& remote_receiver : remote_receivers) {
+                remote_receiver.retransmission_scheduler.retransmit(downstream_udp_socket,
+                                                                    video_packet_storage,
+                                                                    remote_receiver.video_frame_id,
+                                                                    remote_receiver.endpoint,
+                                                                    profiler);
+            }
+        } catch (tt::UdpSocketRuntimeError e) {
+            std::cout << "UdpSocketRuntimeError\n  message: " << e.what() << "\n  endpoint: " << e.endpoint() << "\n";
+            std::vector<int> failed_receiver_ids;
+            for (auto& remote_receiver : remote_receivers) {
+                if (remote_receiver.endpoint == e.endpoint())
+                    failed_receiver_ids.push_back(remote_receiver.receiver_id);
+            }
+
+            for (int receiver_id : failed_receiver_ids)
+                remote_receivers.remove(receiver_id);
+        }
+
+        // The upstream sender resends SessionInfo until acknowledged, so one left unacknowledged here comes again.
+        const bool session_info_supported_downstream{session_info && is_session_info_supported_downstream(remote_receivers, *session_info)};
+        upstream_connection.update_session_info_acknowledgement(upstream_udp_socket, upstream_packet_info.session_info,
+                                                                session_info_supported_downstream, HEARTBEAT_INTERVAL_SEC);
+        upstream_connection.resend_keyframe_request(upstream_udp_socket, KEYFRAME_REQUEST_INTERVAL_SEC);
+
+        // Report the slowest receiver to let the upstream sender pace itself for it.
+        // Without a receiver at a frame, report the latest frame to keep the upstream sender sending.
+        auto relay_frame_id{remote_receivers.min_video_frame_id()};
+        if (!relay_frame_id)
+            relay_frame_id = upstream_frame_id;
+
+        if (relay_frame_id) {
+            upstream_connection.report(upstream_udp_socket, *relay_frame_id);
+            video_packet_storage.cleanup(*relay_frame_id);
+        }
+
+        upstream_connection.send_requests(upstream_udp_socket, REQUEST_INTERVAL_SEC, profiler);
+
+        if (profiler.getElapsedTime().sec() > SUMMARY_INTERVAL_SEC) {
+            print_relay_summary(remote_receivers, profiler);
+            profiler.reset();
+        }
+    }
+}
+
+void main()
+{
+    constexpr unsigned short PORT{3773};
+
+    for (;;) {
+        std::cout << "Enter the IP address of a sender to relay: ";
+        std::string ip_address;
+        std::getline(std::cin, ip_address);
+        // The default IP address is 127.0.0.1.
+        if (ip_address.empty())
+            ip_address = "127.0.0.1";
+
+        const int receiver_id{gsl::narrow<const int>(std::random_device{}() % (static_cast<unsigned int>(INT_MAX) + 1))};
+        start_relay(ip_address, PORT, receiver_id);
+    }
+}
+}
+
+int main()
+{
+    kh::main();
+    return 0;
+}
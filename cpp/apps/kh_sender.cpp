@@ -6,7 +6,11 @@
 #include "sender/video_pipeline.h"
 #include "sender/video_sender_storage.h"
 #include "sender/receiver_packet_classifier.h"
+#include "sender/scene_change_detector.h"
+#include "sender/video_packet_fan_out.h"
 #include "win32/imgui_wrapper.h"
+#include "utils/compact_video_message.h"
+#include "utils/extension_packets.h"
 #include "utils/filesystem_utils.h"
 #include "native/profiler.h"
 
@@ -43,31 +47,19 @@ void imgui_loop(const Func& f)
     cleanup_imgui(window);
 };
 
-std::pair<bool, bool> plan_video_bitrate_control(std::map<int, RemoteReceiver>& remote_receivers, int last_frame_id, tt::TimePoint last_frame_time)
+// With intra refresh of both codecs, receivers falling behind skip frames and recover through the refresh instead of a keyframe.
+// Otherwise, they still catch up with keyframes.
+std::pair<bool, bool> plan_video_bitrate_control(RemoteReceiverRegistry& remote_receivers, int last_frame_id, tt::TimePoint last_frame_time, bool intra_refreshed)
 {
-    bool video_required_by_any = false;
-    for (auto& [_, remote_receiver] : remote_receivers) {
-        if (remote_receiver.video_requested) {
-            video_required_by_any = true;
-            break;
-        }
-    }
-    if (!video_required_by_any)
+    if (remote_receivers.video_requested_count() == 0)
         return {false, false};
 
-    int min_receiver_frame_id{INT_MAX};
-    for (auto& [_, remote_receiver] : remote_receivers) {
-        // Receivers that did not request video are irrelevant.
-        if (!remote_receiver.video_requested)
-            continue;
+    // Send out a keyframe if there is a new receiver.
+    if (remote_receivers.has_new_video_receiver())
+        return {true, true};
 
-        // Send out a keyframe if there is a new receiver.
-        if (!remote_receiver.video_frame_id)
-            return {true, true};
-
-        if (*remote_receiver.video_frame_id < min_receiver_frame_id)
-            min_receiver_frame_id = *remote_receiver.video_frame_id;
-    }
+    // All receivers requested video have a video_frame_id here.
+    const int min_receiver_frame_id{*remote_receivers.min_video_frame_id()};
 
     constexpr float AZURE_KINECT_FRAME_RATE{30.0f};
     const auto frame_time_point{tt::TimePoint::now()};
@@ -79,25 +71,28 @@ std::pair<bool, bool> plan_video_bitrate_control(std::map<int, RemoteReceiver>&
     const bool is_ready{(frame_time_diff.sec() * AZURE_KINECT_FRAME_RATE) > std::pow(2, frame_id_diff - 1)};
 
     // Send a keyframe when there is a new receiver or at least a receiver needs to catch up by jumping forward using a keyframe.
-    const bool keyframe{frame_id_diff > 5};
+    const bool keyframe{!intra_refreshed && frame_id_diff > KH_CATCH_UP_FRAME_ID_DIFF};
 
     return {is_ready, keyframe};
 }
 
-void send_video_message(VideoPipelineFrame& video_frame,
-                        int sender_id,
-                        tt::TimePoint session_start_time,
-                        k4a::calibration calibration,
-                        tt::UdpSocket& udp_socket,
-                        VideoSenderStorage& video_sender_storage,
-                        std::map<int, RemoteReceiver>& remote_receivers,
-                        std::mt19937& rng)
+// Built once per session since the calibration stays the same.
+// With a crop, the size and intrinsics are of the cropped frames.
+// The version comes from the sender_id, which is random per session,
+// so a receiver still holding the SessionInfo of an earlier session does not read compact messages of this one with it.
+SessionInfo create_session_info(int sender_id,
+                                const k4a::calibration& calibration,
+                                const std::optional<DepthCrop>& crop,
+                                ColorCodec color_codec,
+                                DepthCodec depth_codec,
+                                DepthQuantization depth_quantization,
+                                bool intra_refresh)
 {
-    // Create video/parity packet bytes.
-    const float video_frame_time_stamp{(video_frame.time_point - session_start_time).ms()};
-    int width{calibration.depth_camera_calibration.resolution_width};
-    int height{calibration.depth_camera_calibration.resolution_height};
-    tt::KinectIntrinsics intrinsics;
+    SessionInfo session_info;
+    session_info.version = sender_id;
+    session_info.width = calibration.depth_camera_calibration.resolution_width;
+    session_info.height = calibration.depth_camera_calibration.resolution_height;
+    auto& intrinsics{session_info.intrinsics};
     intrinsics.cx = calibration.depth_camera_calibration.intrinsics.parameters.param.cx;
     intrinsics.cy = calibration.depth_camera_calibration.intrinsics.parameters.param.cy;
     intrinsics.fx = calibration.depth_camera_calibration.intrinsics.parameters.param.fx;
@@ -111,10 +106,52 @@ void send_video_message(VideoPipelineFrame& video_frame,
     intrinsics.codx = calibration.depth_camera_calibration.intrinsics.parameters.param.codx;
     intrinsics.cody = calibration.depth_camera_calibration.intrinsics.parameters.param.cody;
     intrinsics.max_radius_for_projection = calibration.depth_camera_calibration.metric_radius;
+    if (crop) {
+        session_info.width = crop->width;
+        session_info.height = crop->height;
+        intrinsics = crop_kinect_intrinsics(intrinsics, *crop);
+    }
+    session_info.color_codec = color_codec;
+    session_info.depth_codec = depth_codec;
+    session_info.depth_quantization = depth_quantization;
+    session_info.intra_refresh = intra_refresh;
+    return session_info;
+}
 
-    const auto message{tt::create_video_sender_message(video_frame_time_stamp, video_frame.keyframe, width, height, intrinsics,
-                                                   video_frame.vp8_frame, video_frame.trvl_frame, video_frame.floor)};
-    auto video_packets{tt::split_video_sender_message_bytes(sender_id, video_frame.frame_id, message.bytes)};
+// Compact messages leave out the SessionInfo, so they are only for when all receivers have it.
+// Receivers with held video do not count since they get no video until they have it or turn out not to support it.
+bool is_compact_video_message_available(RemoteReceiverRegistry& remote_receivers, const SessionInfo& session_info)
+{
+    for (auto& remote_receiver : remote_receivers) {
+        if (remote_receiver.video_requested && remote_receiver.session_info_version != session_info.version)
+            return false;
+    }
+    return true;
+}
+
+void send_video_message(VideoPipelineFrame& video_frame,
+                        int sender_id,
+                        tt::TimePoint session_start_time,
+                        const SessionInfo& session_info,
+                        bool compact,
+                        tt::UdpSocket& udp_socket,
+                        std::optional<asio::ip::udp::endpoint> multicast_endpoint,
+                        VideoSenderStorage& video_sender_storage,
+                        RemoteReceiverRegistry& remote_receivers,
+                        std::mt19937& rng,
+                        tt::Profiler& profiler)
+{
+    // Create video/parity packet bytes.
+    const float video_frame_time_stamp{(video_frame.time_point - session_start_time).ms()};
+
+    const auto message_bytes{compact ? create_compact_video_message_bytes(session_info.version, video_frame_time_stamp, video_frame.keyframe,
+                                                                          video_frame.vp8_frame, video_frame.trvl_frame, video_frame.floor)
+                                     : tt::create_video_sender_message(video_frame_time_stamp, video_frame.keyframe, session_info.width, session_info.height,
+                                                                       session_info.intrinsics, video_frame.vp8_frame, video_frame.trvl_frame, video_frame.floor).bytes};
+    if (compact)
+        profiler.addNumber("send-compact-frame", 1);
+
+    auto video_packets{tt::split_video_sender_message_bytes(sender_id, video_frame.frame_id, message_bytes)};
     auto parity_packets{tt::create_parity_sender_packets(sender_id, video_frame.frame_id, video_packets)};
 
     // Send video/parity packets.
@@ -127,19 +164,7 @@ void send_video_message(VideoPipelineFrame& video_frame,
         packet_ptrs.push_back(&parity_packet);
 
     std::shuffle(packet_ptrs.begin(), packet_ptrs.end(), rng);
-    for (auto& [_, remote_receiver] : remote_receivers) {
-        if (!remote_receiver.video_requested)
-            continue;
-
-        for (auto& packet_bytes_ptr : packet_ptrs) {
-            udp_socket.send(packet_bytes_ptr->bytes, remote_receiver.endpoint);
-        }
-
-        // Make video_frame_id no longer a std::nullopt so it won't get the
-        // intialization privilege again.
-        if (!remote_receiver.video_frame_id)
-            remote_receiver.video_frame_id = video_frame.frame_id - 1;
-    }
+    fan_out_video_packets(packet_ptrs, video_frame.frame_id, udp_socket, multicast_endpoint, remote_receivers, profiler);
 
     // Save video/parity packet bytes for retransmission. 
     video_sender_storage.add(video_frame.frame_id, std::move(video_packets), std::move(parity_packets));
@@ -148,12 +173,13 @@ void send_video_message(VideoPipelineFrame& video_frame,
 // Update receiver_state and summary with Report packets.
 void apply_report_packets(std::vector<tt::ReportReceiverPacket>& report_packets,
                           RemoteReceiver& remote_receiver,
+                          RemoteReceiverRegistry& remote_receivers,
                           tt::Profiler& profiler)
 {
     // Update receiver_state and summary with Report packets.
     for (auto& report_packet : report_packets) {
         if (!remote_receiver.video_frame_id) {
-            remote_receiver.video_frame_id = report_packet.frame_id;
+            remote_receivers.set_video_frame_id(remote_receiver, report_packet.frame_id);
             continue;
         }
 
@@ -161,67 +187,27 @@ void apply_report_packets(std::vector<tt::ReportReceiverPacket>& report_packets,
         if (report_packet.frame_id <= *remote_receiver.video_frame_id)
             continue;
         
-        remote_receiver.video_frame_id = report_packet.frame_id;
+        remote_receivers.set_video_frame_id(remote_receiver, report_packet.frame_id);
         profiler.addNumber("report-count", 1);
     }
 }
 
-void retransmit_requested_packets(tt::UdpSocket& udp_socket,
-                                  std::vector<tt::RequestReceiverPacket>& request_packets,
-                                  VideoSenderStorage& video_sender_storage,
-                                  const asio::ip::udp::endpoint remote_endpoint,
-                                  tt::Profiler& profiler)
+void log_receiver_report_summary(ExampleAppLog& log, tt::Profiler& profiler)
 {
-    if (request_packets.size() > 0)
-        std::cout << "request_packets.size(): " << request_packets.size() << std::endl;
-
-    // Retransmit the requested video packets.
-    for (auto& request_packet : request_packets) {
-        //std::cout << "received a request packet: " << request_packet.frame_id << std::endl;
-        const int frame_id{request_packet.frame_id};
-
-        auto video_frame_packets_it{video_sender_storage.find(frame_id)};
-        if (video_frame_packets_it == video_sender_storage.end()) {
-            //throw std::runtime_error("Could not find frame from VideoSenderStorage.");
-            // A request packet can arrive after a report packet with a later frame_id.
-            continue;
-        }
-
-        profiler.addNumber("retransmit-frame", 1);
-
-        if (request_packet.all_packets) {
-            for (auto& video_packet : video_frame_packets_it->second.video_packets) {
-                udp_socket.send(video_packet.bytes, remote_endpoint);
-                profiler.addNumber("retransmit-byte", video_packet.bytes.size());
-            }
-
-            for (auto& parity_packet : video_frame_packets_it->second.parity_packets) {
-                udp_socket.send(parity_packet.bytes, remote_endpoint);
-                profiler.addNumber("retransmit-byte", parity_packet.bytes.size());
-            }
-
-            profiler.addNumber("retransmit-video", video_frame_packets_it->second.video_packets.size());
-            profiler.addNumber("retransmit-parity", video_frame_packets_it->second.parity_packets.size());
-        } else {
-            for (int packet_index : request_packet.video_packet_indices) {
-                udp_socket.send(video_frame_packets_it->second.video_packets[packet_index].bytes, remote_endpoint);
-                profiler.addNumber("retransmit-byte", video_frame_packets_it->second.video_packets[packet_index].bytes.size());
-            }
-
-            for (int packet_index : request_packet.parity_packet_indices) {
-                udp_socket.send(video_frame_packets_it->second.parity_packets[packet_index].bytes, remote_endpoint);
-                profiler.addNumber("retransmit-byte", video_frame_packets_it->second.parity_packets[packet_index].bytes.size());
-            }
-
-            profiler.addNumber("retransmit-video", request_packet.video_packet_indices.size());
-            profiler.addNumber("retransmit-parity", request_packet.parity_packet_indices.size());
-        }
-    }
+    log.AddLog("Receiver FPS %f\n", profiler.getNumber("report-count") / profiler.getElapsedTime().sec());
 }
 
-void log_receiver_report_summary(ExampleAppLog& log, tt::Profiler& profiler)
+void log_send_summary(ExampleAppLog& log, tt::Profiler& profiler)
 {
-    log.AddLog("Receiver FPS %f\n", profiler.getNumber("report-count") / profiler.getElapsedTime().sec());
+    auto elapsed_time{profiler.getElapsedTime()};
+    log.AddLog("Send Summary:\n");
+    log.AddLog("  Video Bandwidth: %f Mbps\n", profiler.getNumber("send-video-byte") / elapsed_time.sec() / (1024.0f * 1024.0f / 8.0f));
+    log.AddLog("  Compact Frame Ratio: %f\n", profiler.getNumber("send-compact-frame") / profiler.getNumber("pipeline-frame"));
+    log.AddLog("  Audio Frame Per Second: %f\n", profiler.getNumber("send-audio-frame") / elapsed_time.sec());
+    log.AddLog("  Audio Packet Per Second: %f\n", profiler.getNumber("send-audio-packet") / elapsed_time.sec());
+    log.AddLog("  Audio Bandwidth: %f Kbps\n", profiler.getNumber("send-audio-byte") / elapsed_time.sec() / (1024.0f / 8.0f));
+    log.AddLog("  Audio Capture To Send Latency Average: %f ms\n", profiler.getNumber("send-audio-latency") / profiler.getNumber("send-audio-frame"));
+    log.AddLog("  Audio Dropped Frame Per Second: %f\n", profiler.getNumber("send-audio-dropped") / elapsed_time.sec());
 }
 
 void log_video_pipeline_summary(ExampleAppLog& log, int last_frame_id, tt::Profiler& profiler)
@@ -233,12 +219,23 @@ void log_video_pipeline_summary(ExampleAppLog& log, int last_frame_id, tt::Profi
     log.AddLog("  Color Bandwidth: %f Mbps\n", profiler.getNumber("pipeline-vp8byte") / elapsed_time.sec() / (1024.0f * 1024.0f / 8.0f));
     log.AddLog("  Depth Bandwidth: %f Mbps\n", profiler.getNumber("pipeline-trvlbyte") / elapsed_time.sec() / (1024.0f * 1024.0f / 8.0f));
     log.AddLog("  Keyframe Ratio: %f\n", profiler.getNumber("pipeline-keyframe") / profiler.getNumber("pipeline-frame"));
+    const float frame_kilobyte_mean{profiler.getNumber("pipeline-framekilobyte") / profiler.getNumber("pipeline-frame")};
+    const float frame_kilobyte_squared_mean{profiler.getNumber("pipeline-framekilobyte-squared") / profiler.getNumber("pipeline-frame")};
+    log.AddLog("  Frame Size Standard Deviation: %f KB\n", std::sqrt(std::max(frame_kilobyte_squared_mean - frame_kilobyte_mean * frame_kilobyte_mean, 0.0f)));
+    log.AddLog("  Idle Skipped Frame Ratio: %f\n", profiler.getNumber("idle-skipped-frame") / (profiler.getNumber("idle-skipped-frame") + profiler.getNumber("pipeline-frame")));
+    log.AddLog("  Scene Change Detection Time Average: %f\n", profiler.getNumber("idle-detection") / (profiler.getNumber("idle-skipped-frame") + profiler.getNumber("pipeline-frame")));
     log.AddLog("  Occlusion Removal Time Average: %f\n", profiler.getNumber("pipeline-occlusion") / profiler.getNumber("pipeline-frame"));
+    log.AddLog("  Depth Denoising Time Average: %f\n", profiler.getNumber("pipeline-denoise") / profiler.getNumber("pipeline-frame"));
+    log.AddLog("  Delayed Depth Pixels Per Frame: %f\n", profiler.getNumber("pipeline-denoise-delayed") / profiler.getNumber("pipeline-frame"));
+    log.AddLog("  Region Of Interest Time Average: %f\n", profiler.getNumber("pipeline-roi") / profiler.getNumber("pipeline-frame"));
+    log.AddLog("  Depth Pixels Outside Region Per Frame: %f\n", profiler.getNumber("pipeline-roi-invalidated") / profiler.getNumber("pipeline-frame"));
     log.AddLog("  Transformation Time Average: %f\n", profiler.getNumber("pipeline-mapping") / profiler.getNumber("pipeline-frame"));
+    log.AddLog("  Color Fill Time Average: %f\n", profiler.getNumber("pipeline-colorfill") / profiler.getNumber("pipeline-frame"));
     log.AddLog("  Yuv Conversion Time Average: %f\n", profiler.getNumber("pipeline-yuv") / profiler.getNumber("pipeline-frame"));
     log.AddLog("  Color Encoder Time Average: %f\n", profiler.getNumber("pipeline-vp8") / profiler.getNumber("pipeline-frame"));
     log.AddLog("  Depth Encoder Time Average: %f\n", profiler.getNumber("pipeline-trvl") / profiler.getNumber("pipeline-frame"));
     log.AddLog("  Floor Detection Time Average: %f\n", profiler.getNumber("pipeline-floor") / profiler.getNumber("pipeline-frame"));
+    log.AddLog("  Floor Verified Frame Ratio: %f\n", profiler.getNumber("pipeline-floor-verified") / profiler.getNumber("pipeline-frame"));
 }
 
 void log_retransmission_summary(ExampleAppLog& log, tt::Profiler& profiler)
@@ -249,6 +246,8 @@ void log_retransmission_summary(ExampleAppLog& log, tt::Profiler& profiler)
     log.AddLog("  Video Packet Per Second: %f\n", profiler.getNumber("retransmit-video") / elapsed_time.sec());
     log.AddLog("  Parity Packet Per Second: %f\n", profiler.getNumber("retransmit-parity") / elapsed_time.sec());
     log.AddLog("  Bandwidth: %f Mbps\n", profiler.getNumber("retransmit-byte") / elapsed_time.sec() / (1024.0f * 1024.0f / 8.0f));
+    log.AddLog("  Dropped Request Per Second: %f\n", profiler.getNumber("retransmit-dropped") / elapsed_time.sec());
+    log.AddLog("  Deferred Frame Per Second: %f\n", profiler.getNumber("retransmit-deferred") / elapsed_time.sec());
 }
 
 void start(KinectInterface& kinect_interface)
@@ -258,11 +257,52 @@ void start(KinectInterface& kinect_interface)
     constexpr float HEARTBEAT_INTERVAL_SEC{1.0f};
     constexpr float VIDEO_PARITY_PACKET_STORAGE_TIME_OUT_SEC{3.0f};
     constexpr float HEARTBEAT_TIME_OUT_SEC{10.0f};
+    // A receiver not acknowledging the SessionInfo by then gets treated as one without the extension.
+    // The SessionInfo gets resent with the heartbeat within, in case the first one got lost.
+    constexpr float SESSION_INFO_ACK_WAIT_SEC{2.0f};
     constexpr float SUMMARY_INTERVAL_SEC{10.0f};
+    // Receivers opt in for multicast. Set MULTICAST_ENABLED false to always unicast.
+    // The group is in the organization-local scope and packets do not get routed beyond the LAN.
+    constexpr bool MULTICAST_ENABLED{true};
+    constexpr const char* MULTICAST_ADDRESS{"239.255.37.73"};
+    constexpr unsigned short MULTICAST_PORT{3779};
+    // kh_reader compares the sender CPU time, bandwidth, and quality the settings below trade.
+    // The codecs for receivers reading compact messages.
+    constexpr ColorCodec COLOR_CODEC{ColorCodec::TiledVp9};
+    constexpr DepthCodec DEPTH_CODEC{DepthCodec::TiledTrvlZstd};
+    // Quantizing depth pixels following their noise saves bandwidth on far pixels.
+    constexpr DepthQuantization DEPTH_QUANTIZATION{DepthQuantization::InverseDepth};
+    // Holds single-frame depth flickers back from TRVL, delaying changes of pixels by a frame.
+    constexpr bool DEPTH_DENOISING_ENABLED{true};
+    // For example, RegionOfInterest{500, 3000, 1000.0f, std::pair{-0.1f, 2.2f}, DepthCrop{64, 0, 512, 576}} keeps a person within 3 m.
+    const std::optional<RegionOfInterest> REGION_OF_INTEREST{};
+    // Filling color pixels without depth saves the bytes spent on pixels receivers drop.
+    constexpr bool DEPTH_MASKED_COLOR_ENABLED{true};
+    // Frames of a still scene get skipped except one per IDLE_FRAME_INTERVAL_SEC.
+    constexpr bool IDLE_MODE_ENABLED{true};
+    constexpr float IDLE_FRAME_INTERVAL_SEC{1.0f};
+    // Receivers falling behind recover through a refreshed stripe per frame instead of keyframes when both codecs are tiled.
+    constexpr bool INTRA_REFRESH_ENABLED{true};
+    // Only the profile of a tiled COLOR_CODEC gets intra refresh since other codecs ignore it.
+    ColorEncoderProfile vp8_profile{create_default_vp8_color_encoder_profile()};
+    vp8_profile.intra_refresh = INTRA_REFRESH_ENABLED && COLOR_CODEC == ColorCodec::TiledVp8;
+    ColorEncoderProfile vp9_profile{create_default_vp9_color_encoder_profile()};
+    vp9_profile.intra_refresh = INTRA_REFRESH_ENABLED && COLOR_CODEC == ColorCodec::TiledVp9;
+    // Tracking keeps the floor while the Kinect gets handled, for less time than detecting it each frame.
+    constexpr bool FLOOR_TRACKING_ENABLED{true};
+    // The rays of depth pixels get computed at the first launch and then mapped from a file here.
+    const std::optional<std::string> DEPTH_RAY_TABLE_FOLDER_PATH{(std::filesystem::temp_directory_path() / "KinectToHololens").string()};
+    // Opus frames per AudioBundle packet, which cut the packet rate at the cost of 20 ms per extra frame.
+    constexpr int AUDIO_BUNDLE_FRAME_COUNT{1};
 
     // The default port (the port when nothing is entered) is 7777.
     const int sender_id{gsl::narrow<const int>(std::random_device{}() % (static_cast<unsigned int>(INT_MAX) + 1))};
     const k4a::calibration calibration{kinect_interface.getCalibration()};
+    const VideoPipelineOptions video_pipeline_options{DEPTH_DENOISING_ENABLED, DEPTH_MASKED_COLOR_ENABLED, REGION_OF_INTEREST,
+                                                      vp8_profile, vp9_profile, INTRA_REFRESH_ENABLED, FLOOR_TRACKING_ENABLED,
+                                                      DEPTH_RAY_TABLE_FOLDER_PATH};
+    const SessionInfo session_info{create_session_info(sender_id, calibration, REGION_OF_INTEREST ? REGION_OF_INTEREST->crop : std::nullopt,
+                                                       COLOR_CODEC, DEPTH_CODEC, DEPTH_QUANTIZATION, INTRA_REFRESH_ENABLED)};
 
     std::cout << "Start kinect_sender (sender_id: " << sender_id << ").\n";
 
@@ -281,6 +321,14 @@ void start(KinectInterface& kinect_interface)
         }
     }
     socket->set_option(asio::socket_base::send_buffer_size{SENDER_SEND_BUFFER_SIZE});
+
+    std::optional<asio::ip::udp::endpoint> multicast_endpoint{};
+    if (MULTICAST_ENABLED) {
+        multicast_endpoint = asio::ip::udp::endpoint{asio::ip::make_address(MULTICAST_ADDRESS), MULTICAST_PORT};
+        socket->set_option(asio::ip::multicast::hops{1});
+        // For receivers running in the same machine.
+        socket->set_option(asio::ip::multicast::enable_loopback{true});
+    }
     tt::UdpSocket udp_socket{std::move(*socket)};
 
     // Print IP addresses of this machine.
@@ -298,17 +346,24 @@ void start(KinectInterface& kinect_interface)
 
     // Initialize instances for loop below.
     const tt::TimePoint session_start_time{tt::TimePoint::now()};
-    tt::TimePoint last_heartbeat_time{tt::TimePoint::now()};
 
-    VideoPipeline video_pipeline{calibration};
+    const tt::TimePoint video_pipeline_start_time{tt::TimePoint::now()};
+    VideoPipeline video_pipeline{calibration, video_pipeline_options};
+    std::cout << "VideoPipeline started in " << video_pipeline_start_time.elapsed_time().ms() << " ms"
+              << (video_pipeline.depth_ray_table_mapped() ? " with the cached DepthRayTable.\n" : " computing the DepthRayTable.\n");
+    SceneChangeDetector scene_change_detector;
     
     std::unique_ptr<AudioSender> audio_sender{nullptr};
     if (kinect_interface.isDevice())
-        audio_sender.reset(new AudioSender(sender_id));
+        audio_sender.reset(new AudioSender(sender_id, AUDIO_BUNDLE_FRAME_COUNT, session_start_time));
     
     VideoSenderStorage video_packet_storage;
 
-    std::map<int, RemoteReceiver> remote_receivers;
+    RemoteReceiverRegistry remote_receivers{HEARTBEAT_INTERVAL_SEC, HEARTBEAT_TIME_OUT_SEC};
+    std::vector<int> heartbeat_receiver_ids;
+    std::vector<int> timed_out_receiver_ids;
+    // Set by a relay when a receiver connects to it.
+    bool keyframe_requested{false};
 
     std::mt19937 rng{std::random_device{}()};
 
@@ -333,11 +388,13 @@ void start(KinectInterface& kinect_interface)
         ImGui::SetNextWindowPos(ImVec2(0.0f, IMGUI_HEIGHT * 0.4f), ImGuiCond_FirstUseEver);
         ImGui::SetNextWindowSize(ImVec2(IMGUI_WIDTH * 0.4f, IMGUI_HEIGHT * 0.6f), ImGuiCond_FirstUseEver);
         ImGui::Begin("Remote Receivers");
-        for (auto& [_, remote_receiver] : remote_receivers) {
+        ImGui::Text("Receiver Count: %d", gsl::narrow<int>(remote_receivers.size()));
+        for (auto& remote_receiver : remote_receivers) {
             ImGui::Text("End Point: %s:%d", remote_receiver.endpoint.address().to_string(), remote_receiver.endpoint.port());
             ImGui::BulletText("Receiver ID: %d", remote_receiver.receiver_id);
-            ImGui::BulletText("Video: %s", remote_receiver.video_requested ? "Requested" : "Not Requested");
+            ImGui::BulletText("Video: %s", remote_receiver.video_requested ? "Requested" : remote_receiver.video_held ? "Held" : "Not Requested");
             ImGui::BulletText("Audio: %s", remote_receiver.audio_requested ? "Requested" : "Not Requested");
+            ImGui::BulletText("Multicast: %s", remote_receiver.multicast ? "Joined" : "Not Joined");
             ImGui::BulletText("Frame ID: %d", remote_receiver.video_frame_id.value_or(-1));
         }
         ImGui::End();
@@ -363,89 +420,155 @@ void start(KinectInterface& kinect_interface)
                 udp_socket.send(tt::create_confirm_sender_packet(sender_id, connect_packet_info.connect_packet.receiver_id).bytes, connect_packet_info.receiver_endpoint);
 
                 // Skip already existing receivers.
-                if (remote_receivers.find(connect_packet_info.connect_packet.receiver_id) != remote_receivers.end())
+                if (remote_receivers.find(connect_packet_info.connect_packet.receiver_id))
                     continue;
 
                 std::cout << "connect_packet_info.connect_packet_data.video_requested: " << connect_packet_info.connect_packet.video_requested << "\n";
 
                 std::cout << "Receiver " << connect_packet_info.connect_packet.receiver_id << " connected.\n";
-                remote_receivers.insert({connect_packet_info.connect_packet.receiver_id,
-                                         RemoteReceiver{connect_packet_info.receiver_endpoint,
-                                                        connect_packet_info.connect_packet.receiver_id,
-                                                        connect_packet_info.connect_packet.video_requested,
-                                                        connect_packet_info.connect_packet.audio_requested}});
+                // Video gets held until the receiver acknowledges the SessionInfo or stops being waited for,
+                // so a joining receiver does not switch the others to the message format without the extension and back.
+                RemoteReceiver remote_receiver{connect_packet_info.receiver_endpoint,
+                                               connect_packet_info.connect_packet.receiver_id,
+                                               false,
+                                               connect_packet_info.connect_packet.audio_requested};
+                remote_receiver.video_held = connect_packet_info.connect_packet.video_requested;
+                remote_receivers.add(std::move(remote_receiver));
+                udp_socket.send(create_session_info_sender_packet_bytes(sender_id, session_info), connect_packet_info.receiver_endpoint);
             }
 
             // Skip the main part of the loop if there is no receiver connected.
             if (!remote_receivers.empty()) {
-                // Send heartbeat packets to receivers.
-                if (last_heartbeat_time.elapsed_time().sec() > HEARTBEAT_INTERVAL_SEC) {
-                    for (auto& [_, remote_receiver] : remote_receivers)
-                        udp_socket.send(tt::create_heartbeat_sender_packet(sender_id).bytes, remote_receiver.endpoint);
-                    last_heartbeat_time = tt::TimePoint::now();
+                // Send heartbeat packets to receivers and remove receivers that timed out.
+                heartbeat_receiver_ids.clear();
+                timed_out_receiver_ids.clear();
+                remote_receivers.update_timers(heartbeat_receiver_ids, timed_out_receiver_ids);
+                for (int receiver_id : heartbeat_receiver_ids) {
+                    auto remote_receiver_ptr{remote_receivers.find(receiver_id)};
+                    udp_socket.send(tt::create_heartbeat_sender_packet(sender_id).bytes, remote_receiver_ptr->endpoint);
+                    // Resend SessionInfo until it gets acknowledged.
+                    if (remote_receiver_ptr->session_info_version != session_info.version)
+                        udp_socket.send(create_session_info_sender_packet_bytes(sender_id, session_info), remote_receiver_ptr->endpoint);
+                    if (remote_receiver_ptr->video_held && remote_receiver_ptr->connect_time.elapsed_time().sec() > SESSION_INFO_ACK_WAIT_SEC) {
+                        std::cout << "Receiver " << receiver_id << " did not acknowledge the SessionInfo and gets video without the extension.\n";
+                        remote_receivers.release_video(*remote_receiver_ptr);
+                    }
+                }
+
+                for (int receiver_id : timed_out_receiver_ids) {
+                    std::cout << "Timed out receiver " << receiver_id << " after waiting for " << HEARTBEAT_TIME_OUT_SEC << " seconds without a received packet.\n";
+                    remote_receivers.remove(receiver_id);
                 }
 
                 // Send video packets to the receivers.
-                auto [is_ready, keyframe] {plan_video_bitrate_control(remote_receivers, video_pipeline.last_frame_id(), video_pipeline.last_frame_time())};
+                // Codecs other than the default ones and intra refresh are only for compact messages.
+                const bool compact{is_compact_video_message_available(remote_receivers, session_info)};
+                const bool intra_refreshed{compact && is_intra_refreshed(session_info.color_codec, session_info.depth_codec, session_info.intra_refresh)};
+                auto [is_ready, keyframe] {plan_video_bitrate_control(remote_receivers, video_pipeline.last_frame_id(), video_pipeline.last_frame_time(),
+                                                                      intra_refreshed)};
                 if (is_ready) {
                     // Try getting a Kinect frame.
                     auto kinect_frame{kinect_interface.getFrame()};
+                    // While the scene stays still, only send a frame per IDLE_FRAME_INTERVAL_SEC
+                    // and skip the pipeline for the others to save CPU time and bandwidth.
+                    // A change gets sent with the first frame it appears in.
+                    if (kinect_frame && IDLE_MODE_ENABLED) {
+                        const auto scene_change_detection_start{tt::TimePoint::now()};
+                        const bool scene_changed{scene_change_detector.detect(*kinect_frame)};
+                        profiler.addNumber("idle-detection", scene_change_detection_start.elapsed_time().ms());
+                        const bool idle_frame_due{video_pipeline.last_frame_time().elapsed_time().sec() > IDLE_FRAME_INTERVAL_SEC};
+                        if (!scene_changed && !keyframe && !keyframe_requested && !idle_frame_due) {
+                            profiler.addNumber("idle-skipped-frame", 1);
+                            kinect_frame = std::nullopt;
+                        } else {
+                            scene_change_detector.update();
+                        }
+                    }
+
                     if (kinect_frame) {
-                        auto video_frame{video_pipeline.process(*kinect_frame, keyframe, profiler)};
-                        send_video_message(video_frame, sender_id, session_start_time, calibration,
-                                           udp_socket, video_packet_storage, remote_receivers, rng);
+                        const auto color_codec{compact ? session_info.color_codec : ColorCodec::Vp8};
+                        const auto depth_codec{compact ? session_info.depth_codec : DepthCodec::Trvl};
+                        const auto depth_quantization{compact ? session_info.depth_quantization : DepthQuantization::None};
+                        auto video_frame{video_pipeline.process(*kinect_frame, keyframe || keyframe_requested, color_codec, depth_codec, depth_quantization, profiler)};
+                        keyframe_requested = false;
+                        send_video_message(video_frame, sender_id, session_start_time, session_info, compact,
+                                           udp_socket, multicast_endpoint, video_packet_storage, remote_receivers, rng, profiler);
                     }
                 }
 
                 // Send audio packets to the receivers.
                 if (audio_sender)
-                    audio_sender->send(udp_socket, remote_receivers);
-
-                for (auto& [receiver_id, receiver_packet_set] : receiver_packet_collection.receiver_packet_infos) {
-                    auto remote_receiver_ptr{&remote_receivers.at(receiver_id)};
-                    if (receiver_packet_set.received_any) {
-                        apply_report_packets(receiver_packet_set.report_packets,
-                                             *remote_receiver_ptr,
-                                             profiler);
-                        retransmit_requested_packets(udp_socket,
-                                                     receiver_packet_set.request_packets,
-                                                     video_packet_storage,
-                                                     remote_receiver_ptr->endpoint,
-                                                     profiler);
-                        remote_receiver_ptr->last_packet_time = tt::TimePoint::now();
-                    } else {
-                        if (remote_receiver_ptr->last_packet_time.elapsed_time().sec() > HEARTBEAT_TIME_OUT_SEC) {
-                            std::cout << "Timed out receiver " << receiver_id << " after waiting for " << HEARTBEAT_TIME_OUT_SEC << " seconds without a received packet.\n";
-                            remote_receivers.erase(receiver_id);
-                        }
+                    audio_sender->send(udp_socket, remote_receivers, profiler);
+
+                for (auto& receiver_packet_info : receiver_packet_collection.receiver_packet_infos) {
+                    // The receiver can be removed above for timing out.
+                    auto remote_receiver_ptr{remote_receivers.find(receiver_packet_info.receiver_id)};
+                    if (!remote_receiver_ptr)
+                        continue;
+
+                    // Let the receiver join the multicast group.
+                    // The group packet gets sent again for every join packet in case it gets lost.
+                    if (receiver_packet_info.multicast_join_requested && multicast_endpoint) {
+                        if (!remote_receiver_ptr->multicast)
+                            std::cout << "Receiver " << receiver_packet_info.receiver_id << " joined the multicast group.\n";
+                        remote_receiver_ptr->multicast = true;
+                        udp_socket.send(create_multicast_group_sender_packet_bytes(sender_id, *multicast_endpoint), remote_receiver_ptr->endpoint);
                     }
+
+                    if (receiver_packet_info.keyframe_requested)
+                        keyframe_requested = true;
+
+                    // An acknowledgement of another version, such as KH_WITHDRAWN_SESSION_INFO_VERSION from a relay,
+                    // makes the receiver count as one without the SessionInfo again.
+                    if (receiver_packet_info.session_info_ack_version) {
+                        remote_receiver_ptr->session_info_version = receiver_packet_info.session_info_ack_version;
+                        if (remote_receiver_ptr->session_info_version == session_info.version)
+                            remote_receivers.release_video(*remote_receiver_ptr);
+                    }
+
+                    apply_report_packets(receiver_packet_info.report_packets,
+                                         *remote_receiver_ptr,
+                                         remote_receivers,
+                                         profiler);
+                    // Requests get filtered with the reports applied above.
+                    remote_receiver_ptr->retransmission_scheduler.add(receiver_packet_info.request_packets,
+                                                                      remote_receiver_ptr->video_frame_id,
+                                                                      profiler);
+                    remote_receiver_ptr->last_packet_time = tt::TimePoint::now();
                 }
-            }
 
-            int min_receiver_frame_id{INT_MAX};
-            for (auto& [_, remote_receiver] : remote_receivers) {
-                if (remote_receiver.video_frame_id && *remote_receiver.video_frame_id < min_receiver_frame_id)
-                    min_receiver_frame_id = *remote_receiver.video_frame_id;
+                // Retransmit requested packets within the budget of each receiver.
+                // Requests that do not fit in the budget get deferred to later loops.
+                for (auto& remote_receiver : remote_receivers) {
+                    remote_receiver.retransmission_scheduler.retransmit(udp_socket,
+                                                                        video_packet_storage,
+                                                                        remote_receiver.video_frame_id,
+                                                                        remote_receiver.endpoint,
+                                                                        profiler);
+                }
             }
 
-            if(min_receiver_frame_id != INT_MAX)
-                video_packet_storage.cleanup(min_receiver_frame_id);
+            auto min_receiver_frame_id{remote_receivers.min_video_frame_id()};
+            if (min_receiver_frame_id)
+                video_packet_storage.cleanup(*min_receiver_frame_id);
 
         } catch (tt::UdpSocketRuntimeError e) {
             std::cout << "UdpSocketRuntimeError\n  message: " << e.what() << "\n  endpoint: " << e.endpoint() << "\n";
             std::cout << "remote_receivers.size(): " << remote_receivers.size() << "\n";
-            for (auto it{remote_receivers.begin()}; it != remote_receivers.end();) {
-                if (it->second.endpoint == e.endpoint()) {
-                    it = remote_receivers.erase(it);
-                } else {
-                    ++it;
-                }
+            std::vector<int> failed_receiver_ids;
+            for (auto& remote_receiver : remote_receivers) {
+                if (remote_receiver.endpoint == e.endpoint())
+                    failed_receiver_ids.push_back(remote_receiver.receiver_id);
             }
+
+            for (int receiver_id : failed_receiver_ids)
+                remote_receivers.remove(receiver_id);
         }
 
         if (profiler.getElapsedTime().sec() > SUMMARY_INTERVAL_SEC) {
             log_receiver_report_summary(log, profiler);
             log_video_pipeline_summary(log, video_pipeline.last_frame_id(), profiler);
+            log_send_summary(log, profiler);
             log_retransmission_summary(log, profiler);
             profiler.reset();
         }
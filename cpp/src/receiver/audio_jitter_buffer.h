@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <optional>
+#include <vector>
+#include "native/tt_native.h"
+
+namespace kh
+{
+// Each audio frame of the sender has 960 samples at 48 kHz.
+constexpr float KH_AUDIO_FRAME_MS{20.0f};
+
+enum class AudioFrameSource
+{
+    // The packet of the frame.
+    Packet,
+    // The in-band FEC data of the packet of the next frame.
+    ForwardErrorCorrection,
+    // Opus packet loss concealment without data.
+    Concealment
+};
+
+struct AudioJitterBufferFrame
+{
+    int frame_id;
+    AudioFrameSource source;
+    // The packet to decode, which is the one of the next frame for FEC and empty for concealment.
+    // Valid until the next call of the AudioJitterBuffer.
+    gsl::span<const std::byte> opus_frame;
+};
+
+struct AudioJitterBufferStats
+{
+    int packet_frame_count{0};
+    int fec_frame_count{0};
+    int concealed_frame_count{0};
+    // Packets arriving after their frames got played or concealed.
+    int late_packet_count{0};
+    // Frames skipped since packets piled up beyond the target delay, which happens when the clock of the sender runs faster.
+    int drift_dropped_frame_count{0};
+};
+
+// Reorders audio packets by frame ID and hands frames to the ring buffer of the speaker in order,
+// keeping the audio in the ring buffer near a target delay that follows the jitter of packet arrivals.
+// A missing frame waits until the ring buffer is about to run out, and then gets recovered
+// from the FEC data of the next packet if it has arrived or concealed otherwise.
+// The ring buffer running out is also what fills in frames when the clock of the sender runs slower,
+// and frames get dropped when packets pile up from a faster one.
+class AudioJitterBuffer
+{
+public:
+    AudioJitterBuffer()
+        : packets_{}
+        , next_frame_id_{}
+        , last_arrival_{}
+        , jitter_ms_{0.0f}
+        , stats_{}
+    {
+    }
+
+    int target_delay_frame_count() const
+    {
+        // Enough frames to cover arrivals up to JITTER_MULTIPLIER times the mean deviation late, and a frame being played.
+        constexpr float JITTER_MULTIPLIER{3.0f};
+        constexpr int MIN_TARGET_DELAY_FRAME_COUNT{2};
+        constexpr int MAX_TARGET_DELAY_FRAME_COUNT{10};
+        const int frame_count{1 + static_cast<int>(std::ceil(JITTER_MULTIPLIER * jitter_ms_ / KH_AUDIO_FRAME_MS))};
+        return std::clamp(frame_count, MIN_TARGET_DELAY_FRAME_COUNT, MAX_TARGET_DELAY_FRAME_COUNT);
+    }
+
+    float jitter_ms() const { return jitter_ms_; }
+    const AudioJitterBufferStats& stats() const { return stats_; }
+
+    void add(int frame_id, std::vector<std::byte>&& opus_frame, float arrival_ms)
+    {
+        // A sender restarting its frame IDs, or one coming back after a long silence, starts over.
+        constexpr int RESET_FRAME_ID_DIFF{100};
+
+        if (next_frame_id_ && std::abs(frame_id - *next_frame_id_) > RESET_FRAME_ID_DIFF) {
+            packets_.clear();
+            next_frame_id_ = std::nullopt;
+            last_arrival_ = std::nullopt;
+        }
+
+        update_jitter(frame_id, arrival_ms);
+
+        if (next_frame_id_ && frame_id < *next_frame_id_) {
+            ++stats_.late_packet_count;
+            return;
+        }
+        packets_.emplace(frame_id, std::move(opus_frame));
+    }
+
+    // Returns the next frame to write into the ring buffer, which has ring_buffer_frame_count frames,
+    // or std::nullopt when the ring buffer has enough or the next frame should still be waited for.
+    std::optional<AudioJitterBufferFrame> pop(int ring_buffer_frame_count)
+    {
+        // Packets beyond this many frames over the target delay are from clock drift instead of jitter.
+        constexpr int DRIFT_MARGIN_FRAME_COUNT{2};
+
+        const int target_delay_frame_count{this->target_delay_frame_count()};
+        if (ring_buffer_frame_count >= target_delay_frame_count)
+            return std::nullopt;
+
+        if (!next_frame_id_) {
+            // Starts with enough packets to cover the target delay.
+            if (packets_.empty() || packets_.rbegin()->first - packets_.begin()->first + 1 < target_delay_frame_count)
+                return std::nullopt;
+            next_frame_id_ = packets_.begin()->first;
+        }
+
+        // Nothing arrived to play or conceal, such as when the sender stopped sending audio.
+        if (packets_.empty())
+            return std::nullopt;
+
+        const int buffered_frame_count{packets_.rbegin()->first - *next_frame_id_ + 1};
+        if (ring_buffer_frame_count + buffered_frame_count > target_delay_frame_count + DRIFT_MARGIN_FRAME_COUNT) {
+            ++stats_.drift_dropped_frame_count;
+            packets_.erase(*next_frame_id_);
+            ++*next_frame_id_;
+        }
+
+        const int frame_id{*next_frame_id_};
+        // Packets get erased when the frame after them gets popped, so the returned span stays valid until the next call.
+        packets_.erase(packets_.begin(), packets_.lower_bound(frame_id));
+
+        auto packet_it{packets_.find(frame_id)};
+        if (packet_it != packets_.end()) {
+            ++next_frame_id_.value();
+            ++stats_.packet_frame_count;
+            return AudioJitterBufferFrame{frame_id, AudioFrameSource::Packet, packet_it->second};
+        }
+
+        // The missing frame still has time to arrive until the ring buffer is about to run out.
+        if (ring_buffer_frame_count > 0)
+            return std::nullopt;
+
+        ++next_frame_id_.value();
+        auto next_packet_it{packets_.find(frame_id + 1)};
+        if (next_packet_it != packets_.end()) {
+            ++stats_.fec_frame_count;
+            return AudioJitterBufferFrame{frame_id, AudioFrameSource::ForwardErrorCorrection, next_packet_it->second};
+        }
+
+        ++stats_.concealed_frame_count;
+        return AudioJitterBufferFrame{frame_id, AudioFrameSource::Concealment, {}};
+    }
+
+private:
+    // The interarrival jitter of RFC 3550, which is a running mean deviation of the arrival intervals from the frame intervals.
+    void update_jitter(int frame_id, float arrival_ms)
+    {
+        if (last_arrival_) {
+            const float deviation_ms{(arrival_ms - last_arrival_->second) - (frame_id - last_arrival_->first) * KH_AUDIO_FRAME_MS};
+            jitter_ms_ += (std::abs(deviation_ms) - jitter_ms_) / 16.0f;
+        }
+        last_arrival_ = std::pair{frame_id, arrival_ms};
+    }
+
+    std::map<int, std::vector<std::byte>> packets_;
+    std::optional<int> next_frame_id_;
+    // The frame ID and the arrival time of the last packet.
+    std::optional<std::pair<int, float>> last_arrival_;
+    float jitter_ms_;
+    AudioJitterBufferStats stats_;
+};
+}
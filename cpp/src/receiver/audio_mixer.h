@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <xmmintrin.h>
+#include <gsl/gsl>
+
+namespace kh
+{
+// The Kinect microphone records quietly, so streams get amplified by this much unless set otherwise.
+constexpr float KH_DEFAULT_AUDIO_GAIN{8.0f};
+
+// Adds pcm multiplied by gain to mix, four samples at a time with SSE.
+inline void mix_audio_samples(gsl::span<const float> pcm, float gain, gsl::span<float> mix)
+{
+    const gsl::index sample_count{std::min(pcm.size(), mix.size())};
+    const __m128 gain_vector{_mm_set1_ps(gain)};
+    gsl::index i{0};
+    for (; i + 4 <= sample_count; i += 4) {
+        const __m128 scaled{_mm_mul_ps(_mm_loadu_ps(pcm.data() + i), gain_vector)};
+        _mm_storeu_ps(mix.data() + i, _mm_add_ps(_mm_loadu_ps(mix.data() + i), scaled));
+    }
+    for (; i < sample_count; ++i)
+        mix[i] += pcm[i] * gain;
+}
+
+// The largest absolute value of samples.
+inline float find_audio_peak(gsl::span<const float> samples)
+{
+    // Clearing the sign bit takes the absolute value.
+    const __m128 sign_mask{_mm_set1_ps(-0.0f)};
+    __m128 peak_vector{_mm_setzero_ps()};
+    gsl::index i{0};
+    for (; i + 4 <= samples.size(); i += 4)
+        peak_vector = _mm_max_ps(peak_vector, _mm_andnot_ps(sign_mask, _mm_loadu_ps(samples.data() + i)));
+
+    alignas(16) float peaks[4];
+    _mm_store_ps(peaks, peak_vector);
+    float peak{std::max(std::max(peaks[0], peaks[1]), std::max(peaks[2], peaks[3]))};
+    for (; i < samples.size(); ++i)
+        peak = std::max(peak, std::abs(samples[i]));
+    return peak;
+}
+
+// Keeps the peaks of mixed audio under a ceiling instead of letting them clip,
+// which happens more with several streams getting mixed.
+// A frame with a peak over the ceiling lowers the gain right away,
+// and the gain recovers over later frames, ramping within each frame not to click.
+class AudioLimiter
+{
+public:
+    AudioLimiter()
+        : gain_{1.0f}
+    {
+    }
+
+    float gain() const { return gain_; }
+
+    void apply(gsl::span<float> samples)
+    {
+        constexpr float CEILING{0.98f};
+        // The part of the gain reduction recovered per call, which takes about half a second with 20 ms frames.
+        constexpr float RELEASE_RATIO{0.1f};
+
+        const float peak{find_audio_peak(samples)};
+        const float released_gain{gain_ + (1.0f - gain_) * RELEASE_RATIO};
+        const float next_gain{peak * released_gain > CEILING ? CEILING / peak : released_gain};
+
+        // Lowering the gain ramps only in the next frame, so peaks of this frame never exceed the ceiling.
+        const float start_gain{next_gain < gain_ ? next_gain : gain_};
+        const float gain_step{(next_gain - start_gain) / std::max<gsl::index>(samples.size(), 1)};
+        gain_ = next_gain;
+
+        const __m128 step_vector{_mm_set1_ps(gain_step * 4.0f)};
+        const __m128 min_vector{_mm_set1_ps(-1.0f)};
+        const __m128 max_vector{_mm_set1_ps(1.0f)};
+        __m128 gain_vector{_mm_setr_ps(start_gain, start_gain + gain_step, start_gain + gain_step * 2.0f, start_gain + gain_step * 3.0f)};
+        gsl::index i{0};
+        for (; i + 4 <= samples.size(); i += 4) {
+            const __m128 scaled{_mm_mul_ps(_mm_loadu_ps(samples.data() + i), gain_vector)};
+            // Clamping only catches the rounding of the ramp.
+            _mm_storeu_ps(samples.data() + i, _mm_min_ps(_mm_max_ps(scaled, min_vector), max_vector));
+            gain_vector = _mm_add_ps(gain_vector, step_vector);
+        }
+        for (; i < samples.size(); ++i)
+            samples[i] = std::clamp(samples[i] * (start_gain + gain_step * i), -1.0f, 1.0f);
+    }
+
+private:
+    float gain_;
+};
+}
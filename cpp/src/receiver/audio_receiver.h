@@ -1,100 +1,294 @@
 #pragma once
 
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include "utils/extension_packets.h"
+#include "win32/audio_thread.h"
 #include "win32/soundio_utils.h"
+#include "audio_jitter_buffer.h"
+#include "audio_mixer.h"
 
 namespace kh
 {
-static SoundIoRingBuffer* ring_buffer{nullptr};
-
-void write_callback(SoundIoOutStream* outstream, int frame_count_min, int frame_count_max)
-{
-    write_buffer_to_outstream(outstream, frame_count_min, frame_count_max, ring_buffer);
-}
-
-void underflow_callback(struct SoundIoOutStream* outstream) {
-    static int count = 0;
-    // This line leaves too many logs...
-    //printf("underflow %d\n", ++count);
-}
-
 // AudioPacketPlayer better suits what this class does.
 // However, this is named receiver to match the corresponding c# class,
 // which only receives packets and enqueues them to a ring buffer.
+// receive() writes packets into the Opus frame ring buffer of the instance, and its audio thread passes them
+// through an AudioJitterBuffer per sender, which decides what to decode and when.
+// The audio thread mixes the decoded frames of the senders with their gains and passes the mix
+// through an AudioLimiter into the sample ring buffer, so one speaker plays several senders, such as the Kinects of a room.
+// Senders wait for each other to keep their frames aligned in the mix, except when the sample ring buffer is about to run out.
+// The write callback of soundio, which finds the instance through the userdata of the stream, plays the sample ring buffer.
+// Both ring buffers are lock-free queues of soundio with a single reader and a single writer,
+// so the callback never waits for the other threads, and several instances can play at once.
+// With time stamps from AudioBundle packets, the instance tells the time stamp of the audio of a sender playing,
+// which VideoPresentationScheduler aligns video frames of the sender to.
 class AudioReceiver
 {
 public:
     AudioReceiver()
-        : sound_io_{create_sound_io_handle()}, default_speaker_stream_{create_default_speaker_stream(sound_io_, write_callback, underflow_callback)},
-        opus_decoder_{tt::create_opus_decoder_handle(KH_SAMPLE_RATE, KH_CHANNEL_COUNT)},
-        pcm_{}, last_audio_frame_id_{-1}
+        : sound_io_{create_sound_io_handle()},
+        sample_ring_buffer_{create_sound_io_ring_buffer(sound_io_, gsl::narrow<int>(KH_LATENCY_SECONDS * 2 * KH_BYTES_PER_SECOND))},
+        opus_frame_ring_buffer_{create_sound_io_ring_buffer(sound_io_, OPUS_FRAME_RING_BUFFER_CAPACITY)},
+        default_speaker_stream_{create_default_speaker_stream(sound_io_, write_callback, underflow_callback, this)},
+        device_latency_ms_{gsl::narrow_cast<float>(default_speaker_stream_->software_latency * 1000.0)},
+        start_time_{tt::TimePoint::now()}, streams_{}, mix_{}, limiter_{},
+        shared_state_mutex_{}, gains_{}, jitter_buffer_stats_{}, time_stamp_anchors_{}, playout_anchors_{}, audio_thread_{}
     {
-        constexpr int capacity{gsl::narrow<int>(KH_LATENCY_SECONDS * 2 * KH_BYTES_PER_SECOND)};
-
-        ring_buffer = soundio_ring_buffer_create(sound_io_.get(), capacity);
-        if (!ring_buffer)
-            throw std::runtime_error("Failed in soundio_ring_buffer_create()...");
-
         if (int error = soundio_outstream_start(default_speaker_stream_.get()))
             throw std::runtime_error(std::string("Failed to start AudioOutStream: ") + std::to_string(error));
+
+        audio_thread_.emplace([this] { decode(); }, AUDIO_THREAD_INTERVAL);
     }
 
-    void receive(std::vector<tt::AudioSenderPacket>& audio_packets)
+    // The stats of the jitter buffer of each sender that has sent audio.
+    std::map<int, AudioJitterBufferStats> jitter_buffer_stats() const
     {
-        constexpr float AMPLIFIER{8.0f};
+        std::lock_guard<std::mutex> lock{shared_state_mutex_};
+        return jitter_buffer_stats_;
+    }
 
-        soundio_flush_events(sound_io_.get());
+    // Scales the audio of the sender in the mix, which is KH_DEFAULT_AUDIO_GAIN until set.
+    void set_gain(int sender_id, float gain)
+    {
+        std::lock_guard<std::mutex> lock{shared_state_mutex_};
+        gains_.insert_or_assign(sender_id, gain);
+    }
+
+    // The time stamp of the audio of the sender coming out of the speaker now, on the clock of video frame time stamps of the sender,
+    // or std::nullopt without time stamps or while nothing gets decoded, such as when the sender stopped sending audio.
+    std::optional<float> playout_time_stamp(int sender_id) const
+    {
+        // Audio decoded longer ago than this has played out.
+        constexpr float MAX_PLAYOUT_ANCHOR_AGE_MS{1000.0f};
 
-        if (audio_packets.empty())
-            return;
+        std::lock_guard<std::mutex> lock{shared_state_mutex_};
+        auto playout_anchor_it{playout_anchors_.find(sender_id)};
+        if (playout_anchor_it == playout_anchors_.end())
+            return std::nullopt;
 
-        std::sort(audio_packets.begin(),
-                  audio_packets.end(),
-                  [](tt::AudioSenderPacket& a, tt::AudioSenderPacket& b) { return a.frame_id < b.frame_id; });
+        const auto& [anchor_ms, anchor_time_stamp] {playout_anchor_it->second};
+        const float anchor_age_ms{start_time_.elapsed_time().ms() - anchor_ms};
+        if (anchor_age_ms > MAX_PLAYOUT_ANCHOR_AGE_MS)
+            return std::nullopt;
 
-        char* write_ptr{soundio_ring_buffer_write_ptr(ring_buffer)};
-        int free_bytes{soundio_ring_buffer_free_count(ring_buffer)};
+        return anchor_time_stamp + anchor_age_ms;
+    }
 
-        const int FRAME_BYTE_SIZE{gsl::narrow<int>(sizeof(float) * pcm_.size())};
+    void receive(std::vector<tt::AudioSenderPacket>& audio_packets, const std::vector<AudioFrameTimeStamp>& audio_frame_time_stamps)
+    {
+        audio_thread_->rethrow_if_failed();
 
-        int write_cursor{0};
-        auto packet_it = audio_packets.begin();
-        while ((free_bytes - write_cursor) >= FRAME_BYTE_SIZE) {
-            if (packet_it == audio_packets.end())
-                break;
+        if (!audio_frame_time_stamps.empty()) {
+            std::lock_guard<std::mutex> lock{shared_state_mutex_};
+            for (auto& audio_frame_time_stamp : audio_frame_time_stamps)
+                time_stamp_anchors_.insert_or_assign(audio_frame_time_stamp.sender_id, audio_frame_time_stamp);
+        }
 
-            int frame_size;
-            if (packet_it->frame_id <= last_audio_frame_id_) {
-                // If a packet is about the past, throw it away and try again.
-                ++packet_it;
+        const float arrival_ms{start_time_.elapsed_time().ms()};
+        for (auto& audio_packet : audio_packets) {
+            // A packet not fitting gets dropped like one lost in the network
+            // since the audio thread has stopped emptying the ring buffer anyway.
+            const int record_size{gsl::narrow<int>(sizeof(OpusFrameRecordHeader) + audio_packet.opus_frame.size())};
+            if (soundio_ring_buffer_free_count(opus_frame_ring_buffer_.get()) < record_size)
                 continue;
+
+            // soundio mirrors the memory of ring buffers, so a record never wraps around.
+            char* record{soundio_ring_buffer_write_ptr(opus_frame_ring_buffer_.get())};
+            const OpusFrameRecordHeader header{audio_packet.sender_id, audio_packet.frame_id, arrival_ms, gsl::narrow<int>(audio_packet.opus_frame.size())};
+            memcpy(record, &header, sizeof(header));
+            memcpy(record + sizeof(header), audio_packet.opus_frame.data(), audio_packet.opus_frame.size());
+            soundio_ring_buffer_advance_write_ptr(opus_frame_ring_buffer_.get(), record_size);
+        }
+    }
+
+private:
+    // Each Opus frame in the Opus frame ring buffer follows this header.
+    struct OpusFrameRecordHeader
+    {
+        int sender_id;
+        int frame_id;
+        // When the packet arrived, in milliseconds from start_time_.
+        float arrival_ms;
+        int opus_frame_size;
+    };
+
+    // A second of Opus frames of the largest size.
+    static constexpr int OPUS_FRAME_RING_BUFFER_CAPACITY{(sizeof(OpusFrameRecordHeader) + tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE) * 50};
+    static constexpr std::chrono::milliseconds AUDIO_THREAD_INTERVAL{5};
+    static constexpr int FRAME_SAMPLE_COUNT{KH_SAMPLES_PER_FRAME * KH_CHANNEL_COUNT};
+
+    struct DecodedAudioFrame
+    {
+        int frame_id;
+        std::array<float, FRAME_SAMPLE_COUNT> pcm;
+    };
+
+    // The audio of a sender, only for the audio thread.
+    struct AudioStream
+    {
+        AudioStream()
+            : opus_decoder{tt::create_opus_decoder_handle(KH_SAMPLE_RATE, KH_CHANNEL_COUNT)}
+            , jitter_buffer{}
+            , decoded_frames{}
+            , last_arrival_ms{0.0f}
+            , started{false}
+        {
+        }
+
+        tt::OpusDecoderHandle opus_decoder;
+        AudioJitterBuffer jitter_buffer;
+        // Frames waiting for the frames of the other senders to get mixed with.
+        std::deque<DecodedAudioFrame> decoded_frames;
+        float last_arrival_ms;
+        // Whether the jitter buffer has started handing out frames, after which the other senders wait for the frames of this one.
+        bool started;
+    };
+
+    static void write_callback(SoundIoOutStream* outstream, int frame_count_min, int frame_count_max)
+    {
+        auto audio_receiver{static_cast<AudioReceiver*>(outstream->userdata)};
+        write_buffer_to_outstream(outstream, frame_count_min, frame_count_max, audio_receiver->sample_ring_buffer_.get());
+    }
+
+    static void underflow_callback(struct SoundIoOutStream* outstream) {
+        static int count = 0;
+        // This line leaves too many logs...
+        //printf("underflow %d\n", ++count);
+    }
+
+    // Runs on the audio thread.
+    void decode()
+    {
+        constexpr int FRAME_BYTE_SIZE{gsl::narrow<int>(sizeof(float) * FRAME_SAMPLE_COUNT)};
+        // A sender without packets for this long has stopped, such as after leaving, and stops being waited for.
+        constexpr float STREAM_TIME_OUT_MS{KH_AUDIO_FRAME_MS * 10.0f};
+
+        soundio_flush_events(sound_io_.get());
+
+        const char* read_ptr{soundio_ring_buffer_read_ptr(opus_frame_ring_buffer_.get())};
+        const int fill_bytes{soundio_ring_buffer_fill_count(opus_frame_ring_buffer_.get())};
+        int cursor{0};
+        while (cursor < fill_bytes) {
+            OpusFrameRecordHeader header;
+            memcpy(&header, read_ptr + cursor, sizeof(header));
+            const auto opus_frame{reinterpret_cast<const std::byte*>(read_ptr + cursor + sizeof(header))};
+            auto& stream{streams_[header.sender_id]};
+            stream.jitter_buffer.add(header.frame_id, std::vector<std::byte>(opus_frame, opus_frame + header.opus_frame_size), header.arrival_ms);
+            stream.last_arrival_ms = header.arrival_ms;
+            cursor += sizeof(header) + header.opus_frame_size;
+        }
+        soundio_ring_buffer_advance_read_ptr(opus_frame_ring_buffer_.get(), cursor);
+
+        std::map<int, float> gains;
+        std::map<int, AudioFrameTimeStamp> time_stamp_anchors;
+        {
+            std::lock_guard<std::mutex> lock{shared_state_mutex_};
+            gains = gains_;
+            time_stamp_anchors = time_stamp_anchors_;
+        }
+
+        // Frames waiting to get mixed count as frames in the ring buffer for the jitter buffer of their sender.
+        const int ring_buffer_frame_count{soundio_ring_buffer_fill_count(sample_ring_buffer_.get()) / FRAME_BYTE_SIZE};
+        for (auto& [sender_id, stream] : streams_) {
+            while (const auto frame{stream.jitter_buffer.pop(ring_buffer_frame_count + gsl::narrow<int>(stream.decoded_frames.size()))}) {
+                // FEC decodes the frame before the packet, and concealment decodes without a packet.
+                auto& decoded_frame{stream.decoded_frames.emplace_back()};
+                decoded_frame.frame_id = frame->frame_id;
+                const int frame_size{tt::decode_opus(stream.opus_decoder, frame->opus_frame, decoded_frame.pcm.data(), KH_SAMPLES_PER_FRAME,
+                                                     frame->source == AudioFrameSource::ForwardErrorCorrection ? 1 : 0)};
+                if (frame_size < 0)
+                    throw std::runtime_error(std::string("Failed to decode audio: ") + opus_strerror(frame_size));
+                stream.started = true;
             }
+        }
+
+        const float now_ms{start_time_.elapsed_time().ms()};
+        std::map<int, std::pair<float, float>> playout_anchors;
+        while (soundio_ring_buffer_free_count(sample_ring_buffer_.get()) >= FRAME_BYTE_SIZE) {
+            const int queued_bytes{soundio_ring_buffer_fill_count(sample_ring_buffer_.get())};
 
-            //frame_size = opus_decoder_.decode(packet_it->opus_frame, pcm_.data(), KH_SAMPLES_PER_FRAME, 0);
-            frame_size = tt::decode_opus(opus_decoder_, packet_it->opus_frame, pcm_.data(), KH_SAMPLES_PER_FRAME, 0);
+            // A sender missing its frame gets waited for until the ring buffer is about to run out,
+            // when its jitter buffer has already recovered or concealed the frame if it could.
+            bool frame_found{false};
+            bool frame_awaited{false};
+            for (auto& [sender_id, stream] : streams_) {
+                if (!stream.decoded_frames.empty())
+                    frame_found = true;
+                else if (stream.started && now_ms - stream.last_arrival_ms < STREAM_TIME_OUT_MS)
+                    frame_awaited = true;
+            }
+            if (!frame_found || (frame_awaited && queued_bytes >= FRAME_BYTE_SIZE))
+                break;
 
-            if (frame_size < 0)
-                throw std::runtime_error(std::string("Failed to decode audio: ") + opus_strerror(frame_size));
+            std::fill(mix_.begin(), mix_.end(), 0.0f);
+            for (auto& [sender_id, stream] : streams_) {
+                if (stream.decoded_frames.empty())
+                    continue;
 
-            for (gsl::index i{0}; i < pcm_.size(); ++i)
-                pcm_[i] *= AMPLIFIER;
+                const auto& decoded_frame{stream.decoded_frames.front()};
+                auto gain_it{gains.find(sender_id)};
+                mix_audio_samples(decoded_frame.pcm, gain_it != gains.end() ? gain_it->second : KH_DEFAULT_AUDIO_GAIN, mix_);
 
-            memcpy(write_ptr + write_cursor, pcm_.data(), FRAME_BYTE_SIZE);
+                // The start of the frame plays after the samples before it in the ring buffer and in the buffer of the device.
+                auto time_stamp_anchor_it{time_stamp_anchors.find(sender_id)};
+                if (time_stamp_anchor_it != time_stamp_anchors.end()) {
+                    const auto& time_stamp_anchor{time_stamp_anchor_it->second};
+                    const float frame_time_stamp{time_stamp_anchor.time_stamp + (decoded_frame.frame_id - time_stamp_anchor.frame_id) * KH_AUDIO_FRAME_MS};
+                    const float queued_ms{queued_bytes * 1000.0f / KH_BYTES_PER_SECOND + device_latency_ms_};
+                    playout_anchors.insert_or_assign(sender_id, std::pair{now_ms, frame_time_stamp - KH_AUDIO_FRAME_MS - queued_ms});
+                }
+                stream.decoded_frames.pop_front();
+            }
+            limiter_.apply(mix_);
 
-            last_audio_frame_id_ = packet_it->frame_id;
-            ++packet_it;
-            write_cursor += FRAME_BYTE_SIZE;
+            memcpy(soundio_ring_buffer_write_ptr(sample_ring_buffer_.get()), mix_.data(), FRAME_BYTE_SIZE);
+            soundio_ring_buffer_advance_write_ptr(sample_ring_buffer_.get(), FRAME_BYTE_SIZE);
         }
 
-        soundio_ring_buffer_advance_write_ptr(ring_buffer, write_cursor);
+        std::lock_guard<std::mutex> lock{shared_state_mutex_};
+        for (auto it{streams_.begin()}; it != streams_.end();) {
+            jitter_buffer_stats_.insert_or_assign(it->first, it->second.jitter_buffer.stats());
+            // A stopped sender comes back as a new stream, whose jitter buffer starts over.
+            if (it->second.decoded_frames.empty() && now_ms - it->second.last_arrival_ms > STREAM_TIME_OUT_MS) {
+                it = streams_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto& [sender_id, playout_anchor] : playout_anchors)
+            playout_anchors_.insert_or_assign(sender_id, playout_anchor);
     }
 
-private:
     SoundIoHandle sound_io_;
+    SoundIoRingBufferHandle sample_ring_buffer_;
+    SoundIoRingBufferHandle opus_frame_ring_buffer_;
+    // Declared after the ring buffers, so it stops calling back before they get destroyed.
     SoundIoOutStreamHandle default_speaker_stream_;
 
-    tt::OpusDecoderHandle opus_decoder_;
-    std::array<float, KH_SAMPLES_PER_FRAME* KH_CHANNEL_COUNT> pcm_;
+    // How long samples written to the device take to play.
+    const float device_latency_ms_;
+    // Arrival times of packets for the jitter and the times of playout anchors are from this time.
+    const tt::TimePoint start_time_;
+
+    // Only for the audio thread.
+    // Streams by sender ID.
+    std::map<int, AudioStream> streams_;
+    std::array<float, FRAME_SAMPLE_COUNT> mix_;
+    AudioLimiter limiter_;
 
-    int last_audio_frame_id_;
+    // Guards the state between the main loop and the audio thread, whose maps are by sender ID.
+    mutable std::mutex shared_state_mutex_;
+    std::map<int, float> gains_;
+    // Copies of the stats of the jitter buffers for the main loop, which stay after their streams get removed.
+    std::map<int, AudioJitterBufferStats> jitter_buffer_stats_;
+    // The latest time stamps from the senders, which date the other frames by their frame IDs.
+    std::map<int, AudioFrameTimeStamp> time_stamp_anchors_;
+    // The time from start_time_ when a frame got mixed and the time stamp of the audio of the sender playing at the time.
+    std::map<int, std::pair<float, float>> playout_anchors_;
+    // Declared last, so the thread stops before the members it uses get destroyed.
+    std::optional<AudioThread> audio_thread_;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vpx/vp8dx.h>
+#include <vpx/vpx_decoder.h>
+#include "native/tt_native.h"
+#include "utils/extension_packets.h"
+#include "utils/tiled_color.h"
+#include "utils/worker_thread_pool.h"
+
+namespace kh
+{
+constexpr unsigned int KH_VP9_DECODER_THREAD_COUNT{4};
+
+class ColorDecoder
+{
+public:
+    virtual ~ColorDecoder() {}
+    virtual tt::YuvFrame decode(gsl::span<const std::byte> frame) = 0;
+};
+
+class Vp8ColorDecoder : public ColorDecoder
+{
+public:
+    Vp8ColorDecoder()
+        : decoder_{}
+    {
+    }
+
+    tt::YuvFrame decode(gsl::span<const std::byte> frame)
+    {
+        tt::AVFrameHandle av_frame{decoder_.decode(frame)};
+        return tt::YuvFrame::create(av_frame);
+    }
+
+private:
+    tt::Vp8Decoder decoder_;
+};
+
+// A VP9 decoder of libvpx.
+class Vp9ColorDecoder : public ColorDecoder
+{
+public:
+    Vp9ColorDecoder()
+        : codec_{}
+    {
+        vpx_codec_dec_cfg_t configuration{};
+        configuration.threads = KH_VP9_DECODER_THREAD_COUNT;
+        if (vpx_codec_dec_init(&codec_, vpx_codec_vp9_dx(), &configuration, 0) != VPX_CODEC_OK)
+            throw std::runtime_error("vpx_codec_dec_init() failed in Vp9ColorDecoder.");
+    }
+
+    ~Vp9ColorDecoder()
+    {
+        vpx_codec_destroy(&codec_);
+    }
+
+    Vp9ColorDecoder(const Vp9ColorDecoder&) = delete;
+    Vp9ColorDecoder& operator=(const Vp9ColorDecoder&) = delete;
+
+    tt::YuvFrame decode(gsl::span<const std::byte> frame)
+    {
+        if (vpx_codec_decode(&codec_, reinterpret_cast<const uint8_t*>(frame.data()), gsl::narrow<unsigned int>(frame.size()), nullptr, 0) != VPX_CODEC_OK)
+            throw std::runtime_error(std::string("vpx_codec_decode() failed in Vp9ColorDecoder: ") + vpx_codec_error(&codec_));
+
+        vpx_codec_iter_t iterator{nullptr};
+        const vpx_image_t* image{vpx_codec_get_frame(&codec_, &iterator)};
+        if (!image)
+            throw std::runtime_error("No frame from vpx_codec_get_frame() in Vp9ColorDecoder.");
+
+        const int width{gsl::narrow<int>(image->d_w)};
+        const int height{gsl::narrow<int>(image->d_h)};
+        return tt::YuvFrame{copy_plane(image, VPX_PLANE_Y, width, height),
+                            copy_plane(image, VPX_PLANE_U, width / 2, height / 2),
+                            copy_plane(image, VPX_PLANE_V, width / 2, height / 2),
+                            width, height};
+    }
+
+private:
+    // Planes of vpx_image_t have padding at the end of their rows.
+    static std::vector<uint8_t> copy_plane(const vpx_image_t* image, int plane, int width, int height)
+    {
+        std::vector<uint8_t> channel(width * height);
+        for (int row{0}; row < height; ++row)
+            memcpy(channel.data() + row * width, image->planes[plane] + row * image->stride[plane], width);
+        return channel;
+    }
+
+    vpx_codec_ctx_t codec_;
+};
+
+// Decodes the stripes of tiled color codecs in parallel and stacks them into a frame.
+// The decoders get created with the first frame since the number of stripes depends on the height of the frames.
+// A stripe failing to decode keeps its last picture when it has one, until a refresh or a keyframe repairs its decoder,
+// so a receiver skipping frames does not lose the other stripes.
+class TiledColorDecoder : public ColorDecoder
+{
+public:
+    TiledColorDecoder(ColorCodec stripe_codec)
+        : stripe_codec_{stripe_codec}
+        , decoders_{}
+        , stripe_yuv_frames_{}
+        , worker_thread_pool_{}
+    {
+    }
+
+    tt::YuvFrame decode(gsl::span<const std::byte> frame)
+    {
+        const auto tiled_color_frame{read_tiled_color_frame(frame)};
+        const auto& stripe_frames{tiled_color_frame.stripe_frames};
+        if (decoders_.empty()) {
+            for (size_t i{0}; i < stripe_frames.size(); ++i)
+                decoders_.push_back(create_stripe_decoder());
+            stripe_yuv_frames_.resize(stripe_frames.size());
+            worker_thread_pool_ = std::make_unique<WorkerThreadPool>(gsl::narrow<int>(stripe_frames.size()) - 1);
+        }
+
+        if (stripe_frames.size() != decoders_.size())
+            throw std::runtime_error("Stripe count mismatch in TiledColorDecoder::decode().");
+
+        worker_thread_pool_->run([&](int i) {
+            try {
+                stripe_yuv_frames_[i] = decoders_[i]->decode(stripe_frames[i]);
+            } catch (std::runtime_error&) {
+                if (!stripe_yuv_frames_[i])
+                    throw;
+            }
+        });
+
+        // The chroma planes of each stripe follow its luma rows since the stripes have even row counts.
+        const int width{stripe_yuv_frames_.front()->width()};
+        int height{0};
+        std::vector<uint8_t> y_channel;
+        std::vector<uint8_t> u_channel;
+        std::vector<uint8_t> v_channel;
+        for (auto& stripe_yuv_frame : stripe_yuv_frames_) {
+            if (stripe_yuv_frame->width() != width)
+                throw std::runtime_error("Stripe width mismatch in TiledColorDecoder::decode().");
+
+            height += stripe_yuv_frame->height();
+            y_channel.insert(y_channel.end(), stripe_yuv_frame->y_channel().begin(), stripe_yuv_frame->y_channel().end());
+            u_channel.insert(u_channel.end(), stripe_yuv_frame->u_channel().begin(), stripe_yuv_frame->u_channel().end());
+            v_channel.insert(v_channel.end(), stripe_yuv_frame->v_channel().begin(), stripe_yuv_frame->v_channel().end());
+        }
+        return tt::YuvFrame{std::move(y_channel), std::move(u_channel), std::move(v_channel), width, height};
+    }
+
+private:
+    std::unique_ptr<ColorDecoder> create_stripe_decoder()
+    {
+        if (stripe_codec_ == ColorCodec::Vp9)
+            return std::make_unique<Vp9ColorDecoder>();
+        return std::make_unique<Vp8ColorDecoder>();
+    }
+
+    ColorCodec stripe_codec_;
+    std::vector<std::unique_ptr<ColorDecoder>> decoders_;
+    std::vector<std::optional<tt::YuvFrame>> stripe_yuv_frames_;
+    std::unique_ptr<WorkerThreadPool> worker_thread_pool_;
+};
+
+inline std::unique_ptr<ColorDecoder> create_color_decoder(ColorCodec color_codec)
+{
+    switch (color_codec) {
+    case ColorCodec::Vp8:
+        return std::make_unique<Vp8ColorDecoder>();
+    case ColorCodec::Vp9:
+        return std::make_unique<Vp9ColorDecoder>();
+    case ColorCodec::TiledVp8:
+        return std::make_unique<TiledColorDecoder>(ColorCodec::Vp8);
+    case ColorCodec::TiledVp9:
+        return std::make_unique<TiledColorDecoder>(ColorCodec::Vp9);
+    }
+    throw std::runtime_error("Invalid ColorCodec in create_color_decoder().");
+}
+}
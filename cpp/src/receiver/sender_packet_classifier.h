@@ -1,36 +1,76 @@
 #pragma once
 
+#include <iostream>
+#include "utils/extension_packets.h"
+
 namespace kh
 {
 struct SenderPacketInfo
 {
-    bool received_any;
+    bool received_any{false};
     std::vector<tt::VideoSenderPacket> video_packets;
     std::vector<tt::ParitySenderPacket> parity_packets;
     std::vector<tt::AudioSenderPacket> audio_packets;
+    // Only from AudioBundle packets since audio packets from telepresence-toolkit have no time stamps.
+    std::vector<AudioFrameTimeStamp> audio_frame_time_stamps;
+    std::optional<MulticastGroupSenderPacket> multicast_group_packet;
+    std::optional<SessionInfo> session_info;
 };
 
 class SenderPacketClassifier
 {
 public:
-    static void classify(tt::UdpSocket& udp_socket, SenderPacketInfo& sender_packet_info)
+    // Can be called with multiple sockets (e.g., the one for the multicast group) to collect packets into one SenderPacketInfo.
+    // With sender_id, packets from other senders get ignored, which can happen with a multicast group shared by senders.
+    static void classify(tt::UdpSocket& udp_socket, SenderPacketInfo& sender_packet_info, std::optional<int> sender_id = std::nullopt)
     {
-        sender_packet_info.received_any = false;
         while (auto packet{udp_socket.receive(tt::KH_PACKET_SIZE)}) {
-            sender_packet_info.received_any = true;
-            switch (tt::get_packet_type_from_sender_packet_bytes(packet->bytes))
-            {
-            case tt::SenderPacketType::Heartbeat:
-                break;
-            case tt::SenderPacketType::Video:
-                sender_packet_info.video_packets.push_back(tt::read_video_sender_packet(packet->bytes));
-                break;
-            case tt::SenderPacketType::Parity:
-                sender_packet_info.parity_packets.push_back(tt::read_parity_sender_packet(packet->bytes));
-                break;
-            case tt::SenderPacketType::Audio:
-                sender_packet_info.audio_packets.push_back(tt::read_audio_sender_packet(packet->bytes));
-                break;
+            if (packet->bytes.size() < KH_PACKET_HEADER_SIZE) {
+                std::cout << "SenderPacketClassifier dropped a packet of " << packet->bytes.size() << " bytes.\n";
+                continue;
+            }
+
+            try {
+                if (sender_id) {
+                    size_t cursor{0};
+                    if (read_from_extension_packet_bytes<int>(packet->bytes, cursor) != *sender_id)
+                        continue;
+                }
+
+                sender_packet_info.received_any = true;
+                switch (tt::get_packet_type_from_sender_packet_bytes(packet->bytes))
+                {
+                case tt::SenderPacketType::Heartbeat:
+                    break;
+                case tt::SenderPacketType::Video:
+                    sender_packet_info.video_packets.push_back(tt::read_video_sender_packet(packet->bytes));
+                    break;
+                case tt::SenderPacketType::Parity:
+                    sender_packet_info.parity_packets.push_back(tt::read_parity_sender_packet(packet->bytes));
+                    break;
+                case tt::SenderPacketType::Audio:
+                    sender_packet_info.audio_packets.push_back(tt::read_audio_sender_packet(packet->bytes));
+                    break;
+                default:
+                    switch (get_extension_sender_packet_type(packet->bytes)) {
+                    case ExtensionSenderPacketType::MulticastGroup:
+                        sender_packet_info.multicast_group_packet = read_multicast_group_sender_packet(packet->bytes);
+                        break;
+                    case ExtensionSenderPacketType::SessionInfo:
+                        sender_packet_info.session_info = read_session_info_sender_packet(packet->bytes);
+                        break;
+                    case ExtensionSenderPacketType::AudioBundle: {
+                        auto audio_bundle_packet{read_audio_bundle_sender_packet(packet->bytes)};
+                        sender_packet_info.audio_frame_time_stamps.push_back(audio_bundle_packet.first_frame_time_stamp);
+                        for (auto& audio_packet : audio_bundle_packet.audio_packets)
+                            sender_packet_info.audio_packets.push_back(std::move(audio_packet));
+                        break;
+                    }
+                    }
+                    break;
+                }
+            } catch (const std::runtime_error& e) {
+                std::cout << "SenderPacketClassifier dropped a malformed packet: " << e.what() << "\n";
             }
         }
     }
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+namespace kh
+{
+struct VideoPresentationStats
+{
+    int rendered_frame_count{0};
+    // Frames rendered while audio with time stamps played, which have their A/V offsets measured.
+    int synchronized_frame_count{0};
+    // Offsets are positive for video ahead of audio.
+    float offset_ms_sum{0.0f};
+    float max_abs_offset_ms{0.0f};
+    // Loop iterations a frame got held for the audio to catch up with it.
+    int held_count{0};
+};
+
+// Aligns rendering video frames to the audio playout of AudioReceiver, with both on the clock of the sender.
+// Video frames only wait for the network while audio also waits for the jitter buffer and the speaker,
+// so frames ahead of the audio get held until the audio catches up with them.
+// Frames behind the audio get rendered right away since holding them only delays them further.
+// Without audio playout time stamps, such as from senders without the extensions, frames get rendered right away.
+class VideoPresentationScheduler
+{
+public:
+    VideoPresentationScheduler()
+        : stats_{}
+    {
+    }
+
+    const VideoPresentationStats& stats() const { return stats_; }
+
+    // Whether to render a frame with frame_time_stamp now.
+    bool is_due(float frame_time_stamp, std::optional<float> audio_playout_time_stamp)
+    {
+        // Video less than half a frame ahead of the audio is as close as holding it gets.
+        constexpr float HOLD_TOLERANCE_MS{1000.0f / 30.0f / 2.0f};
+        // Video this far ahead is from the sender clocks of audio and video disagreeing, such as after a restart of the sender,
+        // instead of buffering, and holding it would freeze the video.
+        constexpr float MAX_HOLD_MS{1000.0f};
+
+        if (!audio_playout_time_stamp)
+            return true;
+
+        const float offset_ms{frame_time_stamp - *audio_playout_time_stamp};
+        if (offset_ms <= HOLD_TOLERANCE_MS || offset_ms > MAX_HOLD_MS)
+            return true;
+
+        ++stats_.held_count;
+        return false;
+    }
+
+    // Measures the A/V offset of a frame getting rendered.
+    void add_rendered_frame(float frame_time_stamp, std::optional<float> audio_playout_time_stamp)
+    {
+        ++stats_.rendered_frame_count;
+        if (!audio_playout_time_stamp)
+            return;
+
+        const float offset_ms{frame_time_stamp - *audio_playout_time_stamp};
+        ++stats_.synchronized_frame_count;
+        stats_.offset_ms_sum += offset_ms;
+        stats_.max_abs_offset_ms = std::max(stats_.max_abs_offset_ms, std::abs(offset_ms));
+    }
+
+private:
+    VideoPresentationStats stats_;
+};
+}
@@ -2,6 +2,7 @@
 
 #include <map>
 #include "native/tt_native.h"
+#include "utils/compact_video_message.h"
 
 namespace kh
 {
@@ -195,7 +196,8 @@ struct FrameParitySet
     }
 
     // Build a message with a Correct set.
-    std::unique_ptr<tt::VideoSenderMessage> build()
+    // session_info is for compact messages, and a compact message without its SessionInfo builds nullptr.
+    std::unique_ptr<VideoMessage> build(const std::optional<SessionInfo>& session_info)
     {
         if (getState() != State::Correct)
             throw std::runtime_error("FrameParitySet::build() called while set's state is not Correct.");
@@ -207,7 +209,11 @@ struct FrameParitySet
             }
         }
 
-        return std::make_unique<tt::VideoSenderMessage>(tt::read_video_sender_message(merge_video_sender_packets(video_packet_ptrs)));
+        auto video_message{read_video_message(merge_video_sender_packets(video_packet_ptrs), session_info)};
+        if (!video_message)
+            return nullptr;
+
+        return std::make_unique<VideoMessage>(std::move(*video_message));
     }
 
     // Assumes there is at least one packet.
@@ -315,15 +321,20 @@ public:
     }
 
     // Add video messages as much as possible to the queue.
-    void build(std::map<int, std::shared_ptr<tt::VideoSenderMessage>>& video_messages)
+    void build(std::map<int, std::shared_ptr<VideoMessage>>& video_messages,
+               const std::optional<SessionInfo>& session_info)
     {
         for (auto& [frame_id, frame_parity_set] : frame_parity_sets_) {
             auto set_state{frame_parity_set.getState()};
             if (set_state == FrameParitySet::State::Correctable)
                 frame_parity_set.correct();
 
-            if (frame_parity_set.getState() != FrameParitySet::State::Incorrect)
-                video_messages.insert({frame_id, frame_parity_set.build()});
+            if (frame_parity_set.getState() == FrameParitySet::State::Incorrect)
+                continue;
+
+            // Frames of compact messages arriving before their SessionInfo stay until it arrives.
+            if (auto video_message{frame_parity_set.build(session_info)})
+                video_messages.insert({frame_id, std::move(video_message)});
         }
     }
 
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "win32/opencv_utils.h"
+#include "receiver/color_decoder.h"
+#include "utils/depth_quantizer.h"
+#include "utils/extension_packets.h"
+#include "utils/tiled_trvl.h"
 
 namespace kh
 {
@@ -10,17 +14,35 @@ public:
     VideoRenderer(int width, int height)
         : width_{width}
         , height_{height}
-        , color_decoder_{}
+        , color_decoder_{create_color_decoder(ColorCodec::Vp8)}
+        , last_color_codec_{ColorCodec::Vp8}
         , depth_decoder_{width * height}
+        , tiled_depth_decoder_{width, height}
+        , depth_quantizer_{}
     {
     }
 
-    void render(std::vector<std::byte>& color_encoder_frame, std::vector<std::byte>& depth_encoder_frame, bool keyframe)
+    void render(std::vector<std::byte>& color_encoder_frame,
+                std::vector<std::byte>& depth_encoder_frame,
+                ColorCodec color_codec,
+                DepthCodec depth_codec,
+                DepthQuantization depth_quantization,
+                bool keyframe)
     {
-        tt::AVFrameHandle av_frame{color_decoder_.decode(color_encoder_frame)};
-        std::vector<int16_t> trvl_frame{depth_decoder_.decode(depth_encoder_frame, keyframe)};
+        // A frame with a different color codec than the previous one is a keyframe.
+        if (color_codec != last_color_codec_) {
+            color_decoder_ = create_color_decoder(color_codec);
+            last_color_codec_ = color_codec;
+        }
 
-        auto color_mat{create_cv_mat_from_yuv_image(tt::YuvFrame::create(av_frame))};
+        const auto yuv_image{color_decoder_->decode(color_encoder_frame)};
+        std::vector<int16_t> trvl_frame{depth_codec == DepthCodec::Trvl ? depth_decoder_.decode(depth_encoder_frame, keyframe)
+                                                                        : tiled_depth_decoder_.decode(depth_encoder_frame, keyframe, depth_codec == DepthCodec::TiledTrvlZstd)};
+        // Dequantizing after TRVL decoding since TRVL decoders keep their previous frames in codes.
+        if (depth_quantization != DepthQuantization::None)
+            depth_quantizer_.dequantize(trvl_frame);
+
+        auto color_mat{create_cv_mat_from_yuv_image(yuv_image)};
         auto depth_mat{create_cv_mat_from_kinect_depth_image(trvl_frame.data(), width_, height_)};
 
         // Rendering the depth pixels.
@@ -33,8 +55,11 @@ public:
 private:
     int width_;
     int height_;
-    tt::Vp8Decoder color_decoder_;
+    std::unique_ptr<ColorDecoder> color_decoder_;
+    ColorCodec last_color_codec_;
     tt::TrvlDecoder depth_decoder_;
+    TiledTrvlDecoder tiled_depth_decoder_;
+    DepthQuantizer depth_quantizer_;
     std::optional<int> last_frame_id_;
 };
 }
\ No newline at end of file
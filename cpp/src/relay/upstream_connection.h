@@ -0,0 +1,237 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include "native/tt_native.h"
+#include "native/profiler.h"
+#include "sender/retransmission_scheduler.h"
+#include "sender/video_sender_storage.h"
+#include "utils/compact_video_message.h"
+#include "utils/tiled_color.h"
+#include "utils/tiled_trvl.h"
+
+namespace kh
+{
+// The side of a relay facing its upstream sender, where the relay acts as a receiver.
+// Reports and requests from the downstream receivers get collapsed into a single stream,
+// so the upstream sender sees a relay as one receiver regardless of the number of receivers behind it.
+class UpstreamConnection
+{
+public:
+    UpstreamConnection(int receiver_id, asio::ip::udp::endpoint sender_endpoint)
+        : receiver_id_{receiver_id}
+        , sender_endpoint_{sender_endpoint}
+        , sender_id_{std::nullopt}
+        , reported_frame_id_{std::nullopt}
+        , requests_{}
+        , requested_frame_ids_{}
+        , last_heartbeat_time_{tt::TimePoint::now()}
+        , last_request_time_{tt::TimePoint::now()}
+        , session_info_acknowledged_{false}
+        , last_session_info_ack_time_{tt::TimePoint::now()}
+        , last_session_info_withdrawal_time_{tt::TimePoint::now()}
+        , keyframe_requested_{false}
+        , keyframe_request_frame_id_{std::nullopt}
+        , last_keyframe_request_time_{tt::TimePoint::now()}
+    {
+    }
+
+    // Known after the upstream sender confirms the connect packet.
+    std::optional<int> sender_id() { return sender_id_; }
+
+    void connect(tt::UdpSocket& udp_socket)
+    {
+        udp_socket.send(tt::create_connect_receiver_packet(receiver_id_, true, true).bytes, sender_endpoint_);
+    }
+
+    void confirm(const tt::ConfirmSenderPacket& confirm_packet)
+    {
+        if (confirm_packet.receiver_id == receiver_id_)
+            sender_id_ = confirm_packet.sender_id;
+    }
+
+    // Sends a connect packet instead of a heartbeat packet until getting confirmed
+    // since a lost connect packet would leave the relay without frames.
+    void send_heartbeat(tt::UdpSocket& udp_socket, float heartbeat_interval_sec)
+    {
+        if (last_heartbeat_time_.elapsed_time().sec() < heartbeat_interval_sec)
+            return;
+
+        if (sender_id_) {
+            udp_socket.send(tt::create_heartbeat_receiver_packet(receiver_id_).bytes, sender_endpoint_);
+        } else {
+            connect(udp_socket);
+        }
+        last_heartbeat_time_ = tt::TimePoint::now();
+    }
+
+    // For a downstream receiver to start with. The request gets resent by resend_keyframe_request()
+    // until a frame a new receiver can start from arrives, which either is a keyframe,
+    // or, with intra refresh of both codecs, comes after a frame refreshing each stripe.
+    void request_keyframe(tt::UdpSocket& udp_socket, std::optional<int> upstream_frame_id)
+    {
+        udp_socket.send(create_keyframe_request_receiver_packet_bytes(receiver_id_), sender_endpoint_);
+        keyframe_requested_ = true;
+        keyframe_request_frame_id_ = upstream_frame_id;
+        last_keyframe_request_time_ = tt::TimePoint::now();
+    }
+
+    bool keyframe_requested() const { return keyframe_requested_; }
+
+    void resend_keyframe_request(tt::UdpSocket& udp_socket, float request_interval_sec)
+    {
+        if (!keyframe_requested_ || last_keyframe_request_time_.elapsed_time().sec() < request_interval_sec)
+            return;
+
+        udp_socket.send(create_keyframe_request_receiver_packet_bytes(receiver_id_), sender_endpoint_);
+        last_keyframe_request_time_ = tt::TimePoint::now();
+    }
+
+    // Called with the messages of frames that got all their video packets while a keyframe is requested.
+    void receive_video_message(int frame_id, const VideoMessage& video_message)
+    {
+        constexpr int REFRESH_CYCLE_FRAME_COUNT{std::max(KH_TILED_TRVL_STRIPE_COUNT, KH_TILED_COLOR_STRIPE_COUNT)};
+
+        if (!keyframe_requested_)
+            return;
+
+        if (!keyframe_request_frame_id_)
+            keyframe_request_frame_id_ = frame_id;
+        if (frame_id <= *keyframe_request_frame_id_)
+            return;
+
+        const bool intra_refreshed{is_intra_refreshed(video_message.color_codec, video_message.depth_codec, video_message.intra_refresh)};
+        if (video_message.sender_message.keyframe || (intra_refreshed && frame_id - *keyframe_request_frame_id_ >= REFRESH_CYCLE_FRAME_COUNT))
+            keyframe_requested_ = false;
+    }
+
+    // Acknowledging the SessionInfo makes the upstream sender send compact video messages, which leave the SessionInfo out,
+    // so the relay only acknowledges while supported_downstream, which is when every downstream receiver of video has the SessionInfo.
+    // The sender resends its SessionInfo until acknowledged, and each one gets acknowledged while supported.
+    // Once not, e.g., after a receiver without the extensions joined, the relay withdraws the acknowledgement
+    // with one of KH_WITHDRAWN_SESSION_INFO_VERSION every heartbeat until the sender resends its SessionInfo again.
+    void update_session_info_acknowledgement(tt::UdpSocket& udp_socket,
+                                             const std::optional<SessionInfo>& received_session_info,
+                                             bool supported_downstream,
+                                             float heartbeat_interval_sec)
+    {
+        if (received_session_info) {
+            if (supported_downstream) {
+                udp_socket.send(create_session_info_ack_receiver_packet_bytes(receiver_id_, received_session_info->version), sender_endpoint_);
+                session_info_acknowledged_ = true;
+                last_session_info_ack_time_ = tt::TimePoint::now();
+                return;
+            }
+
+            // A SessionInfo sent before the acknowledgement reached the sender does not mean the sender stopped counting it.
+            if (last_session_info_ack_time_.elapsed_time().sec() > heartbeat_interval_sec)
+                session_info_acknowledged_ = false;
+        }
+
+        if (supported_downstream || !session_info_acknowledged_)
+            return;
+        if (last_session_info_withdrawal_time_.elapsed_time().sec() < heartbeat_interval_sec)
+            return;
+
+        udp_socket.send(create_session_info_ack_receiver_packet_bytes(receiver_id_, KH_WITHDRAWN_SESSION_INFO_VERSION), sender_endpoint_);
+        last_session_info_withdrawal_time_ = tt::TimePoint::now();
+    }
+
+    // Whether packets of the frame got requested again for downstream receivers,
+    // whose RetransmissionSchedulers send them instead of the relay forwarding them to every receiver.
+    bool requested(int frame_id) const
+    {
+        return requested_frame_ids_.find(frame_id) != requested_frame_ids_.end();
+    }
+
+    // Only frame IDs moving forward get reported since the upstream sender ignores the others.
+    void report(tt::UdpSocket& udp_socket, int frame_id)
+    {
+        if (reported_frame_id_ && frame_id <= *reported_frame_id_)
+            return;
+
+        udp_socket.send(tt::create_report_receiver_packet(receiver_id_, frame_id).bytes, sender_endpoint_);
+        reported_frame_id_ = frame_id;
+        requested_frame_ids_.erase(requested_frame_ids_.begin(), requested_frame_ids_.upper_bound(frame_id));
+    }
+
+    // Collects packets that a downstream receiver requested but the relay does not have.
+    void add_requests(const std::vector<tt::RequestReceiverPacket>& request_packets,
+                      VideoSenderStorage& video_sender_storage)
+    {
+        for (auto& request_packet : request_packets) {
+            // The upstream sender does not keep frames the relay already reported.
+            if (reported_frame_id_ && request_packet.frame_id <= *reported_frame_id_)
+                continue;
+
+            auto video_frame_packets_it{video_sender_storage.find(request_packet.frame_id)};
+            if (video_frame_packets_it == video_sender_storage.end()) {
+                requests_[request_packet.frame_id].all_packets = true;
+                continue;
+            }
+
+            auto& video_frame_packets{video_frame_packets_it->second};
+            for (int i{0}; i < video_frame_packets.video_packets.size(); ++i) {
+                if (!video_frame_packets.video_packets[i].bytes.empty())
+                    continue;
+                if (!request_packet.all_packets && !contains(request_packet.video_packet_indices, i))
+                    continue;
+
+                requests_[request_packet.frame_id].video_packet_indices.insert(i);
+            }
+            for (int i{0}; i < video_frame_packets.parity_packets.size(); ++i) {
+                if (!video_frame_packets.parity_packets[i].bytes.empty())
+                    continue;
+                if (!request_packet.all_packets && !contains(request_packet.parity_packet_indices, i))
+                    continue;
+
+                requests_[request_packet.frame_id].parity_packet_indices.insert(i);
+            }
+        }
+    }
+
+    // Sends the collected requests at most once per request_interval_sec,
+    // so downstream receivers missing the same packets cause only one request.
+    void send_requests(tt::UdpSocket& udp_socket, float request_interval_sec, tt::Profiler& profiler)
+    {
+        if (requests_.empty() || last_request_time_.elapsed_time().sec() < request_interval_sec)
+            return;
+
+        for (auto& [frame_id, request] : requests_) {
+            const std::vector<int> video_packet_indices(request.video_packet_indices.begin(), request.video_packet_indices.end());
+            const std::vector<int> parity_packet_indices(request.parity_packet_indices.begin(), request.parity_packet_indices.end());
+            udp_socket.send(tt::create_request_receiver_packet(receiver_id_, frame_id, request.all_packets,
+                                                               video_packet_indices, parity_packet_indices).bytes, sender_endpoint_);
+            profiler.addNumber("relay-upstream-request", 1);
+            requested_frame_ids_.insert(frame_id);
+        }
+        requests_.clear();
+        last_request_time_ = tt::TimePoint::now();
+    }
+
+private:
+    static bool contains(const std::vector<int>& indices, int index)
+    {
+        return std::find(indices.begin(), indices.end(), index) != indices.end();
+    }
+
+    const int receiver_id_;
+    const asio::ip::udp::endpoint sender_endpoint_;
+    std::optional<int> sender_id_;
+    std::optional<int> reported_frame_id_;
+    // Key is frame ID.
+    std::map<int, RetransmissionRequest> requests_;
+    // Frames with requests sent and not reported yet.
+    std::set<int> requested_frame_ids_;
+    tt::TimePoint last_heartbeat_time_;
+    tt::TimePoint last_request_time_;
+    // Whether the upstream sender may be counting an acknowledgement from the relay.
+    bool session_info_acknowledged_;
+    tt::TimePoint last_session_info_ack_time_;
+    tt::TimePoint last_session_info_withdrawal_time_;
+    bool keyframe_requested_;
+    // The newest frame when the keyframe got requested, which the frame to start from should come after.
+    std::optional<int> keyframe_request_frame_id_;
+    tt::TimePoint last_keyframe_request_time_;
+};
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <iostream>
+#include "native/tt_native.h"
+#include "utils/extension_packets.h"
+
+namespace kh
+{
+// A video or parity packet from the upstream sender.
+// Its bytes are kept as they are to get forwarded without creating the packet again.
+struct UpstreamVideoPacket
+{
+    int frame_id;
+    int packet_index;
+    int video_packet_count;
+    tt::Packet packet;
+};
+
+struct UpstreamPacketInfo
+{
+    bool received_any{false};
+    std::optional<tt::ConfirmSenderPacket> confirm_packet;
+    std::vector<UpstreamVideoPacket> video_packets;
+    std::vector<UpstreamVideoPacket> parity_packets;
+    std::vector<tt::Packet> audio_packets;
+    std::vector<tt::Packet> audio_bundle_packets;
+    std::optional<SessionInfo> session_info;
+};
+
+class UpstreamPacketClassifier
+{
+public:
+    static void classify(tt::UdpSocket& udp_socket, UpstreamPacketInfo& upstream_packet_info)
+    {
+        while (auto packet{udp_socket.receive(tt::KH_PACKET_SIZE)}) {
+            if (packet->bytes.size() < KH_PACKET_HEADER_SIZE) {
+                std::cout << "UpstreamPacketClassifier dropped a packet of " << packet->bytes.size() << " bytes.\n";
+                continue;
+            }
+
+            try {
+                upstream_packet_info.received_any = true;
+                switch (tt::get_packet_type_from_sender_packet_bytes(packet->bytes))
+                {
+                case tt::SenderPacketType::Confirm:
+                    upstream_packet_info.confirm_packet = tt::read_confirm_sender_packet(packet->bytes);
+                    break;
+                case tt::SenderPacketType::Heartbeat:
+                    break;
+                case tt::SenderPacketType::Video: {
+                    auto video_packet{tt::read_video_sender_packet(packet->bytes)};
+                    upstream_packet_info.video_packets.push_back(UpstreamVideoPacket{video_packet.frame_id,
+                                                                                     video_packet.packet_index,
+                                                                                     video_packet.packet_count,
+                                                                                     to_packet(std::move(packet->bytes))});
+                    break;
+                }
+                case tt::SenderPacketType::Parity: {
+                    auto parity_packet{tt::read_parity_sender_packet(packet->bytes)};
+                    upstream_packet_info.parity_packets.push_back(UpstreamVideoPacket{parity_packet.frame_id,
+                                                                                      parity_packet.packet_index,
+                                                                                      parity_packet.video_packet_count,
+                                                                                      to_packet(std::move(packet->bytes))});
+                    break;
+                }
+                case tt::SenderPacketType::Audio:
+                    upstream_packet_info.audio_packets.push_back(to_packet(std::move(packet->bytes)));
+                    break;
+                // MulticastGroup packets are not for relays since they do not request them.
+                default:
+                    switch (get_extension_sender_packet_type(packet->bytes)) {
+                    case ExtensionSenderPacketType::SessionInfo:
+                        upstream_packet_info.session_info = read_session_info_sender_packet(packet->bytes);
+                        break;
+                    case ExtensionSenderPacketType::AudioBundle:
+                        upstream_packet_info.audio_bundle_packets.push_back(to_packet(std::move(packet->bytes)));
+                        break;
+                    }
+                    break;
+                }
+            } catch (const std::runtime_error& e) {
+                std::cout << "UpstreamPacketClassifier dropped a malformed packet: " << e.what() << "\n";
+            }
+        }
+    }
+
+private:
+    static tt::Packet to_packet(std::vector<std::byte>&& bytes)
+    {
+        tt::Packet packet{0};
+        packet.bytes = std::move(bytes);
+        return packet;
+    }
+};
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <optional>
+#include "utils/extension_packets.h"
+
+namespace kh
+{
+// Gives each encoded audio frame its frame ID and collects the frames into AudioBundle packets,
+// so frames get serialized once for every receiver instead of once per receiver.
+// A bundle gets completed when it has bundle_frame_count frames or the next frame would not fit in a packet.
+class AudioBundler
+{
+public:
+    AudioBundler(int sender_id, int bundle_frame_count)
+        : sender_id_{sender_id}
+        , bundle_frame_count_{bundle_frame_count}
+        , next_frame_id_{0}
+        , building_frame_count_{0}
+        , building_bytes_{}
+        , completed_bytes_{}
+        , completed_{false}
+    {
+        if (bundle_frame_count < 1 || bundle_frame_count > KH_MAX_AUDIO_BUNDLE_FRAME_COUNT)
+            throw std::runtime_error("Invalid bundle_frame_count for AudioBundler.");
+
+        building_bytes_.reserve(tt::KH_PACKET_SIZE);
+        completed_bytes_.reserve(tt::KH_PACKET_SIZE);
+    }
+
+    int bundle_frame_count() const { return bundle_frame_count_; }
+
+    // Adds the frame after the last one and returns its frame ID.
+    // time_stamp is when the last sample of the frame got captured, in milliseconds from the start of the session.
+    int add(gsl::span<const std::byte> opus_frame, float time_stamp)
+    {
+        constexpr size_t FRAME_SIZE_BYTE_COUNT{sizeof(int32_t)};
+
+        completed_ = false;
+        if (building_frame_count_ > 0 && building_bytes_.size() + FRAME_SIZE_BYTE_COUNT + opus_frame.size() > tt::KH_PACKET_SIZE)
+            complete();
+
+        const int frame_id{next_frame_id_++};
+        if (building_frame_count_ == 0)
+            begin_audio_bundle_sender_packet_bytes(building_bytes_, AudioFrameTimeStamp{sender_id_, frame_id, time_stamp});
+        append_to_audio_bundle_sender_packet_bytes(building_bytes_, opus_frame);
+
+        if (++building_frame_count_ == bundle_frame_count_)
+            complete();
+
+        return frame_id;
+    }
+
+    // The bundle completed by the last add(), which stays valid until the next add().
+    // An add() completes at most one bundle since a frame not fitting in a bundle starts a new one.
+    std::optional<gsl::span<const std::byte>> completed_bundle() const
+    {
+        if (!completed_)
+            return std::nullopt;
+        return gsl::span<const std::byte>{completed_bytes_};
+    }
+
+private:
+    // Swapping keeps the capacity of both vectors, so bundles get built without allocations.
+    void complete()
+    {
+        std::swap(building_bytes_, completed_bytes_);
+        building_frame_count_ = 0;
+        completed_ = true;
+    }
+
+    const int sender_id_;
+    const int bundle_frame_count_;
+    int next_frame_id_;
+    int building_frame_count_;
+    std::vector<std::byte> building_bytes_;
+    std::vector<std::byte> completed_bytes_;
+    bool completed_;
+};
+}
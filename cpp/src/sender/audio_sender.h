@@ -1,86 +1,185 @@
 #pragma once
 
-#include "sender/remote_receiver.h"
+#include <optional>
+#include "sender/audio_bundler.h"
+#include "sender/remote_receiver_registry.h"
 #include "native/tt_native.h"
+#include "win32/audio_thread.h"
 #include "win32/soundio_utils.h"
 
 namespace kh
 {
-static SoundIoRingBuffer* ring_buffer{nullptr};
-
-void read_callback(SoundIoInStream* instream, int frame_count_min, int frame_count_max)
-{
-    // Using KH_CHANNEL_COUNT (i.e., 2) to pick the first two channels of the Azure Kinect microphone.
-    // Use (instream->bytes_per_frame / instream->bytes_per_sample) as channel_count for full usage of channels.
-    write_instream_to_buffer(instream, frame_count_min, frame_count_max, ring_buffer, KH_CHANNEL_COUNT);
-}
-
-void overflow_callback(struct SoundIoInStream* instream) {
-    static int count = 0;
-    printf("overflow %d\n", ++count);
-}
-
 // The instance of this class uses soundio to access Kinect's microphone.
-// Code below looks ugly because soundio requires its callback functions to be
-// c-style functions, not a member function, and this class is trying to
-// cover the discrepancy inside here.
+// The read callback of soundio writes samples into the sample ring buffer of the instance, which it finds through
+// the userdata of the stream, and the audio thread of the instance encodes them into the Opus frame ring buffer,
+// which send() empties from the main loop. Both ring buffers are lock-free queues of soundio
+// with a single reader and a single writer, so the callback never waits for the other threads
+// and a stall of the main loop only delays sending frames, which the capture-to-send latency of the send summary shows.
+// Each frame gets its frame ID from an AudioBundler, whose bundles reach receivers with the extensions of this repository.
+// Other receivers (e.g., KHViewer) get a packet from telepresence-toolkit per frame.
+// With bundle_frame_count above one, a bundle carries that many frames, which lowers the packet rate on lossy links
+// at the cost of delaying frames by up to (bundle_frame_count - 1) frames.
+// Bundles carry capture times from session_start_time, the clock of video frame time stamps, for receivers to synchronize them.
 class AudioSender
 {
 public:
-    AudioSender(const int sender_id)
+    AudioSender(const int sender_id, const int bundle_frame_count, const tt::TimePoint session_start_time)
         : sender_id_{sender_id}
         , sound_io_{create_sound_io_handle()}
-        , kinect_microphone_stream_{create_kinect_microphone_stream(sound_io_, read_callback, overflow_callback)}
+        , sample_ring_buffer_{create_sound_io_ring_buffer(sound_io_, gsl::narrow<int>(KH_LATENCY_SECONDS * 2 * KH_BYTES_PER_SECOND))}
+        , opus_frame_ring_buffer_{create_sound_io_ring_buffer(sound_io_, OPUS_FRAME_RING_BUFFER_CAPACITY)}
+        , kinect_microphone_stream_{create_kinect_microphone_stream(sound_io_, read_callback, overflow_callback, this)}
         , opus_encoder_{tt::create_opus_encoder_handle(KH_SAMPLE_RATE, KH_CHANNEL_COUNT)}
+        , start_time_{session_start_time}
         , pcm_{}
-        , audio_frame_id_{0}
+        , bundler_{sender_id, bundle_frame_count}
+        , dropped_frame_count_{0}
+        , audio_thread_{}
     {
-        constexpr int capacity{gsl::narrow<int>(KH_LATENCY_SECONDS * 2 * KH_BYTES_PER_SECOND)};
-        ring_buffer = soundio_ring_buffer_create(sound_io_.get(), capacity);
-        if (!ring_buffer)
-            throw std::runtime_error("Failed in soundio_ring_buffer_create()...");
+        // In-band FEC lets the AudioJitterBuffer of receivers recover a lost frame from the packet after it.
+        // Opus only spends bits on FEC when it expects loss.
+        constexpr int EXPECTED_PACKET_LOSS_PERCENT{10};
+        opus_encoder_ctl(opus_encoder_.get(), OPUS_SET_INBAND_FEC(1));
+        opus_encoder_ctl(opus_encoder_.get(), OPUS_SET_PACKET_LOSS_PERC(EXPECTED_PACKET_LOSS_PERCENT));
 
         if (int error = soundio_instream_start(kinect_microphone_stream_.get()))
             throw std::runtime_error(std::string("Failed to start AudioInStream: ") + std::to_string(error));
+
+        audio_thread_.emplace([this] { encode(); }, AUDIO_THREAD_INTERVAL);
     }
 
-    void send(tt::UdpSocket& udp_socket, std::map<int, RemoteReceiver>& remote_receivers)
+    void send(tt::UdpSocket& udp_socket, RemoteReceiverRegistry& remote_receivers, tt::Profiler& profiler)
     {
-        soundio_flush_events(sound_io_.get());
-        const char* read_ptr{soundio_ring_buffer_read_ptr(ring_buffer)};
-        const int fill_bytes{soundio_ring_buffer_fill_count(ring_buffer)};
+        audio_thread_->rethrow_if_failed();
+
+        const float send_ms{start_time_.elapsed_time().ms()};
+        const char* read_ptr{soundio_ring_buffer_read_ptr(opus_frame_ring_buffer_.get())};
+        const int fill_bytes{soundio_ring_buffer_fill_count(opus_frame_ring_buffer_.get())};
+
+        int cursor{0};
+        while (cursor < fill_bytes) {
+            OpusFrameRecordHeader header;
+            memcpy(&header, read_ptr + cursor, sizeof(header));
+            const gsl::span<const std::byte> opus_frame{reinterpret_cast<const std::byte*>(read_ptr + cursor + sizeof(header)),
+                                                        gsl::narrow<size_t>(header.opus_frame_size)};
+            cursor += sizeof(header) + header.opus_frame_size;
+
+            const int frame_id{bundler_.add(opus_frame, header.capture_ms)};
+
+            // Serialized once per frame only while a receiver without the extensions requests audio.
+            std::optional<tt::Packet> audio_packet;
+            for (auto& remote_receiver : remote_receivers) {
+                if (!remote_receiver.audio_requested || remote_receiver.session_info_version)
+                    continue;
+                if (!audio_packet)
+                    audio_packet = tt::create_audio_sender_packet(sender_id_, frame_id, opus_frame);
+                udp_socket.send(audio_packet->bytes, remote_receiver.endpoint);
+                profiler.addNumber("send-audio-packet", 1);
+                profiler.addNumber("send-audio-byte", audio_packet->bytes.size());
+            }
+
+            if (const auto bundle{bundler_.completed_bundle()}) {
+                for (auto& remote_receiver : remote_receivers) {
+                    if (!remote_receiver.audio_requested || !remote_receiver.session_info_version)
+                        continue;
+                    udp_socket.send(*bundle, remote_receiver.endpoint);
+                    profiler.addNumber("send-audio-packet", 1);
+                    profiler.addNumber("send-audio-byte", bundle->size());
+                }
+            }
+            profiler.addNumber("send-audio-frame", 1);
+            profiler.addNumber("send-audio-latency", send_ms - header.capture_ms);
+        }
+
+        soundio_ring_buffer_advance_read_ptr(opus_frame_ring_buffer_.get(), cursor);
+        profiler.addNumber("send-audio-dropped", dropped_frame_count_.exchange(0));
+    }
+
+private:
+    // Each Opus frame in the Opus frame ring buffer follows this header.
+    struct OpusFrameRecordHeader
+    {
+        // When the last sample of the frame got captured, in milliseconds from start_time_.
+        float capture_ms;
+        int opus_frame_size;
+    };
 
+    static constexpr int MAX_OPUS_FRAME_RECORD_SIZE{sizeof(OpusFrameRecordHeader) + tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE};
+    // A second of Opus frames of the largest size.
+    static constexpr int OPUS_FRAME_RING_BUFFER_CAPACITY{MAX_OPUS_FRAME_RECORD_SIZE * 50};
+    static constexpr std::chrono::milliseconds AUDIO_THREAD_INTERVAL{5};
+
+    static void read_callback(SoundIoInStream* instream, int frame_count_min, int frame_count_max)
+    {
+        // Using KH_CHANNEL_COUNT (i.e., 2) to pick the first two channels of the Azure Kinect microphone.
+        // Use (instream->bytes_per_frame / instream->bytes_per_sample) as channel_count for full usage of channels.
+        auto audio_sender{static_cast<AudioSender*>(instream->userdata)};
+        write_instream_to_buffer(instream, frame_count_min, frame_count_max, audio_sender->sample_ring_buffer_.get(), KH_CHANNEL_COUNT);
+    }
+
+    static void overflow_callback(struct SoundIoInStream* instream)
+    {
+        static int count = 0;
+        printf("overflow %d\n", ++count);
+    }
+
+    // Runs on the audio thread.
+    void encode()
+    {
         constexpr int BYTES_PER_FRAME{gsl::narrow<int>(sizeof(float) * KH_SAMPLES_PER_FRAME * KH_CHANNEL_COUNT)};
-        int cursor = 0;
+
+        soundio_flush_events(sound_io_.get());
+
+        const float read_ms{start_time_.elapsed_time().ms()};
+        const char* read_ptr{soundio_ring_buffer_read_ptr(sample_ring_buffer_.get())};
+        const int fill_bytes{soundio_ring_buffer_fill_count(sample_ring_buffer_.get())};
+
+        int cursor{0};
         while ((fill_bytes - cursor) >= BYTES_PER_FRAME) {
             memcpy(pcm_.data(), read_ptr + cursor, BYTES_PER_FRAME);
+            cursor += BYTES_PER_FRAME;
 
-            std::vector<std::byte> opus_frame(tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE);
+            // Frames get dropped instead of waiting for the main loop to empty the Opus frame ring buffer.
+            if (soundio_ring_buffer_free_count(opus_frame_ring_buffer_.get()) < MAX_OPUS_FRAME_RECORD_SIZE) {
+                ++dropped_frame_count_;
+                continue;
+            }
+
+            // soundio mirrors the memory of ring buffers, so a record never wraps around.
+            const auto record{reinterpret_cast<std::byte*>(soundio_ring_buffer_write_ptr(opus_frame_ring_buffer_.get()))};
             const int opus_frame_size{tt::encode_opus(opus_encoder_,
-                                                      opus_frame.data(),
+                                                      record + sizeof(OpusFrameRecordHeader),
                                                       pcm_.data(),
                                                       KH_SAMPLES_PER_FRAME,
-                                                      gsl::narrow<opus_int32>(opus_frame.size()))};
-            opus_frame.resize(opus_frame_size);
-            for (auto& [_, remote_receiver] : remote_receivers) {
-                if (remote_receiver.audio_requested) {
-                    udp_socket.send(tt::create_audio_sender_packet(sender_id_, audio_frame_id_++, opus_frame).bytes, remote_receiver.endpoint);
-                }
-            }
-            cursor += BYTES_PER_FRAME;
+                                                      tt::KH_MAX_AUDIO_PACKET_CONTENT_SIZE)};
+            if (opus_frame_size < 0)
+                throw std::runtime_error(std::string("Failed to encode audio: ") + opus_strerror(opus_frame_size));
+
+            // The samples after the frame in the ring buffer got captured after it.
+            const OpusFrameRecordHeader header{read_ms - (fill_bytes - cursor) * 1000.0f / KH_BYTES_PER_SECOND, opus_frame_size};
+            memcpy(record, &header, sizeof(header));
+            soundio_ring_buffer_advance_write_ptr(opus_frame_ring_buffer_.get(), gsl::narrow<int>(sizeof(header) + opus_frame_size));
         }
 
-        soundio_ring_buffer_advance_read_ptr(ring_buffer, cursor);
+        soundio_ring_buffer_advance_read_ptr(sample_ring_buffer_.get(), cursor);
     }
 
-private:
     const int sender_id_;
 
     SoundIoHandle sound_io_;
+    SoundIoRingBufferHandle sample_ring_buffer_;
+    SoundIoRingBufferHandle opus_frame_ring_buffer_;
+    // Declared after the ring buffers, so it stops calling back before they get destroyed.
     SoundIoInStreamHandle kinect_microphone_stream_;
     tt::OpusEncoderHandle opus_encoder_;
 
+    const tt::TimePoint start_time_;
+    // Only for the audio thread.
     std::array<float, KH_SAMPLES_PER_FRAME * KH_CHANNEL_COUNT> pcm_;
-    int audio_frame_id_;
+    // Only for the main loop.
+    AudioBundler bundler_;
+    std::atomic<int> dropped_frame_count_;
+    // Declared last, so the thread stops before the members it uses get destroyed.
+    std::optional<AudioThread> audio_thread_;
 };
-}
\ No newline at end of file
+}
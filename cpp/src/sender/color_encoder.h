@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <vpx/vp8cx.h>
+#include <vpx/vpx_encoder.h>
+#include "native/tt_native.h"
+#include "utils/extension_packets.h"
+#include "utils/tiled_color.h"
+#include "utils/worker_thread_pool.h"
+
+namespace kh
+{
+// Settings of libvpx for a session.
+// Fields only one of VP8 and VP9 has are ignored by the other.
+struct ColorEncoderProfile
+{
+    unsigned int thread_count;
+    // VP8 splits the tokens of a frame into 2^token_partitions_log2 partitions to decode them in parallel.
+    int token_partitions_log2;
+    // VP9 splits a frame into 2^tile_columns_log2 tile columns to encode them in parallel.
+    int tile_columns_log2;
+    // Higher speeds trade quality for encoding time.
+    // From 4 to 16 for real-time VP8 and from 5 to 9 for real-time VP9.
+    int speed;
+    unsigned int target_bitrate_kbps;
+    // Quantizers range from 0 to 63.
+    unsigned int min_quantizer;
+    unsigned int max_quantizer;
+    bool error_resilient;
+    // With a tiled color codec, encodes a stripe per frame as a keyframe of its encoder in turns,
+    // so decoders recover from missing frames without keyframes. Other codecs ignore this.
+    bool intra_refresh;
+};
+
+inline ColorEncoderProfile create_default_vp8_color_encoder_profile()
+{
+    return ColorEncoderProfile{4, 2, 0, 8, 2000, 4, 56, true, false};
+}
+
+inline ColorEncoderProfile create_default_vp9_color_encoder_profile()
+{
+    return ColorEncoderProfile{4, 0, 2, 7, 2000, 4, 56, true, false};
+}
+
+class ColorEncoder
+{
+public:
+    virtual ~ColorEncoder() {}
+    virtual std::vector<std::byte> encode(const tt::YuvFrame& yuv_frame, bool keyframe) = 0;
+};
+
+class Vp8ColorEncoder : public ColorEncoder
+{
+public:
+    Vp8ColorEncoder(int width, int height)
+        : encoder_{width, height}
+    {
+    }
+
+    std::vector<std::byte> encode(const tt::YuvFrame& yuv_frame, bool keyframe)
+    {
+        return encoder_.encode(yuv_frame, keyframe);
+    }
+
+private:
+    tt::Vp8Encoder encoder_;
+};
+
+// A VP8 or VP9 encoder of libvpx set up for real-time encoding of each frame without lag.
+// VP9 also gets row based multi-threading on top of its tiles.
+class LibvpxColorEncoder : public ColorEncoder
+{
+public:
+    LibvpxColorEncoder(ColorCodec color_codec, int width, int height, const ColorEncoderProfile& profile)
+        : codec_{}
+        , image_{}
+        , frame_index_{0}
+    {
+        vpx_codec_iface_t* codec_interface{color_codec == ColorCodec::Vp9 ? vpx_codec_vp9_cx() : vpx_codec_vp8_cx()};
+        vpx_codec_enc_cfg_t configuration;
+        if (vpx_codec_enc_config_default(codec_interface, &configuration, 0) != VPX_CODEC_OK)
+            throw std::runtime_error("vpx_codec_enc_config_default() failed in LibvpxColorEncoder.");
+
+        configuration.g_w = width;
+        configuration.g_h = height;
+        configuration.g_timebase.num = 1;
+        configuration.g_timebase.den = 30;
+        configuration.g_threads = profile.thread_count;
+        configuration.g_lag_in_frames = 0;
+        configuration.g_error_resilient = profile.error_resilient ? VPX_ERROR_RESILIENT_DEFAULT : 0;
+        configuration.rc_end_usage = VPX_CBR;
+        configuration.rc_target_bitrate = profile.target_bitrate_kbps;
+        configuration.rc_min_quantizer = profile.min_quantizer;
+        configuration.rc_max_quantizer = profile.max_quantizer;
+        // Keyframes only when asked for.
+        configuration.kf_mode = VPX_KF_DISABLED;
+
+        if (vpx_codec_enc_init(&codec_, codec_interface, &configuration, 0) != VPX_CODEC_OK)
+            throw std::runtime_error("vpx_codec_enc_init() failed in LibvpxColorEncoder.");
+
+        vpx_codec_control(&codec_, VP8E_SET_CPUUSED, profile.speed);
+        if (color_codec == ColorCodec::Vp9) {
+            vpx_codec_control(&codec_, VP9E_SET_ROW_MT, 1);
+            vpx_codec_control(&codec_, VP9E_SET_TILE_COLUMNS, profile.tile_columns_log2);
+        } else {
+            vpx_codec_control(&codec_, VP8E_SET_TOKEN_PARTITIONS, profile.token_partitions_log2);
+        }
+
+        if (!vpx_img_alloc(&image_, VPX_IMG_FMT_I420, width, height, 1))
+            throw std::runtime_error("vpx_img_alloc() failed in LibvpxColorEncoder.");
+    }
+
+    ~LibvpxColorEncoder()
+    {
+        vpx_img_free(&image_);
+        vpx_codec_destroy(&codec_);
+    }
+
+    LibvpxColorEncoder(const LibvpxColorEncoder&) = delete;
+    LibvpxColorEncoder& operator=(const LibvpxColorEncoder&) = delete;
+
+    std::vector<std::byte> encode(const tt::YuvFrame& yuv_frame, bool keyframe)
+    {
+        return encode_rows(yuv_frame, 0, yuv_frame.height(), keyframe);
+    }
+
+    // Encodes row_count rows from row, which is even, of yuv_frame, whose size the encoder has.
+    std::vector<std::byte> encode_rows(const tt::YuvFrame& yuv_frame, int row, int row_count, bool keyframe)
+    {
+        const int width{yuv_frame.width()};
+        copy_plane(yuv_frame.y_channel().data() + row * width, width, row_count, VPX_PLANE_Y);
+        copy_plane(yuv_frame.u_channel().data() + row / 2 * width / 2, width / 2, row_count / 2, VPX_PLANE_U);
+        copy_plane(yuv_frame.v_channel().data() + row / 2 * width / 2, width / 2, row_count / 2, VPX_PLANE_V);
+
+        if (vpx_codec_encode(&codec_, &image_, frame_index_++, 1, keyframe ? VPX_EFLAG_FORCE_KF : 0, VPX_DL_REALTIME) != VPX_CODEC_OK)
+            throw std::runtime_error(std::string("vpx_codec_encode() failed in LibvpxColorEncoder: ") + vpx_codec_error(&codec_));
+
+        std::vector<std::byte> frame;
+        vpx_codec_iter_t iterator{nullptr};
+        while (const vpx_codec_cx_pkt_t* packet{vpx_codec_get_cx_data(&codec_, &iterator)}) {
+            if (packet->kind != VPX_CODEC_CX_FRAME_PKT)
+                continue;
+
+            const auto packet_bytes{reinterpret_cast<const std::byte*>(packet->data.frame.buf)};
+            frame.insert(frame.end(), packet_bytes, packet_bytes + packet->data.frame.sz);
+        }
+        return frame;
+    }
+
+private:
+    void copy_plane(const uint8_t* channel, int width, int height, int plane)
+    {
+        for (int row{0}; row < height; ++row)
+            memcpy(image_.planes[plane] + row * image_.stride[plane], channel + row * width, width);
+    }
+
+    vpx_codec_ctx_t codec_;
+    vpx_image_t image_;
+    vpx_codec_pts_t frame_index_;
+};
+
+// Encodes the stripes of tiled color codecs with a LibvpxColorEncoder each in parallel.
+// Each stripe encoder gets a share of the bitrate by its rows and a single thread, since the stripes are the parallelism.
+class TiledColorEncoder : public ColorEncoder
+{
+public:
+    TiledColorEncoder(ColorCodec stripe_codec, int width, int height, const ColorEncoderProfile& profile)
+        : stripes_{create_tiled_color_stripes(height)}
+        , encoders_{}
+        , stripe_frames_(stripes_.size())
+        , intra_refresh_{profile.intra_refresh}
+        , next_refreshed_stripe_index_{0}
+        , worker_thread_pool_{gsl::narrow<int>(stripes_.size()) - 1}
+    {
+        for (auto& stripe : stripes_) {
+            ColorEncoderProfile stripe_profile{profile};
+            stripe_profile.thread_count = 1;
+            stripe_profile.token_partitions_log2 = 0;
+            stripe_profile.tile_columns_log2 = 0;
+            stripe_profile.target_bitrate_kbps = std::max(profile.target_bitrate_kbps * stripe.row_count / height, 1u);
+            encoders_.push_back(std::make_unique<LibvpxColorEncoder>(stripe_codec, width, stripe.row_count, stripe_profile));
+        }
+    }
+
+    std::vector<std::byte> encode(const tt::YuvFrame& yuv_frame, bool keyframe)
+    {
+        std::optional<int> refreshed_stripe_index;
+        if (intra_refresh_ && !keyframe) {
+            refreshed_stripe_index = next_refreshed_stripe_index_;
+            next_refreshed_stripe_index_ = (next_refreshed_stripe_index_ + 1) % gsl::narrow<int>(stripes_.size());
+        }
+
+        // The first stripe gets encoded in this thread while the others are in worker threads.
+        worker_thread_pool_.run([&](int i) {
+            auto& stripe{stripes_[i]};
+            stripe_frames_[i] = encoders_[i]->encode_rows(yuv_frame, stripe.row, stripe.row_count, keyframe || refreshed_stripe_index == i);
+        });
+        return create_tiled_color_frame(stripe_frames_, refreshed_stripe_index);
+    }
+
+private:
+    std::vector<TiledColorStripe> stripes_;
+    std::vector<std::unique_ptr<LibvpxColorEncoder>> encoders_;
+    std::vector<std::vector<std::byte>> stripe_frames_;
+    bool intra_refresh_;
+    int next_refreshed_stripe_index_;
+    WorkerThreadPool worker_thread_pool_;
+};
+
+// Without a profile, VP8 is left to the defaults of tt::Vp8Encoder and the others get the default profile of their codec.
+inline std::unique_ptr<ColorEncoder> create_color_encoder(ColorCodec color_codec,
+                                                          int width,
+                                                          int height,
+                                                          const std::optional<ColorEncoderProfile>& profile)
+{
+    switch (color_codec) {
+    case ColorCodec::Vp8:
+        if (!profile)
+            return std::make_unique<Vp8ColorEncoder>(width, height);
+        return std::make_unique<LibvpxColorEncoder>(color_codec, width, height, *profile);
+    case ColorCodec::Vp9:
+        return std::make_unique<LibvpxColorEncoder>(color_codec, width, height, profile.value_or(create_default_vp9_color_encoder_profile()));
+    case ColorCodec::TiledVp8:
+        return std::make_unique<TiledColorEncoder>(ColorCodec::Vp8, width, height, profile.value_or(create_default_vp8_color_encoder_profile()));
+    case ColorCodec::TiledVp9:
+        return std::make_unique<TiledColorEncoder>(ColorCodec::Vp9, width, height, profile.value_or(create_default_vp9_color_encoder_profile()));
+    }
+    throw std::runtime_error("Invalid ColorCodec in create_color_encoder().");
+}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <emmintrin.h>
+#include "native/tt_native.h"
+
+namespace kh
+{
+// Changes of a pixel within this band around its last output get held since they are noise.
+// The band widens with the square of the distance as the noise of the Kinect does (6 mm up to 1 m, 9 mm at 2 m, 21 mm at 4 m).
+constexpr int KH_DEPTH_DENOISER_MIN_BAND{6};
+constexpr int KH_DEPTH_DENOISER_BAND_SHIFT{20};
+
+// A temporal filter for depth pixels before TRVL encoding.
+// A change beyond the band only passes once the next frame confirms it by staying within the band of it,
+// so single-frame flickers at edges and on dark surfaces do not become TRVL deltas.
+// Real motion resets the pixel after one frame of delay.
+// Invalid pixels pass through right away since holding them would leave points without color.
+class DepthDenoiser
+{
+public:
+    DepthDenoiser(int pixel_count)
+        : states_(pixel_count, 0)
+        , candidates_(pixel_count, 0)
+    {
+    }
+
+    // Filters depth_pixels in place and returns the number of pixels whose change got delayed.
+    // Eight pixels at a time with SSE2, with the remainder in the same steps without SSE2.
+    int denoise(gsl::span<int16_t> depth_pixels)
+    {
+        int16_t* depths{depth_pixels.data()};
+        int16_t* states{states_.data()};
+        int16_t* candidates{candidates_.data()};
+        const gsl::index pixel_count{std::min<gsl::index>(depth_pixels.size(), states_.size())};
+
+        const __m128i zero{_mm_setzero_si128()};
+        const __m128i min_band{_mm_set1_epi16(KH_DEPTH_DENOISER_MIN_BAND)};
+        // Delayed lanes are -1, so multiplying them by -1 and adding pairs counts them in 32-bit lanes.
+        const __m128i minus_one{_mm_set1_epi16(-1)};
+        __m128i delayed_counts{_mm_setzero_si128()};
+        gsl::index i{0};
+        for (; i + 8 <= pixel_count; i += 8) {
+            const __m128i depth{_mm_loadu_si128(reinterpret_cast<const __m128i*>(depths + i))};
+            const __m128i state{_mm_loadu_si128(reinterpret_cast<const __m128i*>(states + i))};
+            const __m128i candidate{_mm_loadu_si128(reinterpret_cast<const __m128i*>(candidates + i))};
+
+            // The high half of the unsigned product is (state * state) >> 16, which is exact for states of valid pixels.
+            // Bands of invalid pixels do not matter.
+            const __m128i band{_mm_add_epi16(min_band, _mm_srli_epi16(_mm_mulhi_epu16(state, state), KH_DEPTH_DENOISER_BAND_SHIFT - 16))};
+            const __m128i valid{_mm_and_si128(_mm_cmpgt_epi16(depth, zero), _mm_cmpgt_epi16(state, zero))};
+            // Saturated differences stay beyond any band.
+            const __m128i state_difference{_mm_subs_epi16(depth, state)};
+            const __m128i candidate_difference{_mm_subs_epi16(depth, candidate)};
+            const __m128i beyond_band{_mm_cmpgt_epi16(_mm_max_epi16(state_difference, _mm_subs_epi16(zero, state_difference)), band)};
+            const __m128i unconfirmed{_mm_cmpgt_epi16(_mm_max_epi16(candidate_difference, _mm_subs_epi16(zero, candidate_difference)), band)};
+            const __m128i delayed{_mm_and_si128(_mm_and_si128(valid, beyond_band), unconfirmed)};
+            // Pixels keep their state when valid and either within the band or delayed.
+            const __m128i held{_mm_andnot_si128(_mm_andnot_si128(unconfirmed, beyond_band), valid)};
+            const __m128i output{_mm_or_si128(_mm_and_si128(held, state), _mm_andnot_si128(held, depth))};
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates + i), depth);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(states + i), output);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(depths + i), output);
+            delayed_counts = _mm_add_epi32(delayed_counts, _mm_madd_epi16(delayed, minus_one));
+        }
+
+        alignas(16) int32_t lane_counts[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lane_counts), delayed_counts);
+        int delayed_pixel_count{lane_counts[0] + lane_counts[1] + lane_counts[2] + lane_counts[3]};
+        for (; i < pixel_count; ++i) {
+            const int depth{depths[i]};
+            const int state{states[i]};
+            const int band{KH_DEPTH_DENOISER_MIN_BAND + ((state * state) >> KH_DEPTH_DENOISER_BAND_SHIFT)};
+            const bool invalid{depth <= 0 || state <= 0};
+            const bool within_band{std::abs(depth - state) <= band};
+            const bool confirmed{std::abs(depth - candidates[i]) <= band};
+            const int output{invalid || (!within_band && confirmed) ? depth : state};
+
+            candidates[i] = static_cast<int16_t>(depth);
+            states[i] = static_cast<int16_t>(output);
+            depths[i] = static_cast<int16_t>(output);
+            if (!invalid && !within_band && !confirmed)
+                ++delayed_pixel_count;
+        }
+        return delayed_pixel_count;
+    }
+
+private:
+    // The last output of each pixel.
+    std::vector<int16_t> states_;
+    // The last input of each pixel, which a change has to stay close to for being accepted.
+    std::vector<int16_t> candidates_;
+};
+}
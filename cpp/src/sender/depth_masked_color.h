@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstring>
+#include <emmintrin.h>
+#include "native/tt_native.h"
+
+namespace kh
+{
+// Fills BGRA color pixels without valid depth with the color of the last valid pixel in their row,
+// or the first valid one for the pixels before it. Rows without valid pixels stay as they are.
+// Receivers drop these pixels anyway, and without edges to the black pixels the mapping leaves,
+// VP8 prediction covers them with few bits.
+// Four pixels at a time with SSE2, with the remainder of each row in the same steps without SSE2.
+// Within four pixels, colors get carried forward in two shifts, one and two pixels far.
+// Returns the number of filled pixels.
+inline int fill_color_pixels_without_depth(uint8_t* bgra_buffer,
+                                           int stride_bytes,
+                                           gsl::span<const int16_t> depth_pixels,
+                                           int width,
+                                           int height)
+{
+    // The number of set bits of each 4-bit mask.
+    constexpr int BIT_COUNTS[16]{0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+
+    const __m128i zero{_mm_setzero_si128()};
+    int filled_pixel_count{0};
+    for (int row{0}; row < height; ++row) {
+        uint8_t* bgra_row{bgra_buffer + row * stride_bytes};
+        const int16_t* depth_row{depth_pixels.data() + row * width};
+
+        int first_valid_col{-1};
+        // All four lanes are the last valid color once there is one.
+        __m128i last_valid_color{zero};
+        int col{0};
+        for (; col + 4 <= width; col += 4) {
+            __m128i* color_ptr{reinterpret_cast<__m128i*>(bgra_row + col * 4)};
+            const __m128i depth{_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth_row + col))};
+            const __m128i invalid_depth{_mm_cmpeq_epi16(_mm_max_epi16(depth, zero), zero)};
+            // Widen the 16-bit masks to the 32-bit lanes of the pixels.
+            const __m128i invalid{_mm_unpacklo_epi16(invalid_depth, invalid_depth)};
+            const int invalid_bits{_mm_movemask_ps(_mm_castsi128_ps(invalid))};
+            const __m128i color{_mm_loadu_si128(color_ptr)};
+
+            // Only the last valid color changes when all four are valid, which most pixels are.
+            if (invalid_bits == 0) {
+                if (first_valid_col < 0)
+                    first_valid_col = col;
+                last_valid_color = _mm_shuffle_epi32(color, _MM_SHUFFLE(3, 3, 3, 3));
+                continue;
+            }
+
+            // Carry valid colors to the invalid lanes after them.
+            __m128i carried{_mm_andnot_si128(invalid, color)};
+            __m128i has_color{_mm_andnot_si128(invalid, _mm_cmpeq_epi32(zero, zero))};
+            const __m128i taken_from_one{_mm_andnot_si128(has_color, _mm_slli_si128(has_color, 4))};
+            carried = _mm_or_si128(carried, _mm_and_si128(taken_from_one, _mm_slli_si128(carried, 4)));
+            has_color = _mm_or_si128(has_color, taken_from_one);
+            const __m128i taken_from_two{_mm_andnot_si128(has_color, _mm_slli_si128(has_color, 8))};
+            carried = _mm_or_si128(carried, _mm_and_si128(taken_from_two, _mm_slli_si128(carried, 8)));
+            has_color = _mm_or_si128(has_color, taken_from_two);
+
+            const int valid_bits{~invalid_bits & 0xF};
+            if (first_valid_col < 0 && valid_bits != 0) {
+                int first_valid_lane{0};
+                while (!(valid_bits & (1 << first_valid_lane)))
+                    ++first_valid_lane;
+                first_valid_col = col + first_valid_lane;
+            }
+
+            // Lanes before any valid one in the row keep their colors until the pass over the pixels before the first valid one.
+            if (first_valid_col >= 0 && first_valid_col < col) {
+                carried = _mm_or_si128(carried, _mm_andnot_si128(has_color, last_valid_color));
+                has_color = _mm_cmpeq_epi32(zero, zero);
+            }
+            const __m128i filled{_mm_or_si128(_mm_and_si128(has_color, carried), _mm_andnot_si128(has_color, color))};
+            _mm_storeu_si128(color_ptr, filled);
+            filled_pixel_count += BIT_COUNTS[invalid_bits & _mm_movemask_ps(_mm_castsi128_ps(has_color))];
+
+            if (first_valid_col >= 0)
+                last_valid_color = _mm_shuffle_epi32(filled, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+
+        uint32_t last_valid_color_value{static_cast<uint32_t>(_mm_cvtsi128_si32(last_valid_color))};
+        for (; col < width; ++col) {
+            if (depth_row[col] > 0) {
+                memcpy(&last_valid_color_value, bgra_row + col * 4, 4);
+                if (first_valid_col < 0)
+                    first_valid_col = col;
+            } else if (first_valid_col >= 0) {
+                memcpy(bgra_row + col * 4, &last_valid_color_value, 4);
+                ++filled_pixel_count;
+            }
+        }
+
+        if (first_valid_col < 0)
+            continue;
+
+        // Pixels before the first valid one.
+        for (int col{0}; col < first_valid_col; ++col)
+            memcpy(bgra_row + col * 4, bgra_row + first_valid_col * 4, 4);
+        filled_pixel_count += first_valid_col;
+    }
+    return filled_pixel_count;
+}
+}
@@ -0,0 +1,173 @@
+#include "depth_ray_table.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <thread>
+
+namespace kh
+{
+namespace
+{
+// A cache file starts with this header, which is followed by the x, the y, and the validity of every pixel.
+// The header keeps the floats aligned.
+struct DepthRayTableHeader
+{
+    uint64_t calibration_hash;
+    int32_t width;
+    int32_t height;
+};
+
+size_t get_depth_ray_table_size(int width, int height)
+{
+    const size_t pixel_count{gsl::narrow<size_t>(width * height)};
+    return sizeof(DepthRayTableHeader) + pixel_count * (sizeof(float) * 2 + sizeof(uint8_t));
+}
+
+// FNV-1a of the calibration, which includes the depth mode and the color resolution.
+uint64_t hash_calibration(const k4a::calibration& calibration)
+{
+    const auto bytes{reinterpret_cast<const uint8_t*>(static_cast<const k4a_calibration_t*>(&calibration))};
+    uint64_t hash{14695981039346656037ull};
+    for (size_t i{0}; i < sizeof(k4a_calibration_t); ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string get_cache_file_path(const std::string& cache_folder_path, uint64_t calibration_hash)
+{
+    std::ostringstream filename;
+    filename << "depth_ray_table_" << std::hex << calibration_hash << ".bin";
+    return (std::filesystem::path{cache_folder_path} / filename.str()).string();
+}
+
+std::vector<std::byte> compute_depth_ray_table_bytes(const k4a::calibration& calibration, uint64_t calibration_hash)
+{
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+    const int pixel_count{width * height};
+
+    std::vector<std::byte> bytes(get_depth_ray_table_size(width, height));
+    const DepthRayTableHeader header{calibration_hash, width, height};
+    memcpy(bytes.data(), &header, sizeof(header));
+    const auto x{reinterpret_cast<float*>(bytes.data() + sizeof(header))};
+    const auto y{x + pixel_count};
+    const auto valid{reinterpret_cast<uint8_t*>(y + pixel_count)};
+
+    // Each thread unprojects a band of rows since the calibration only gets read.
+    const int thread_count{std::max(gsl::narrow<int>(std::thread::hardware_concurrency()), 1)};
+    const int band_row_count{(height + thread_count - 1) / thread_count};
+    std::vector<std::future<void>> futures;
+    for (int band_row{0}; band_row < height; band_row += band_row_count) {
+        futures.push_back(std::async(std::launch::async, [&calibration, width, height, x, y, valid, band_row, band_row_count] {
+            k4a_float3_t point;
+            for (int j{band_row}; j < std::min(band_row + band_row_count, height); ++j) {
+                for (int i{0}; i < width; ++i) {
+                    const int index{i + j * width};
+                    const bool converted{calibration.convert_2d_to_3d(k4a_float2_t{gsl::narrow<float>(i), gsl::narrow<float>(j)},
+                                                                      1.0f,
+                                                                      K4A_CALIBRATION_TYPE_DEPTH,
+                                                                      K4A_CALIBRATION_TYPE_DEPTH,
+                                                                      &point)};
+                    x[index] = converted ? point.xyz.x : 0.0f;
+                    y[index] = converted ? point.xyz.y : 0.0f;
+                    valid[index] = converted ? 1 : 0;
+                }
+            }
+        }));
+    }
+    for (auto& future : futures)
+        future.get();
+
+    return bytes;
+}
+
+bool verify_depth_ray_table_bytes(gsl::span<const std::byte> bytes, uint64_t calibration_hash, int width, int height)
+{
+    if (bytes.size() != get_depth_ray_table_size(width, height))
+        return false;
+
+    DepthRayTableHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    return header.calibration_hash == calibration_hash && header.width == width && header.height == height;
+}
+
+// Written to a temporary file and then renamed, so other launches never map a partially written file.
+// Failing to write only costs the next launch the time to compute the table again.
+void write_cache_file(const std::string& cache_file_path, gsl::span<const std::byte> bytes)
+{
+    const std::string temporary_path{cache_file_path + ".tmp"};
+    {
+        std::ofstream file{temporary_path, std::ios::binary};
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        if (!file)
+            return;
+    }
+
+    std::error_code error_code;
+    std::filesystem::rename(temporary_path, cache_file_path, error_code);
+    if (error_code)
+        std::filesystem::remove(temporary_path, error_code);
+}
+}
+
+std::shared_ptr<const DepthRayTable> DepthRayTable::create(const k4a::calibration& calibration, const std::optional<std::string>& cache_folder_path)
+{
+    const int width{calibration.depth_camera_calibration.resolution_width};
+    const int height{calibration.depth_camera_calibration.resolution_height};
+    const uint64_t calibration_hash{hash_calibration(calibration)};
+
+    if (cache_folder_path) {
+        const std::string cache_file_path{get_cache_file_path(*cache_folder_path, calibration_hash)};
+        auto mapped_file{MappedFile::open(cache_file_path)};
+        if (mapped_file && verify_depth_ray_table_bytes(mapped_file->bytes(), calibration_hash, width, height))
+            return std::shared_ptr<const DepthRayTable>{new DepthRayTable{width, height, std::move(*mapped_file)}};
+    }
+
+    auto bytes{compute_depth_ray_table_bytes(calibration, calibration_hash)};
+    if (cache_folder_path) {
+        std::error_code error_code;
+        std::filesystem::create_directories(*cache_folder_path, error_code);
+        write_cache_file(get_cache_file_path(*cache_folder_path, calibration_hash), bytes);
+    }
+
+    return std::shared_ptr<const DepthRayTable>{new DepthRayTable{width, height, std::move(bytes)}};
+}
+
+DepthRayTable::DepthRayTable(int width, int height, std::vector<std::byte>&& computed_bytes)
+    : width_{width}
+    , height_{height}
+    , computed_bytes_{std::move(computed_bytes)}
+    , mapped_file_{}
+    , x_{}
+    , y_{}
+    , valid_{}
+{
+    set_spans(computed_bytes_);
+}
+
+DepthRayTable::DepthRayTable(int width, int height, MappedFile&& mapped_file)
+    : width_{width}
+    , height_{height}
+    , computed_bytes_{}
+    , mapped_file_{std::move(mapped_file)}
+    , x_{}
+    , y_{}
+    , valid_{}
+{
+    set_spans(mapped_file_->bytes());
+}
+
+void DepthRayTable::set_spans(gsl::span<const std::byte> bytes)
+{
+    const size_t pixel_count{gsl::narrow<size_t>(width_ * height_)};
+    const auto x{reinterpret_cast<const float*>(bytes.data() + sizeof(DepthRayTableHeader))};
+    x_ = gsl::span<const float>{x, pixel_count};
+    y_ = gsl::span<const float>{x + pixel_count, pixel_count};
+    valid_ = gsl::span<const uint8_t>{reinterpret_cast<const uint8_t*>(x + pixel_count * 2), pixel_count};
+}
+}
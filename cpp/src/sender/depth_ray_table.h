@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include "native/tt_native.h"
+#include "win32/kh_kinect.h"
+#include "win32/mapped_file.h"
+
+namespace k4a
+{
+struct calibration;
+}
+
+namespace kh
+{
+// The x and y of the point of each depth pixel at a millimeter of depth,
+// which OcclusionRemover, PointCloudGenerator, and RegionOfInterestFilter multiply with depth pixels.
+// Computing them takes an Azure Kinect SDK call per pixel, so they get computed in parallel once per calibration
+// and kept in a cache file, which later launches map read-only instead.
+// A table gets shared by its users instead of each keeping a copy.
+class DepthRayTable
+{
+public:
+    // Maps the cache file of the calibration in cache_folder_path if there is one.
+    // Otherwise, computes the table and writes the cache file for the next launch.
+    // Without cache_folder_path, only computes the table.
+    static std::shared_ptr<const DepthRayTable> create(const k4a::calibration& calibration, const std::optional<std::string>& cache_folder_path);
+    int width() const { return width_; }
+    int height() const { return height_; }
+    // Whether the table got mapped from a cache file instead of getting computed.
+    bool mapped() const { return mapped_file_.has_value(); }
+    gsl::span<const float> x() const { return x_; }
+    gsl::span<const float> y() const { return y_; }
+    // Zero for pixels that cannot get unprojected, whose x and y are also zero.
+    gsl::span<const uint8_t> valid() const { return valid_; }
+
+private:
+    DepthRayTable(int width, int height, std::vector<std::byte>&& computed_bytes);
+    DepthRayTable(int width, int height, MappedFile&& mapped_file);
+    void set_spans(gsl::span<const std::byte> bytes);
+
+    int width_;
+    int height_;
+    // Either computed_bytes_ or mapped_file_ holds the bytes of the table.
+    std::vector<std::byte> computed_bytes_;
+    std::optional<MappedFile> mapped_file_;
+    gsl::span<const float> x_;
+    gsl::span<const float> y_;
+    gsl::span<const uint8_t> valid_;
+};
+}
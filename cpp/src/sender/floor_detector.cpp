@@ -0,0 +1,131 @@
+#include "floor_detector.h"
+
+#include <algorithm>
+#include <cmath>
+#include "external/FloorDetector.h"
+
+namespace kh
+{
+namespace
+{
+// Parameters of Samples::FloorDetector::TryDetectFloorPlane().
+constexpr float PLANE_DISPLACEMENT_RANGE{0.05f};
+constexpr float PLANE_MAX_TILT_DEGREE{5.0f};
+constexpr int BIN_AGGREGATION{6};
+constexpr float BIN_SIZE{PLANE_DISPLACEMENT_RANGE / BIN_AGGREGATION};
+// Elevations of Azure Kinect points stay within this range, so the bins for it get reserved once.
+constexpr float RESERVED_ELEVATION_RANGE{10.0f};
+}
+
+FloorDetector::FloorDetector(const k4a::calibration& calibration)
+    : calibration_{calibration}
+    , offsets_{}
+    , histogram_bins_{}
+{
+    offsets_.reserve(calibration.depth_camera_calibration.resolution_width * calibration.depth_camera_calibration.resolution_height);
+    histogram_bins_.reserve(1 + static_cast<size_t>(RESERVED_ELEVATION_RANGE / BIN_SIZE));
+}
+
+std::optional<std::array<float, 4>> FloorDetector::detect(const std::vector<k4a_float3_t>& cloud_points,
+                                                          const k4a_imu_sample_t& imu_sample,
+                                                          size_t minimum_floor_point_count)
+{
+    const auto gravity{Samples::TryEstimateGravityVectorForDepthCamera(imu_sample, calibration_)};
+    if (!gravity || cloud_points.empty())
+        return std::nullopt;
+
+    // Up normal is opposite to gravity down vector.
+    const Samples::Vector up{(*gravity * -1).Normalized()};
+
+    offsets_.resize(cloud_points.size());
+    for (size_t i{0}; i < cloud_points.size(); ++i)
+        offsets_[i] = up.Dot(Samples::Vector{cloud_points[i]});
+
+    const auto [min_offset, max_offset] {std::minmax_element(offsets_.begin(), offsets_.end())};
+    const float min_elevation{*min_offset};
+    const size_t bin_count{1 + static_cast<size_t>((*max_offset - min_elevation) / BIN_SIZE)};
+
+    histogram_bins_.assign(bin_count, HistogramBin{});
+    for (size_t i{0}; i < cloud_points.size(); ++i) {
+        auto& bin{histogram_bins_[static_cast<int>((offsets_[i] - min_elevation) / BIN_SIZE)]};
+        const auto& point{cloud_points[i].xyz};
+        ++bin.count;
+        bin.sum[0] += point.x;
+        bin.sum[1] += point.y;
+        bin.sum[2] += point.z;
+        bin.product_sum[0] += point.x * point.x;
+        bin.product_sum[1] += point.x * point.y;
+        bin.product_sum[2] += point.x * point.z;
+        bin.product_sum[3] += point.y * point.y;
+        bin.product_sum[4] += point.y * point.z;
+        bin.product_sum[5] += point.z * point.z;
+    }
+
+    // The lowest window of BIN_AGGREGATION bins with enough points, skipping the first bin like Samples::FloorDetector.
+    size_t window_count{0};
+    for (size_t i{1}; i <= BIN_AGGREGATION && i < bin_count; ++i)
+        window_count += histogram_bins_[i].count;
+
+    size_t window_start{1};
+    for (; window_start + BIN_AGGREGATION < bin_count; ++window_start) {
+        if (window_count > minimum_floor_point_count)
+            break;
+
+        window_count += histogram_bins_[window_start + BIN_AGGREGATION].count;
+        window_count -= histogram_bins_[window_start].count;
+    }
+
+    if (window_start + BIN_AGGREGATION >= bin_count || window_count < 3)
+        return std::nullopt;
+
+    HistogramBin window{};
+    for (size_t i{window_start}; i < window_start + BIN_AGGREGATION; ++i) {
+        window.count += histogram_bins_[i].count;
+        for (size_t j{0}; j < window.sum.size(); ++j)
+            window.sum[j] += histogram_bins_[i].sum[j];
+        for (size_t j{0}; j < window.product_sum.size(); ++j)
+            window.product_sum[j] += histogram_bins_[i].product_sum[j];
+    }
+
+    // The zero-mean covariances from the sums, which is how FitPlaneToInlierPoints() of Samples::FloorDetector computes them.
+    const double n{static_cast<double>(window.count)};
+    const Samples::Vector centroid{static_cast<float>(window.sum[0] / n), static_cast<float>(window.sum[1] / n), static_cast<float>(window.sum[2] / n)};
+    const float xx{static_cast<float>(window.product_sum[0] - window.sum[0] * window.sum[0] / n)};
+    const float xy{static_cast<float>(window.product_sum[1] - window.sum[0] * window.sum[1] / n)};
+    const float xz{static_cast<float>(window.product_sum[2] - window.sum[0] * window.sum[2] / n)};
+    const float yy{static_cast<float>(window.product_sum[3] - window.sum[1] * window.sum[1] / n)};
+    const float yz{static_cast<float>(window.product_sum[4] - window.sum[1] * window.sum[2] / n)};
+    const float zz{static_cast<float>(window.product_sum[5] - window.sum[2] * window.sum[2] / n)};
+
+    const float det_x{yy * zz - yz * yz};
+    const float det_y{xx * zz - xz * xz};
+    const float det_z{xx * yy - xy * xy};
+    const float det_max{std::max({det_x, det_y, det_z})};
+    if (det_max <= 0.0f)
+        return std::nullopt;
+
+    Samples::Vector normal{0.0f, 0.0f, 0.0f};
+    if (det_max == det_x) {
+        normal = {det_x, xz * yz - xy * zz, xy * yz - xz * yy};
+    } else if (det_max == det_y) {
+        normal = {xz * yz - xy * zz, det_y, xy * xz - yz * xx};
+    } else {
+        normal = {xy * yz - xz * yy, xy * xz - yz * xx, det_z};
+    }
+    normal = normal.Normalized();
+
+    if (normal.Dot(up) < 0.0f)
+        normal = normal * -1.0f;
+    // The constant keeps the sign of Samples::FloorDetector, whose constant belongs to the normal before getting flipped upward.
+    const float c{get_floor_constant_sign(up.X, up.Y, up.Z) * normal.Dot(centroid)};
+
+    // Clamped since a dot product rounded above one would make acos() NaN,
+    // which makes Samples::FloorDetector reject floors parallel to the gravity.
+    const float floor_tilt_degree{std::acos(std::min(normal.Dot(up), 1.0f)) * 180.0f / 3.14159265f};
+    if (floor_tilt_degree >= PLANE_MAX_TILT_DEGREE)
+        return std::nullopt;
+
+    // For reduced jitter, use gravity for floor normal.
+    return std::array<float, 4>{up.X, up.Y, up.Z, c};
+}
+}
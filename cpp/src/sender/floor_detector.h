@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <optional>
+#include "native/tt_native.h"
+#include "win32/kh_kinect.h"
+
+namespace k4a
+{
+struct calibration;
+}
+
+namespace kh
+{
+// Floors keep the plane constant of Samples::FloorDetector, which belongs to the fitted normal before it gets flipped upward.
+// The fitted normal is positive along its largest component, so the constant is the elevation of the floor along the upward normal
+// times this sign, and the other way around.
+inline float get_floor_constant_sign(float up_x, float up_y, float up_z)
+{
+    const float largest_component{std::abs(up_x) >= std::abs(up_y) && std::abs(up_x) >= std::abs(up_z) ? up_x
+                                  : std::abs(up_y) >= std::abs(up_z) ? up_y
+                                                                     : up_z};
+    return largest_component > 0.0f ? -1.0f : 1.0f;
+}
+
+// The elevation of a floor along its upward normal, so the height of a point p above it is normal·p minus this.
+inline float get_floor_elevation(const std::array<float, 4>& floor)
+{
+    return get_floor_constant_sign(floor[0], floor[1], floor[2]) * floor[3];
+}
+
+// Finds the floor plane like Samples::FloorDetector::TryDetectFloorPlane() does,
+// as the lowest window of elevation histogram bins with enough points, without allocating memory per frame.
+// Each histogram bin sums the moments of its points in the same pass that counts them,
+// so the plane of a window gets fitted from the sums of its bins instead of collecting its points again.
+class FloorDetector
+{
+public:
+    FloorDetector(const k4a::calibration& calibration);
+    // Returns the upward normal and the constant of the plane, with get_floor_constant_sign().
+    std::optional<std::array<float, 4>> detect(const std::vector<k4a_float3_t>& cloud_points,
+                                               const k4a_imu_sample_t& imu_sample,
+                                               size_t minimum_floor_point_count);
+
+private:
+    struct HistogramBin
+    {
+        size_t count;
+        // Sums of coordinates and their products. Doubles keep the covariances from cancelling out.
+        std::array<double, 3> sum;
+        std::array<double, 6> product_sum;
+    };
+
+    k4a::calibration calibration_;
+    std::vector<float> offsets_;
+    std::vector<HistogramBin> histogram_bins_;
+};
+}
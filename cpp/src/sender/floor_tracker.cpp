@@ -0,0 +1,167 @@
+#include "floor_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include "external/FloorDetector.h"
+
+namespace kh
+{
+namespace
+{
+constexpr float GRAVITY{9.81f};
+// The filter starts from an accelerometer sample this close to gravity, as Samples::TryEstimateGravityVectorForDepthCamera() requires.
+constexpr float STILL_ACCELERATION_TOLERANCE{0.2f};
+// The share of the accelerometer in the filter shrinks as its samples deviate from gravity while the Kinect gets handled,
+// and the gyroscope carries the filter alone beyond this deviation.
+constexpr float MOVING_ACCELERATION_TOLERANCE{1.0f};
+// Share of a still accelerometer in each update of the filter. The gyroscope has the rest.
+constexpr float ACCELEROMETER_WEIGHT{0.05f};
+// Longer gaps between samples are from skipped frames or a looping playback.
+constexpr float MAX_GYROSCOPE_INTERVAL_SEC{0.1f};
+// Points this close to the plane in meters support it.
+constexpr float INLIER_DISTANCE{0.025f};
+// Points farther below the plane in meters tell a lower floor.
+constexpr float BELOW_DISTANCE{0.1f};
+constexpr int SAMPLED_POINT_COUNT{512};
+// The verification passes when the plane keeps this fraction of the inliers it had when RANSAC found it.
+constexpr float VERIFICATION_INLIER_RATIO{0.5f};
+// A floor has at least this fraction of the sampled points and there are less points below it.
+constexpr float MIN_FLOOR_POINT_RATIO{0.02f};
+constexpr int RANSAC_ITERATION_COUNT{64};
+// Weight of each verified frame on the elevation, which smooths the jitter of the plane.
+constexpr float ELEVATION_SMOOTHING{0.2f};
+
+Samples::Vector rotate(const std::array<float, 9>& rotation, const Samples::Vector& vector)
+{
+    return {rotation[0] * vector.X + rotation[1] * vector.Y + rotation[2] * vector.Z,
+            rotation[3] * vector.X + rotation[4] * vector.Y + rotation[5] * vector.Z,
+            rotation[6] * vector.X + rotation[7] * vector.Y + rotation[8] * vector.Z};
+}
+
+std::array<float, 9> get_rotation_to_depth_camera(const k4a::calibration& calibration, k4a_calibration_type_t source)
+{
+    const auto& rotation{calibration.extrinsics[source][K4A_CALIBRATION_TYPE_DEPTH].rotation};
+    std::array<float, 9> result;
+    std::copy(std::begin(rotation), std::end(rotation), result.begin());
+    return result;
+}
+}
+
+FloorTracker::FloorTracker(const k4a::calibration& calibration)
+    : accelerometer_rotation_{get_rotation_to_depth_camera(calibration, K4A_CALIBRATION_TYPE_ACCEL)}
+    , gyroscope_rotation_{get_rotation_to_depth_camera(calibration, K4A_CALIBRATION_TYPE_GYRO)}
+    , up_{}
+    , last_gyroscope_timestamp_usec_{0}
+    , elevation_{}
+    , reference_inlier_count_{0}
+    , verified_{false}
+    , random_engine_{}
+{
+}
+
+std::optional<std::array<float, 4>> FloorTracker::track(const std::vector<k4a_float3_t>& cloud_points, const k4a_imu_sample_t& imu_sample)
+{
+    update_up(imu_sample);
+    verified_ = false;
+    if (!up_ || cloud_points.empty())
+        return std::nullopt;
+
+    if (elevation_) {
+        const auto support{measure_support(cloud_points, *elevation_)};
+        verified_ = support.inlier_count > 0
+                    && support.inlier_count >= reference_inlier_count_ * VERIFICATION_INLIER_RATIO
+                    && support.below_count < support.sampled_count * MIN_FLOOR_POINT_RATIO;
+        if (verified_)
+            *elevation_ += ELEVATION_SMOOTHING * (support.inlier_elevation_sum / support.inlier_count - *elevation_);
+    }
+
+    if (!verified_ && !run_ransac(cloud_points)) {
+        elevation_ = std::nullopt;
+        return std::nullopt;
+    }
+
+    const Samples::Vector up{(*up_)[0], (*up_)[1], (*up_)[2]};
+    return std::array<float, 4>{up.X, up.Y, up.Z, get_floor_constant_sign(up.X, up.Y, up.Z) * *elevation_};
+}
+
+void FloorTracker::update_up(const k4a_imu_sample_t& imu_sample)
+{
+    // An accelerometer at rest measures the reaction to gravity, which is up.
+    const Samples::Vector acceleration{rotate(accelerometer_rotation_, imu_sample.acc_sample)};
+    const float acceleration_deviation{std::abs(acceleration.Length() - GRAVITY)};
+
+    const float interval_sec{std::min((imu_sample.gyro_timestamp_usec - last_gyroscope_timestamp_usec_) * 0.000001f, MAX_GYROSCOPE_INTERVAL_SEC)};
+    const bool interval_valid{imu_sample.gyro_timestamp_usec > last_gyroscope_timestamp_usec_};
+    last_gyroscope_timestamp_usec_ = imu_sample.gyro_timestamp_usec;
+
+    if (!up_) {
+        if (acceleration_deviation < STILL_ACCELERATION_TOLERANCE) {
+            const auto up{acceleration.Normalized()};
+            up_ = std::array<float, 3>{up.X, up.Y, up.Z};
+        }
+        return;
+    }
+
+    Samples::Vector up{(*up_)[0], (*up_)[1], (*up_)[2]};
+    // Up stays still while the camera rotates, so it turns against the angular velocity in the depth camera coordinates.
+    if (interval_valid) {
+        const Samples::Vector angular_velocity{rotate(gyroscope_rotation_, imu_sample.gyro_sample)};
+        up = (up - (angular_velocity * up) * interval_sec).Normalized();
+    }
+    if (acceleration_deviation < MOVING_ACCELERATION_TOLERANCE) {
+        const float accelerometer_weight{ACCELEROMETER_WEIGHT * (1.0f - acceleration_deviation / MOVING_ACCELERATION_TOLERANCE)};
+        up = (up * (1.0f - accelerometer_weight) + acceleration.Normalized() * accelerometer_weight).Normalized();
+    }
+
+    up_ = std::array<float, 3>{up.X, up.Y, up.Z};
+}
+
+FloorTracker::PlaneSupport FloorTracker::measure_support(const std::vector<k4a_float3_t>& cloud_points, float elevation) const
+{
+    const Samples::Vector up{(*up_)[0], (*up_)[1], (*up_)[2]};
+    const size_t stride{std::max<size_t>(cloud_points.size() / SAMPLED_POINT_COUNT, 1)};
+
+    PlaneSupport support{0, 0, 0, 0.0f};
+    for (size_t i{0}; i < cloud_points.size(); i += stride) {
+        const float point_elevation{up.Dot(Samples::Vector{cloud_points[i]})};
+        ++support.sampled_count;
+        if (std::abs(point_elevation - elevation) < INLIER_DISTANCE) {
+            ++support.inlier_count;
+            support.inlier_elevation_sum += point_elevation;
+        } else if (point_elevation < elevation - BELOW_DISTANCE) {
+            ++support.below_count;
+        }
+    }
+    return support;
+}
+
+// Since the normal comes from up_, a hypothesis only takes a single point.
+// The floor is the lowest hypothesis with enough inliers and few points below it.
+bool FloorTracker::run_ransac(const std::vector<k4a_float3_t>& cloud_points)
+{
+    const Samples::Vector up{(*up_)[0], (*up_)[1], (*up_)[2]};
+    std::uniform_int_distribution<size_t> distribution{0, cloud_points.size() - 1};
+
+    std::optional<PlaneSupport> best_support;
+    for (int i{0}; i < RANSAC_ITERATION_COUNT; ++i) {
+        const float elevation{up.Dot(Samples::Vector{cloud_points[distribution(random_engine_)]})};
+        // Only lower hypotheses can replace the best one.
+        if (best_support && elevation >= best_support->inlier_elevation_sum / best_support->inlier_count)
+            continue;
+
+        const auto support{measure_support(cloud_points, elevation)};
+        if (support.inlier_count < support.sampled_count * MIN_FLOOR_POINT_RATIO
+            || support.below_count >= support.sampled_count * MIN_FLOOR_POINT_RATIO) {
+            continue;
+        }
+        best_support = support;
+    }
+
+    if (!best_support)
+        return false;
+
+    elevation_ = best_support->inlier_elevation_sum / best_support->inlier_count;
+    reference_inlier_count_ = best_support->inlier_count;
+    return true;
+}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <random>
+#include "native/tt_native.h"
+#include "win32/kh_kinect.h"
+#include "floor_detector.h"
+
+namespace k4a
+{
+struct calibration;
+}
+
+namespace kh
+{
+// Keeps a floor plane across frames instead of detecting it from scratch each frame like FloorDetector.
+// Each frame verifies the plane on a sampled subset of the points and only runs RANSAC when the verification fails.
+// The up vector comes from a complementary filter of the gyroscope and the accelerometer,
+// which keeps it while the Kinect gets handled, when the accelerometer alone would not tell gravity.
+class FloorTracker
+{
+public:
+    FloorTracker(const k4a::calibration& calibration);
+    // Returns the normal and the constant of the plane, in the convention of FloorDetector.
+    std::optional<std::array<float, 4>> track(const std::vector<k4a_float3_t>& cloud_points, const k4a_imu_sample_t& imu_sample);
+    // Whether the last track() kept its plane through the verification instead of running RANSAC.
+    bool verified() const { return verified_; }
+
+private:
+    struct PlaneSupport
+    {
+        int sampled_count;
+        int inlier_count;
+        int below_count;
+        float inlier_elevation_sum;
+    };
+
+    void update_up(const k4a_imu_sample_t& imu_sample);
+    PlaneSupport measure_support(const std::vector<k4a_float3_t>& cloud_points, float elevation) const;
+    bool run_ransac(const std::vector<k4a_float3_t>& cloud_points);
+
+    std::array<float, 9> accelerometer_rotation_;
+    std::array<float, 9> gyroscope_rotation_;
+    std::optional<std::array<float, 3>> up_;
+    uint64_t last_gyroscope_timestamp_usec_;
+    // Elevation of the floor along up_.
+    std::optional<float> elevation_;
+    // Inliers the plane had in the sampled points when RANSAC found it.
+    int reference_inlier_count_;
+    bool verified_;
+    std::mt19937 random_engine_;
+};
+}
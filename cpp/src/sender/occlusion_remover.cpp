@@ -1,5 +1,6 @@
 #include "occlusion_remover.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace kh
@@ -11,28 +12,13 @@ float get_color_camera_x(k4a::calibration calibration)
     return calibration.extrinsics[K4A_CALIBRATION_TYPE_COLOR][K4A_CALIBRATION_TYPE_DEPTH].translation[0];
 }
 
-std::vector<float> compute_unit_depth_x(const k4a::calibration& calibration)
+gsl::span<const float> get_unit_depth_x(const DepthRayTable& depth_ray_table)
 {
-    const int width{calibration.depth_camera_calibration.resolution_width};
-    const int height{calibration.depth_camera_calibration.resolution_height};
+    const auto valid{depth_ray_table.valid()};
+    if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+        throw std::runtime_error("Failed projecting a depth pixel in OcclusionRemover::get_unit_depth_x().");
 
-    std::vector<float> unit_depth_x(gsl::narrow<int>(width * height));
-
-    k4a_float3_t point;
-    for (gsl::index j{0}; j < height; ++j) {
-        for (gsl::index i{0}; i < width; ++i) {
-            if (!calibration.convert_2d_to_3d(k4a_float2_t{gsl::narrow<float>(i), gsl::narrow<float>(j)},
-                                              1.0f,
-                                              K4A_CALIBRATION_TYPE_DEPTH,
-                                              K4A_CALIBRATION_TYPE_DEPTH,
-                                              &point)) {
-                throw std::runtime_error("Failed projecting a depth pixel in OcclusionRemover::compute_unit_depth_x().");
-            }
-            unit_depth_x[i + j * width] = point.xyz.x;
-        }
-    }
-
-    return unit_depth_x;
+    return depth_ray_table.x();
 }
 
 std::vector<float> multiply_vector(const std::vector<float>& v, float multiplier)
@@ -44,11 +30,12 @@ std::vector<float> multiply_vector(const std::vector<float>& v, float multiplier
 }
 }
 
-OcclusionRemover::OcclusionRemover(const k4a::calibration& calibration)
-    : width_{calibration.depth_camera_calibration.resolution_width}
-    , height_{calibration.depth_camera_calibration.resolution_height}
+OcclusionRemover::OcclusionRemover(const k4a::calibration& calibration, std::shared_ptr<const DepthRayTable> depth_ray_table)
+    : width_{depth_ray_table->width()}
+    , height_{depth_ray_table->height()}
     , color_camera_x_{get_color_camera_x(calibration)}
-    , unit_depth_x_{compute_unit_depth_x(calibration)}
+    , depth_ray_table_{std::move(depth_ray_table)}
+    , unit_depth_x_{get_unit_depth_x(*depth_ray_table_)}
 {
 }
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <memory>
 #include "native/tt_native.h"
 #include "win32/kh_kinect.h"
+#include "depth_ray_table.h"
 
 namespace k4a
 {
@@ -13,13 +15,14 @@ namespace kh
 class OcclusionRemover
 {
 public:
-    OcclusionRemover(const k4a::calibration& calibration);
+    OcclusionRemover(const k4a::calibration& calibration, std::shared_ptr<const DepthRayTable> depth_ray_table);
     void remove(gsl::span<int16_t> depth_pixels);
 
 private:
     const int width_;
     const int height_;
     float color_camera_x_;
-    std::vector<float> unit_depth_x_;
+    std::shared_ptr<const DepthRayTable> depth_ray_table_;
+    gsl::span<const float> unit_depth_x_;
 };
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "point_cloud_generator.h"
+
+#include <emmintrin.h>
+
+namespace kh
+{
+namespace
+{
+constexpr float MILLIMETER_TO_METER{0.001f};
+}
+
+PointCloudGenerator::PointCloudGenerator(std::shared_ptr<const DepthRayTable> depth_ray_table)
+    : width_{depth_ray_table->width()}
+    , height_{depth_ray_table->height()}
+    , depth_ray_table_{std::move(depth_ray_table)}
+    , points_{}
+{
+    points_.reserve(width_ * height_);
+}
+
+const std::vector<k4a_float3_t>& PointCloudGenerator::generate(gsl::span<const int16_t> depth_pixels, int step)
+{
+    const auto unit_depth_x{depth_ray_table_->x()};
+    const auto unit_depth_y{depth_ray_table_->y()};
+    const auto valid{depth_ray_table_->valid()};
+    const __m128 millimeter_to_meter{_mm_set1_ps(MILLIMETER_TO_METER)};
+
+    // Cleared instead of resized since points_ has the capacity for every pixel.
+    points_.clear();
+    for (int row{0}; row < height_; row += step) {
+        const int row_offset{row * width_};
+        int col{0};
+        // Four pixels at a time. Their rays are strided like their depth pixels, so both get gathered.
+        for (; col + 3 * step < width_; col += 4 * step) {
+            const int i{row_offset + col};
+            const __m128 depth{_mm_mul_ps(_mm_cvtepi32_ps(_mm_setr_epi32(depth_pixels[i], depth_pixels[i + step],
+                                                                         depth_pixels[i + 2 * step], depth_pixels[i + 3 * step])),
+                                          millimeter_to_meter)};
+            const __m128 ray_x{_mm_setr_ps(unit_depth_x[i], unit_depth_x[i + step], unit_depth_x[i + 2 * step], unit_depth_x[i + 3 * step])};
+            const __m128 ray_y{_mm_setr_ps(unit_depth_y[i], unit_depth_y[i + step], unit_depth_y[i + 2 * step], unit_depth_y[i + 3 * step])};
+
+            alignas(16) float x[4];
+            alignas(16) float y[4];
+            alignas(16) float z[4];
+            _mm_store_ps(x, _mm_mul_ps(ray_x, depth));
+            _mm_store_ps(y, _mm_mul_ps(ray_y, depth));
+            _mm_store_ps(z, depth);
+
+            // Invalid pixels have zero depth or no rays.
+            for (int k{0}; k < 4; ++k) {
+                if (z[k] > 0.0f && valid[i + k * step])
+                    points_.push_back(k4a_float3_t{x[k], y[k], z[k]});
+            }
+        }
+
+        for (; col < width_; col += step) {
+            const int i{row_offset + col};
+            const float z{depth_pixels[i] * MILLIMETER_TO_METER};
+            if (z > 0.0f && valid[i])
+                points_.push_back(k4a_float3_t{unit_depth_x[i] * z, unit_depth_y[i] * z, z});
+        }
+    }
+
+    return points_;
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <memory>
+#include "native/tt_native.h"
+#include "win32/kh_kinect.h"
+#include "depth_ray_table.h"
+
+namespace kh
+{
+// Unprojects sampled depth pixels into points in meters for floor detection.
+// Replaces Samples::PointCloudGenerator, which has the Azure Kinect SDK unproject every pixel into int16 millimeters
+// and then converts the sampled ones to meters.
+// Here, only the sampled pixels get multiplied with the rays of a DepthRayTable,
+// so the points only differ from the SDK ones by the rounding of the SDK to millimeters.
+class PointCloudGenerator
+{
+public:
+    PointCloudGenerator(std::shared_ptr<const DepthRayTable> depth_ray_table);
+    // Returns the points of the valid depth pixels on every step-th row and column.
+    // The points stay valid until the next call, which reuses their memory.
+    const std::vector<k4a_float3_t>& generate(gsl::span<const int16_t> depth_pixels, int step);
+
+private:
+    const int width_;
+    const int height_;
+    std::shared_ptr<const DepthRayTable> depth_ray_table_;
+    std::vector<k4a_float3_t> points_;
+};
+}
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <iostream>
+#include <unordered_map>
 #include "native/tt_native.h"
+#include "sender/remote_receiver_registry.h"
+#include "utils/extension_packets.h"
 
 namespace kh
 {
@@ -13,62 +16,88 @@ struct ConnectPacketInfo
 
 struct ReceiverPacketInfo
 {
-    bool received_any{false};
+    int receiver_id;
     std::vector<tt::ReportReceiverPacket> report_packets;
     std::vector<tt::RequestReceiverPacket> request_packets;
+    bool multicast_join_requested{false};
+    bool keyframe_requested{false};
+    std::optional<int> session_info_ack_version;
 };
 
 struct ReceiverPacketCollection
 {
     std::vector<ConnectPacketInfo> connect_packet_infos;
-    std::map<int, ReceiverPacketInfo> receiver_packet_infos;
+    // Only includes receivers that sent any packet,
+    // so a loop does not cost per receiver without packets.
+    std::vector<ReceiverPacketInfo> receiver_packet_infos;
 };
 
 class ReceiverPacketClassifier
 {
 public:
-    static ReceiverPacketCollection classify(tt::UdpSocket& udp_socket, std::map<int, RemoteReceiver>& remote_receivers)
+    static ReceiverPacketCollection classify(tt::UdpSocket& udp_socket, RemoteReceiverRegistry& remote_receivers)
     {
-        // Prepare ReceiverPacketCollection in regard with the list of RemoteReceivers.
         ReceiverPacketCollection receiver_packet_collection;
-        for (auto& [receiver_id, _] : remote_receivers)
-            receiver_packet_collection.receiver_packet_infos.insert({receiver_id, ReceiverPacketInfo{}});
+        // Key is receiver ID and value is the index in receiver_packet_collection.receiver_packet_infos.
+        std::unordered_map<int, size_t> receiver_packet_info_indices;
 
         // Iterate through all received UDP packets.
         while (auto packet{udp_socket.receive(tt::KH_PACKET_SIZE)}) {
             // After an update with vcpkg, there started to be some zero-length datagrams arriving.
             // Since they were never sent, I suspect this is a bug (or a new feature) from the newer version of asio, but not sure.
             // TODO: Fix this in the right way.
-            if (packet->bytes.size() == 0) {
-                std::cout << "ReceiverPacketClassifier found a zero-length packet.\n";
+            if (packet->bytes.size() < KH_PACKET_HEADER_SIZE) {
+                std::cout << "ReceiverPacketClassifier dropped a packet of " << packet->bytes.size() << " bytes.\n";
                 continue;
             }
 
-            int receiver_id{tt::get_receiver_id_from_receiver_packet_bytes(packet->bytes)};
-            auto packet_type{tt::get_packet_type_from_receiver_packet_bytes(packet->bytes)};
+            try {
+                int receiver_id{tt::get_receiver_id_from_receiver_packet_bytes(packet->bytes)};
+                auto packet_type{tt::get_packet_type_from_receiver_packet_bytes(packet->bytes)};
 
-            // Collect attempts from recievers to connect.
-            if (packet_type == tt::ReceiverPacketType::Connect) {
-                receiver_packet_collection.connect_packet_infos.push_back({packet->endpoint,
-                                                                           tt::read_connect_receiver_packet(packet->bytes)});
-                continue;
-            }
+                // Collect attempts from recievers to connect.
+                if (packet_type == tt::ReceiverPacketType::Connect) {
+                    receiver_packet_collection.connect_packet_infos.push_back({packet->endpoint,
+                                                                               tt::read_connect_receiver_packet(packet->bytes)});
+                    continue;
+                }
 
-            // Skip a packet, not for connection, is not from a reciever already connected.
-            auto receiver_packet_set_it{receiver_packet_collection.receiver_packet_infos.find(receiver_id)};
-            if (receiver_packet_set_it == receiver_packet_collection.receiver_packet_infos.end())
-                continue;
+                // Skip a packet, not for connection, is not from a reciever already connected.
+                if (!remote_receivers.find(receiver_id))
+                    continue;
+
+                auto receiver_packet_info_index_it{receiver_packet_info_indices.find(receiver_id)};
+                if (receiver_packet_info_index_it == receiver_packet_info_indices.end()) {
+                    std::tie(receiver_packet_info_index_it, std::ignore) = receiver_packet_info_indices.insert({receiver_id, receiver_packet_collection.receiver_packet_infos.size()});
+                    receiver_packet_collection.receiver_packet_infos.push_back(ReceiverPacketInfo{receiver_id});
+                }
 
-            receiver_packet_set_it->second.received_any = true;
-            switch (packet_type) {
-            case tt::ReceiverPacketType::Heartbeat:
-                break;
-            case tt::ReceiverPacketType::Report:
-                receiver_packet_set_it->second.report_packets.push_back(tt::read_report_receiver_packet(packet->bytes));
-                break;
-            case tt::ReceiverPacketType::Request:
-                receiver_packet_set_it->second.request_packets.push_back(tt::read_request_receiver_packet(packet->bytes));
-                break;
+                auto& receiver_packet_info{receiver_packet_collection.receiver_packet_infos[receiver_packet_info_index_it->second]};
+                switch (packet_type) {
+                case tt::ReceiverPacketType::Heartbeat:
+                    break;
+                case tt::ReceiverPacketType::Report:
+                    receiver_packet_info.report_packets.push_back(tt::read_report_receiver_packet(packet->bytes));
+                    break;
+                case tt::ReceiverPacketType::Request:
+                    receiver_packet_info.request_packets.push_back(tt::read_request_receiver_packet(packet->bytes));
+                    break;
+                default:
+                    switch (get_extension_receiver_packet_type(packet->bytes)) {
+                    case ExtensionReceiverPacketType::MulticastJoin:
+                        receiver_packet_info.multicast_join_requested = true;
+                        break;
+                    case ExtensionReceiverPacketType::KeyframeRequest:
+                        receiver_packet_info.keyframe_requested = true;
+                        break;
+                    case ExtensionReceiverPacketType::SessionInfoAck:
+                        receiver_packet_info.session_info_ack_version = read_session_info_ack_receiver_packet_version(packet->bytes);
+                        break;
+                    }
+                    break;
+                }
+            } catch (const std::runtime_error& e) {
+                std::cout << "ReceiverPacketClassifier dropped a malformed packet: " << e.what() << "\n";
             }
         }
 
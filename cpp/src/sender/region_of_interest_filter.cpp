@@ -0,0 +1,61 @@
+#include "region_of_interest_filter.h"
+
+namespace kh
+{
+namespace
+{
+void verify_depth_crop(const DepthRayTable& depth_ray_table, const DepthCrop& crop)
+{
+    const int width{depth_ray_table.width()};
+    const int height{depth_ray_table.height()};
+    if (crop.x < 0 || crop.y < 0 || crop.width <= 0 || crop.height <= 0 || crop.x + crop.width > width || crop.y + crop.height > height)
+        throw std::runtime_error("DepthCrop is outside the depth frame.");
+
+    if (crop.x % 2 != 0 || crop.y % 2 != 0 || crop.width % 2 != 0 || crop.height % 2 != 0)
+        throw std::runtime_error("DepthCrop should have even coordinates and sizes for YUV420.");
+}
+}
+
+// Pixels that cannot get unprojected never have valid depth, so their zero rays of DepthRayTable do not matter.
+RegionOfInterestFilter::RegionOfInterestFilter(std::shared_ptr<const DepthRayTable> depth_ray_table, const RegionOfInterest& region_of_interest)
+    : region_of_interest_{region_of_interest}
+    , depth_ray_table_{std::move(depth_ray_table)}
+    , unit_depth_x_{depth_ray_table_->x()}
+    , unit_depth_y_{depth_ray_table_->y()}
+{
+    if (region_of_interest.crop)
+        verify_depth_crop(*depth_ray_table_, *region_of_interest.crop);
+}
+
+int RegionOfInterestFilter::filter(gsl::span<int16_t> depth_pixels, const std::optional<std::array<float, 4>>& floor)
+{
+    constexpr float MILLIMETER_TO_METER{0.001f};
+
+    const float max_abs_x{region_of_interest_.max_abs_x.value_or(std::numeric_limits<float>::max())};
+    // The floor is in meters with its normal pointing upward,
+    // so the height of a point is the dot product with the normal minus the elevation of the floor.
+    const bool floor_applied{floor && region_of_interest_.floor_height_range};
+    const float floor_elevation{floor ? get_floor_elevation(*floor) : 0.0f};
+
+    int invalidated_pixel_count{0};
+    for (size_t i{0}; i < depth_pixels.size(); ++i) {
+        const int16_t depth{depth_pixels[i]};
+        if (depth == 0)
+            continue;
+
+        const float x{unit_depth_x_[i] * depth};
+        bool inside{depth >= region_of_interest_.min_depth && depth <= region_of_interest_.max_depth && std::abs(x) <= max_abs_x};
+        if (inside && floor_applied) {
+            const float y{unit_depth_y_[i] * depth};
+            const float height{((*floor)[0] * x + (*floor)[1] * y + (*floor)[2] * depth) * MILLIMETER_TO_METER - floor_elevation};
+            inside = height >= region_of_interest_.floor_height_range->first && height <= region_of_interest_.floor_height_range->second;
+        }
+
+        if (!inside) {
+            depth_pixels[i] = 0;
+            ++invalidated_pixel_count;
+        }
+    }
+    return invalidated_pixel_count;
+}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <memory>
+#include <optional>
+#include "native/tt_native.h"
+#include "win32/kh_kinect.h"
+#include "depth_ray_table.h"
+#include "floor_detector.h"
+
+namespace kh
+{
+// A rectangle of depth pixels to encode instead of the full frame.
+// Coordinates and sizes are even since the color pixels get encoded in YUV420.
+struct DepthCrop
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// A region of the depth camera space to send, in millimeters.
+struct RegionOfInterest
+{
+    int min_depth{0};
+    int max_depth{std::numeric_limits<int16_t>::max()};
+    // Half of the width of the region around the optical axis of the depth camera.
+    std::optional<float> max_abs_x{};
+    // Heights above the detected floor. Not applied until a floor gets detected.
+    std::optional<std::pair<float, float>> floor_height_range{};
+    std::optional<DepthCrop> crop{};
+};
+
+// Invalidates depth pixels outside a RegionOfInterest.
+// Running this before the mapping also blacks out their color pixels,
+// since colors only get mapped to valid depth pixels.
+class RegionOfInterestFilter
+{
+public:
+    RegionOfInterestFilter(std::shared_ptr<const DepthRayTable> depth_ray_table, const RegionOfInterest& region_of_interest);
+    // Returns the number of invalidated pixels.
+    int filter(gsl::span<int16_t> depth_pixels, const std::optional<std::array<float, 4>>& floor);
+
+private:
+    RegionOfInterest region_of_interest_;
+    std::shared_ptr<const DepthRayTable> depth_ray_table_;
+    gsl::span<const float> unit_depth_x_;
+    gsl::span<const float> unit_depth_y_;
+};
+}
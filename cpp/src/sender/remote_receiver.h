@@ -1,26 +1,45 @@
 #pragma once
 
 #include <unordered_map>
+#include "sender/retransmission_scheduler.h"
 
 namespace kh
 {
 struct RemoteReceiver
 {
-    // The video frame ID before any report from the receiver.
-    const asio::ip::udp::endpoint endpoint;
-    const int receiver_id;
+    // Not const to let RemoteReceiverRegistry move RemoteReceivers inside its vector.
+    asio::ip::udp::endpoint endpoint;
+    int receiver_id;
     bool video_requested;
     bool audio_requested;
+    // Whether video and parity packets reach the receiver through the multicast group instead of unicast.
+    bool multicast;
+    // The version of the SessionInfo the receiver acknowledged.
+    // Receivers without the extension (e.g., KHViewer) never acknowledge.
+    std::optional<int> session_info_version;
+    // Whether the receiver requested video but gets none until it acknowledges the SessionInfo or stops being waited for,
+    // so its handshake does not switch the message format of the others.
+    // Use RemoteReceiverRegistry::release_video() to end this.
+    bool video_held;
+    tt::TimePoint connect_time;
+    // The video frame ID before any report from the receiver.
+    // Use RemoteReceiverRegistry::set_video_frame_id() to update this.
     std::optional<int> video_frame_id;
     tt::TimePoint last_packet_time;
+    RetransmissionScheduler retransmission_scheduler;
 
     RemoteReceiver(asio::ip::udp::endpoint endpoint, int receiver_id, bool video_requested, bool audio_requested)
         : endpoint{endpoint}
         , receiver_id{receiver_id}
         , video_requested{video_requested}
         , audio_requested{audio_requested}
+        , multicast{false}
+        , session_info_version{std::nullopt}
+        , video_held{false}
+        , connect_time{tt::TimePoint::now()}
         , video_frame_id{std::nullopt}
         , last_packet_time{tt::TimePoint::now()}
+        , retransmission_scheduler{}
     {
     }
 };
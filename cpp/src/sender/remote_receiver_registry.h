@@ -0,0 +1,215 @@
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include "sender/remote_receiver.h"
+#include "utils/timer_wheel.h"
+
+namespace kh
+{
+// Keeps RemoteReceivers in a flat vector to serve hundreds of them.
+// Values the sender loop needs from all receivers, such as the minimum video frame ID,
+// are maintained while receivers change instead of getting computed from all receivers every loop.
+// Heartbeats and timeouts are driven by timer wheels, so idle receivers cost nothing per loop.
+class RemoteReceiverRegistry
+{
+public:
+    RemoteReceiverRegistry(float heartbeat_interval_sec, float heartbeat_time_out_sec)
+        : heartbeat_interval_sec_{heartbeat_interval_sec}
+        , heartbeat_time_out_sec_{heartbeat_time_out_sec}
+        , receivers_{}
+        , serials_{}
+        , indices_{}
+        , next_serial_{0}
+        , video_frame_id_counts_{}
+        , video_requested_count_{0}
+        , new_video_receiver_count_{0}
+        , heartbeat_timer_wheel_{TIMER_TICK_SEC, TIMER_SLOT_COUNT}
+        , time_out_timer_wheel_{TIMER_TICK_SEC, TIMER_SLOT_COUNT}
+        , expired_timers_{}
+    {
+    }
+
+    auto begin() { return receivers_.begin(); }
+    auto end() { return receivers_.end(); }
+    size_t size() { return receivers_.size(); }
+    bool empty() { return receivers_.empty(); }
+
+    RemoteReceiver* find(int receiver_id)
+    {
+        auto index_it{indices_.find(receiver_id)};
+        if (index_it == indices_.end())
+            return nullptr;
+
+        return &receivers_[index_it->second];
+    }
+
+    RemoteReceiver& add(RemoteReceiver&& remote_receiver)
+    {
+        const int receiver_id{remote_receiver.receiver_id};
+        if (indices_.find(receiver_id) != indices_.end())
+            throw std::runtime_error("RemoteReceiverRegistry::add() called with an existing receiver_id.");
+
+        if (remote_receiver.video_requested) {
+            ++video_requested_count_;
+            if (!remote_receiver.video_frame_id)
+                ++new_video_receiver_count_;
+        }
+        if (remote_receiver.video_frame_id)
+            ++video_frame_id_counts_[*remote_receiver.video_frame_id];
+
+        const int serial{next_serial_++};
+        indices_.insert({receiver_id, receivers_.size()});
+        receivers_.push_back(std::move(remote_receiver));
+        serials_.push_back(serial);
+
+        heartbeat_timer_wheel_.schedule(ReceiverTimer{receiver_id, serial}, heartbeat_interval_sec_);
+        time_out_timer_wheel_.schedule(ReceiverTimer{receiver_id, serial}, heartbeat_time_out_sec_);
+
+        return receivers_.back();
+    }
+
+    void remove(int receiver_id)
+    {
+        auto index_it{indices_.find(receiver_id)};
+        if (index_it == indices_.end())
+            return;
+
+        const size_t index{index_it->second};
+        auto& remote_receiver{receivers_[index]};
+        if (remote_receiver.video_requested) {
+            --video_requested_count_;
+            if (!remote_receiver.video_frame_id)
+                --new_video_receiver_count_;
+        }
+        if (remote_receiver.video_frame_id)
+            decrement_video_frame_id_count(*remote_receiver.video_frame_id);
+
+        // Fill the hole with the last receiver.
+        // Timers of the removed receiver stay in the wheels and get ignored when they expire.
+        const size_t last_index{receivers_.size() - 1};
+        if (index != last_index) {
+            receivers_[index] = std::move(receivers_[last_index]);
+            serials_[index] = serials_[last_index];
+            indices_[receivers_[index].receiver_id] = index;
+        }
+        receivers_.pop_back();
+        serials_.pop_back();
+        indices_.erase(receiver_id);
+    }
+
+    // video_frame_id of a RemoteReceiver should be updated only through here
+    // to keep min_video_frame_id() up to date.
+    void set_video_frame_id(RemoteReceiver& remote_receiver, int video_frame_id)
+    {
+        if (remote_receiver.video_frame_id) {
+            decrement_video_frame_id_count(*remote_receiver.video_frame_id);
+        } else if (remote_receiver.video_requested) {
+            --new_video_receiver_count_;
+        }
+
+        remote_receiver.video_frame_id = video_frame_id;
+        ++video_frame_id_counts_[video_frame_id];
+    }
+
+    // Lets a held receiver get video as a receiver that requested it.
+    void release_video(RemoteReceiver& remote_receiver)
+    {
+        if (!remote_receiver.video_held)
+            return;
+
+        remote_receiver.video_held = false;
+        remote_receiver.video_requested = true;
+        ++video_requested_count_;
+        if (!remote_receiver.video_frame_id)
+            ++new_video_receiver_count_;
+    }
+
+    int video_requested_count() { return video_requested_count_; }
+
+    // Whether there is a receiver requested video but has not been sent a frame yet.
+    bool has_new_video_receiver() { return new_video_receiver_count_ > 0; }
+
+    std::optional<int> min_video_frame_id()
+    {
+        if (video_frame_id_counts_.empty())
+            return std::nullopt;
+
+        return video_frame_id_counts_.begin()->first;
+    }
+
+    // Collects receivers that are due for a heartbeat and receivers that timed out.
+    // The caller should remove the timed out receivers.
+    void update_timers(std::vector<int>& heartbeat_receiver_ids, std::vector<int>& timed_out_receiver_ids)
+    {
+        expired_timers_.clear();
+        heartbeat_timer_wheel_.advance(expired_timers_);
+        for (auto& timer : expired_timers_) {
+            if (!is_alive(timer))
+                continue;
+
+            heartbeat_receiver_ids.push_back(timer.receiver_id);
+            heartbeat_timer_wheel_.schedule(timer, heartbeat_interval_sec_);
+        }
+
+        expired_timers_.clear();
+        time_out_timer_wheel_.advance(expired_timers_);
+        for (auto& timer : expired_timers_) {
+            if (!is_alive(timer))
+                continue;
+
+            // Instead of rescheduling the timer for every packet,
+            // check the time of the last packet when the timer expires.
+            const float elapsed_sec{find(timer.receiver_id)->last_packet_time.elapsed_time().sec()};
+            if (elapsed_sec > heartbeat_time_out_sec_) {
+                timed_out_receiver_ids.push_back(timer.receiver_id);
+            } else {
+                time_out_timer_wheel_.schedule(timer, heartbeat_time_out_sec_ - elapsed_sec);
+            }
+        }
+    }
+
+private:
+    // The serial tells apart a receiver from a former one with the same receiver_id.
+    struct ReceiverTimer
+    {
+        int receiver_id;
+        int serial;
+    };
+
+    static constexpr float TIMER_TICK_SEC{0.1f};
+    static constexpr int TIMER_SLOT_COUNT{128};
+
+    bool is_alive(const ReceiverTimer& timer)
+    {
+        auto index_it{indices_.find(timer.receiver_id)};
+        if (index_it == indices_.end())
+            return false;
+
+        return serials_[index_it->second] == timer.serial;
+    }
+
+    void decrement_video_frame_id_count(int video_frame_id)
+    {
+        auto count_it{video_frame_id_counts_.find(video_frame_id)};
+        if (--count_it->second == 0)
+            video_frame_id_counts_.erase(count_it);
+    }
+
+    const float heartbeat_interval_sec_;
+    const float heartbeat_time_out_sec_;
+    std::vector<RemoteReceiver> receivers_;
+    // Parallel to receivers_.
+    std::vector<int> serials_;
+    // Key is receiver ID and value is the index in receivers_.
+    std::unordered_map<int, size_t> indices_;
+    int next_serial_;
+    // Key is video frame ID and value is the number of receivers at the frame.
+    std::map<int, int> video_frame_id_counts_;
+    int video_requested_count_;
+    int new_video_receiver_count_;
+    TimerWheel<ReceiverTimer> heartbeat_timer_wheel_;
+    TimerWheel<ReceiverTimer> time_out_timer_wheel_;
+    std::vector<ReceiverTimer> expired_timers_;
+};
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include "native/tt_native.h"
+#include "native/profiler.h"
+#include "sender/video_sender_storage.h"
+
+namespace kh
+{
+// The byte budget each receiver gets for retransmissions.
+// The burst is large enough to resend a whole keyframe at once
+// while the rate keeps a lossy receiver from taking the bandwidth of new frames.
+constexpr float KH_RETRANSMISSION_BYTES_PER_SECOND{1024.0f * 1024.0f};
+constexpr float KH_RETRANSMISSION_BURST_BYTES{128.0f * 1024.0f};
+
+// Packets of a frame that a receiver asked to get resent.
+struct RetransmissionRequest
+{
+    bool all_packets{false};
+    std::set<int> video_packet_indices{};
+    std::set<int> parity_packet_indices{};
+    // Whether this request was already counted as deferred.
+    bool deferred{false};
+};
+
+// Collects RequestReceiverPackets of a receiver and resends the requested packets
+// within a byte budget that refills over time.
+// Requests for the same frame get merged into one and
+// the oldest frame is served first since the receiver needs it before the later ones.
+class RetransmissionScheduler
+{
+public:
+    RetransmissionScheduler()
+        : requests_{}
+        , budget_bytes_{KH_RETRANSMISSION_BURST_BYTES}
+        , last_refill_time_{tt::TimePoint::now()}
+    {
+    }
+
+    void add(const std::vector<tt::RequestReceiverPacket>& request_packets,
+             std::optional<int> receiver_frame_id,
+             tt::Profiler& profiler)
+    {
+        for (auto& request_packet : request_packets) {
+            // A request packet can arrive after a report packet with a later frame_id.
+            if (receiver_frame_id && request_packet.frame_id <= *receiver_frame_id) {
+                profiler.addNumber("retransmit-dropped", 1);
+                continue;
+            }
+
+            auto& request{requests_[request_packet.frame_id]};
+            if (request_packet.all_packets) {
+                request.all_packets = true;
+                continue;
+            }
+
+            request.video_packet_indices.insert(request_packet.video_packet_indices.begin(),
+                                                request_packet.video_packet_indices.end());
+            request.parity_packet_indices.insert(request_packet.parity_packet_indices.begin(),
+                                                 request_packet.parity_packet_indices.end());
+        }
+    }
+
+    void retransmit(tt::UdpSocket& udp_socket,
+                    VideoSenderStorage& video_sender_storage,
+                    std::optional<int> receiver_frame_id,
+                    const asio::ip::udp::endpoint remote_endpoint,
+                    tt::Profiler& profiler)
+    {
+        // Requests for frames that the receiver already moved beyond are obsolete.
+        if (receiver_frame_id) {
+            for (auto it{requests_.begin()}; it != requests_.end() && it->first <= *receiver_frame_id;) {
+                profiler.addNumber("retransmit-dropped", 1);
+                it = requests_.erase(it);
+            }
+        }
+
+        if (requests_.empty())
+            return;
+
+        budget_bytes_ = std::min(budget_bytes_ + last_refill_time_.elapsed_time().sec() * KH_RETRANSMISSION_BYTES_PER_SECOND,
+                                 KH_RETRANSMISSION_BURST_BYTES);
+        last_refill_time_ = tt::TimePoint::now();
+
+        // Key of requests_ is frame ID, so this iterates from the oldest frame.
+        auto request_it{requests_.begin()};
+        while (request_it != requests_.end()) {
+            auto video_frame_packets_it{video_sender_storage.find(request_it->first)};
+            if (video_frame_packets_it == video_sender_storage.end()) {
+                // The frame got cleaned up from the storage.
+                profiler.addNumber("retransmit-dropped", 1);
+                request_it = requests_.erase(request_it);
+                continue;
+            }
+
+            auto& request{request_it->second};
+            auto& video_frame_packets{video_frame_packets_it->second};
+            if (request.all_packets) {
+                for (int i{0}; i < video_frame_packets.video_packets.size(); ++i)
+                    request.video_packet_indices.insert(i);
+                for (int i{0}; i < video_frame_packets.parity_packets.size(); ++i)
+                    request.parity_packet_indices.insert(i);
+                request.all_packets = false;
+            }
+
+            if (!send_packets(udp_socket, video_frame_packets.video_packets, request.video_packet_indices,
+                              remote_endpoint, "retransmit-video", profiler))
+                break;
+
+            if (!send_packets(udp_socket, video_frame_packets.parity_packets, request.parity_packet_indices,
+                              remote_endpoint, "retransmit-parity", profiler))
+                break;
+
+            // Packets that are not in the storage yet are left in the request.
+            if (!request.video_packet_indices.empty() || !request.parity_packet_indices.empty()) {
+                ++request_it;
+                continue;
+            }
+
+            profiler.addNumber("retransmit-frame", 1);
+            request_it = requests_.erase(request_it);
+        }
+
+        // Requests left are deferred to later calls when the budget refills.
+        for (; request_it != requests_.end(); ++request_it) {
+            if (!request_it->second.deferred) {
+                request_it->second.deferred = true;
+                profiler.addNumber("retransmit-deferred", 1);
+            }
+        }
+    }
+
+private:
+    // Returns false when the budget ran out before sending all packets.
+    bool send_packets(tt::UdpSocket& udp_socket,
+                      std::vector<tt::Packet>& packets,
+                      std::set<int>& packet_indices,
+                      const asio::ip::udp::endpoint remote_endpoint,
+                      const char* profiler_name,
+                      tt::Profiler& profiler)
+    {
+        for (auto it{packet_indices.begin()}; it != packet_indices.end();) {
+            // Ignore indices that cannot be from this frame.
+            if (*it < 0 || *it >= packets.size()) {
+                it = packet_indices.erase(it);
+                continue;
+            }
+
+            auto& packet{packets[*it]};
+            // An empty packet is one a relay is still waiting for from its upstream sender.
+            if (packet.bytes.empty()) {
+                ++it;
+                continue;
+            }
+
+            if (packet.bytes.size() > budget_bytes_)
+                return false;
+
+            udp_socket.send(packet.bytes, remote_endpoint);
+            budget_bytes_ -= packet.bytes.size();
+            profiler.addNumber(profiler_name, 1);
+            profiler.addNumber("retransmit-byte", packet.bytes.size());
+            it = packet_indices.erase(it);
+        }
+
+        return true;
+    }
+
+    // Key is frame ID.
+    std::map<int, RetransmissionRequest> requests_;
+    float budget_bytes_;
+    tt::TimePoint last_refill_time_;
+};
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdlib>
+#include "win32/kh_kinect.h"
+
+namespace kh
+{
+// Tells whether a Kinect frame differs from the last frame that got sent,
+// by comparing depth and luma samples on coarse grids of the frames.
+// A depth sample changes like a TRVL pixel does, by going beyond the change threshold or switching validity.
+class SceneChangeDetector
+{
+public:
+    // Sampling every 8th depth pixel and every 16th color pixel in both directions.
+    static constexpr int DEPTH_SAMPLE_STEP{8};
+    static constexpr int COLOR_SAMPLE_STEP{16};
+    static constexpr int DEPTH_CHANGE_THRESHOLD{30};
+    static constexpr int LUMA_CHANGE_THRESHOLD{12};
+    // A scene changes when more than this ratio of either samples changes.
+    static constexpr float CHANGED_SAMPLE_RATIO{0.005f};
+
+    SceneChangeDetector()
+        : reference_depth_samples_{}
+        , reference_luma_samples_{}
+        , depth_samples_{}
+        , luma_samples_{}
+    {
+    }
+
+    bool detect(const KinectFrame& kinect_frame)
+    {
+        sample_depth(kinect_frame.depth_image);
+        sample_luma(kinect_frame.color_image);
+
+        // Without a reference, e.g., for the first frame, the scene counts as changed.
+        if (depth_samples_.size() != reference_depth_samples_.size() || luma_samples_.size() != reference_luma_samples_.size())
+            return true;
+
+        int changed_depth_sample_count{0};
+        for (size_t i{0}; i < depth_samples_.size(); ++i) {
+            const int16_t depth{depth_samples_[i]};
+            const int16_t reference_depth{reference_depth_samples_[i]};
+            const bool validity_changed{(depth == 0) != (reference_depth == 0)};
+            changed_depth_sample_count += (validity_changed || std::abs(depth - reference_depth) > DEPTH_CHANGE_THRESHOLD) ? 1 : 0;
+        }
+
+        int changed_luma_sample_count{0};
+        for (size_t i{0}; i < luma_samples_.size(); ++i)
+            changed_luma_sample_count += std::abs(luma_samples_[i] - reference_luma_samples_[i]) > LUMA_CHANGE_THRESHOLD ? 1 : 0;
+
+        return changed_depth_sample_count > depth_samples_.size() * CHANGED_SAMPLE_RATIO ||
+               changed_luma_sample_count > luma_samples_.size() * CHANGED_SAMPLE_RATIO;
+    }
+
+    // Makes the frame of the last detect() the reference, which should happen when the frame gets sent.
+    void update()
+    {
+        std::swap(reference_depth_samples_, depth_samples_);
+        std::swap(reference_luma_samples_, luma_samples_);
+    }
+
+private:
+    void sample_depth(const k4a::image& depth_image)
+    {
+        const int width{depth_image.get_width_pixels()};
+        const int height{depth_image.get_height_pixels()};
+        const auto depth_pixels{reinterpret_cast<const int16_t*>(depth_image.get_buffer())};
+
+        depth_samples_.clear();
+        for (int row{0}; row < height; row += DEPTH_SAMPLE_STEP) {
+            for (int col{0}; col < width; col += DEPTH_SAMPLE_STEP)
+                depth_samples_.push_back(depth_pixels[row * width + col]);
+        }
+    }
+
+    // Luma gets approximated as (B + 2G + R) / 4 from BGRA pixels.
+    void sample_luma(const k4a::image& color_image)
+    {
+        const int width{color_image.get_width_pixels()};
+        const int height{color_image.get_height_pixels()};
+        const int stride{color_image.get_stride_bytes()};
+        const uint8_t* color_buffer{color_image.get_buffer()};
+
+        luma_samples_.clear();
+        for (int row{0}; row < height; row += COLOR_SAMPLE_STEP) {
+            for (int col{0}; col < width; col += COLOR_SAMPLE_STEP) {
+                const uint8_t* bgra{color_buffer + row * stride + col * 4};
+                luma_samples_.push_back(static_cast<int16_t>((bgra[0] + 2 * bgra[1] + bgra[2]) / 4));
+            }
+        }
+    }
+
+    std::vector<int16_t> reference_depth_samples_;
+    std::vector<int16_t> reference_luma_samples_;
+    std::vector<int16_t> depth_samples_;
+    std::vector<int16_t> luma_samples_;
+};
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "native/profiler.h"
+#include "sender/remote_receiver_registry.h"
+
+namespace kh
+{
+// Sends the video and parity packets of a frame to every receiver requesting video,
+// once per receiver with unicast and once for all receivers in the multicast group.
+// Receivers get their video_frame_id set with their first frame.
+inline void fan_out_video_packets(const std::vector<tt::Packet*>& packet_ptrs,
+                                  int frame_id,
+                                  tt::UdpSocket& udp_socket,
+                                  std::optional<asio::ip::udp::endpoint> multicast_endpoint,
+                                  RemoteReceiverRegistry& remote_receivers,
+                                  tt::Profiler& profiler)
+{
+    bool multicast_requested{false};
+    for (auto& remote_receiver : remote_receivers) {
+        if (!remote_receiver.video_requested)
+            continue;
+
+        if (remote_receiver.multicast) {
+            multicast_requested = true;
+        } else {
+            for (auto& packet_bytes_ptr : packet_ptrs) {
+                udp_socket.send(packet_bytes_ptr->bytes, remote_receiver.endpoint);
+                profiler.addNumber("send-video-byte", packet_bytes_ptr->bytes.size());
+            }
+        }
+
+        // Make video_frame_id no longer a std::nullopt so it won't get the
+        // intialization privilege again.
+        if (!remote_receiver.video_frame_id)
+            remote_receivers.set_video_frame_id(remote_receiver, frame_id - 1);
+    }
+
+    // Receivers in the multicast group share one copy of the packets.
+    if (multicast_requested) {
+        for (auto& packet_bytes_ptr : packet_ptrs) {
+            udp_socket.send(packet_bytes_ptr->bytes, *multicast_endpoint);
+            profiler.addNumber("send-video-byte", packet_bytes_ptr->bytes.size());
+        }
+    }
+}
+}
@@ -7,59 +7,129 @@ namespace kh
 {
 namespace
 {
-tt::Vp8Encoder create_color_encoder(k4a::calibration calibration)
+std::optional<DepthCrop> get_depth_crop(const VideoPipelineOptions& options)
 {
-    return tt::Vp8Encoder{calibration.depth_camera_calibration.resolution_width,
-                          calibration.depth_camera_calibration.resolution_height};
+    return options.region_of_interest ? options.region_of_interest->crop : std::nullopt;
 }
 
-tt::TrvlEncoder create_depth_encoder(k4a::calibration calibration)
+void crop_depth_pixels(gsl::span<const int16_t> depth_pixels, int width, const DepthCrop& crop, gsl::span<int16_t> cropped_depth_pixels)
 {
-    constexpr short CHANGE_THRESHOLD{10};
-    //constexpr int INVALID_THRESHOLD{2};
-    // Tolerating invalid pixels leaves black colored points left when combined with RGBD mapping.
-    constexpr int INVALID_THRESHOLD{1};
-
-    return tt::TrvlEncoder{calibration.depth_camera_calibration.resolution_width *
-                           calibration.depth_camera_calibration.resolution_height,
-                           CHANGE_THRESHOLD, INVALID_THRESHOLD};
+    for (int row{0}; row < crop.height; ++row) {
+        const auto source{depth_pixels.subspan((crop.y + row) * width + crop.x, crop.width)};
+        std::copy(source.begin(), source.end(), cropped_depth_pixels.begin() + row * crop.width);
+    }
 }
 
-std::optional<std::array<float, 4>> detect_floor_plane_from_kinect_frame(Samples::PointCloudGenerator& point_cloud_generator,
-                                                                         KinectFrame kinect_frame,
-                                                                         k4a::calibration calibration)
+// Quantized depth pixels have their own change threshold since they are in codes instead of millimeters.
+TiledTrvlEncoder create_tiled_depth_encoder(int width, int height, DepthQuantization depth_quantization)
+{
+    return TiledTrvlEncoder{width, height,
+                            depth_quantization == DepthQuantization::None ? TRVL_CHANGE_THRESHOLD : KH_QUANTIZED_TRVL_CHANGE_THRESHOLD,
+                            TRVL_INVALID_THRESHOLD};
+}
+
+std::optional<std::array<float, 4>> detect_floor_plane_from_kinect_frame(PointCloudGenerator& point_cloud_generator,
+                                                                         FloorDetector& floor_detector,
+                                                                         std::optional<FloorTracker>& floor_tracker,
+                                                                         const KinectFrame& kinect_frame,
+                                                                         gsl::span<const int16_t> depth_pixels)
 {
     constexpr int DOWNSAMPLE_STEP{2};
     constexpr size_t MINIMUM_FLOOR_POINT_COUNT{1024 / (DOWNSAMPLE_STEP * DOWNSAMPLE_STEP)};
 
-    point_cloud_generator.Update(kinect_frame.depth_image.handle());
-    auto cloud_points{point_cloud_generator.GetCloudPoints(DOWNSAMPLE_STEP)};
-    auto floor_plane{Samples::FloorDetector::TryDetectFloorPlane(cloud_points, kinect_frame.imu_sample, calibration, MINIMUM_FLOOR_POINT_COUNT)};
-    
-    if (!floor_plane)
-        return std::nullopt;
+    const auto& cloud_points{point_cloud_generator.generate(depth_pixels, DOWNSAMPLE_STEP)};
+    if (floor_tracker)
+        return floor_tracker->track(cloud_points, kinect_frame.imu_sample);
 
-    return std::array<float, 4>{floor_plane->Normal.X, floor_plane->Normal.Y, floor_plane->Normal.Z, floor_plane->C};
+    return floor_detector.detect(cloud_points, kinect_frame.imu_sample, MINIMUM_FLOOR_POINT_COUNT);
+}
 }
+
+tt::KinectIntrinsics crop_kinect_intrinsics(const tt::KinectIntrinsics& intrinsics, const DepthCrop& crop)
+{
+    tt::KinectIntrinsics cropped_intrinsics{intrinsics};
+    cropped_intrinsics.cx -= crop.x;
+    cropped_intrinsics.cy -= crop.y;
+    return cropped_intrinsics;
 }
 
 // Color encoder also uses the depth width/height since color pixels get transformed to the depth camera.
-VideoPipeline::VideoPipeline(k4a::calibration calibration)
+VideoPipeline::VideoPipeline(k4a::calibration calibration, const VideoPipelineOptions& options)
     : calibration_{calibration}
     , transformation_{calibration}
-    , color_encoder_{create_color_encoder(calibration)}
-    , depth_encoder_{create_depth_encoder(calibration)}
-    , occlusion_remover_{calibration_}
-    , point_cloud_generator_{calibration_}
+    , depth_ray_table_{DepthRayTable::create(calibration, options.depth_ray_table_folder_path)}
+    , crop_{get_depth_crop(options)}
+    , width_{crop_ ? crop_->width : calibration.depth_camera_calibration.resolution_width}
+    , height_{crop_ ? crop_->height : calibration.depth_camera_calibration.resolution_height}
+    , vp8_profile_{options.vp8_profile}
+    , vp9_profile_{options.vp9_profile}
+    , color_encoders_{}
+    , last_color_codec_{ColorCodec::Vp8}
+    , depth_encoder_{width_ * height_, TRVL_CHANGE_THRESHOLD, TRVL_INVALID_THRESHOLD}
+    , tiled_depth_encoders_{}
+    , last_depth_codec_{DepthCodec::Trvl}
+    , last_depth_quantization_{DepthQuantization::None}
+    , intra_refresh_{options.intra_refresh}
+    , next_refreshed_stripe_index_{0}
+    , depth_quantizer_{}
+    , depth_codes_(width_ * height_)
+    , occlusion_remover_{calibration_, depth_ray_table_}
+    , depth_denoiser_{}
+    , depth_masked_color_{options.depth_masked_color}
+    , region_of_interest_filter_{}
+    , cropped_depth_pixels_(crop_ ? width_ * height_ : 0)
+    , last_floor_{}
+    , point_cloud_generator_{depth_ray_table_}
+    , floor_detector_{calibration_}
+    , floor_tracker_{}
     , last_frame_id_{-1}
     , last_frame_time_{tt::TimePoint::now()}
 {
+    if (options.depth_denoising)
+        depth_denoiser_.emplace(calibration.depth_camera_calibration.resolution_width * calibration.depth_camera_calibration.resolution_height);
+
+    if (options.region_of_interest)
+        region_of_interest_filter_.emplace(depth_ray_table_, *options.region_of_interest);
+
+    if (options.floor_tracking)
+        floor_tracker_.emplace(calibration_);
 }
 
 VideoPipelineFrame VideoPipeline::process(KinectFrame& kinect_frame,
                                           bool keyframe,
+                                          ColorCodec color_codec,
+                                          DepthCodec depth_codec,
+                                          DepthQuantization depth_quantization,
                                           tt::Profiler& profiler)
 {
+    if (depth_codec == DepthCodec::Trvl && depth_quantization != DepthQuantization::None)
+        throw std::runtime_error("Depth quantization requires a tiled TRVL codec.");
+
+    if (color_codec != last_color_codec_) {
+        keyframe = true;
+        last_color_codec_ = color_codec;
+    }
+
+    auto& color_encoder{color_encoders_[color_codec]};
+    if (!color_encoder) {
+        const bool vp9{color_codec == ColorCodec::Vp9 || color_codec == ColorCodec::TiledVp9};
+        color_encoder = create_color_encoder(color_codec, width_, height_, vp9 ? vp9_profile_ : vp8_profile_);
+    }
+
+    if (depth_codec != last_depth_codec_) {
+        keyframe = true;
+        last_depth_codec_ = depth_codec;
+    }
+
+    if (depth_quantization != last_depth_quantization_) {
+        keyframe = true;
+        last_depth_quantization_ = depth_quantization;
+    }
+
+    auto tiled_depth_encoder_it{tiled_depth_encoders_.find(depth_quantization)};
+    if (depth_codec != DepthCodec::Trvl && tiled_depth_encoder_it == tiled_depth_encoders_.end())
+        tiled_depth_encoder_it = tiled_depth_encoders_.emplace(depth_quantization, create_tiled_depth_encoder(width_, height_, depth_quantization)).first;
+
     gsl::span<int16_t> depth_image_span{reinterpret_cast<int16_t*>(kinect_frame.depth_image.get_buffer()),
                                         kinect_frame.depth_image.get_size()};
 
@@ -72,40 +142,103 @@ VideoPipelineFrame VideoPipeline::process(KinectFrame& kinect_frame,
     occlusion_remover_.remove(depth_image_span);
     profiler.addNumber("pipeline-occlusion", occlusion_removal_start.elapsed_time().ms());
 
+    // Filter depth pixels before the mapping to keep color pixels mapped with the depth pixels that get sent.
+    if (depth_denoiser_) {
+        const auto denoising_start{tt::TimePoint::now()};
+        const int delayed_pixel_count{depth_denoiser_->denoise(depth_image_span)};
+        profiler.addNumber("pipeline-denoise", denoising_start.elapsed_time().ms());
+        profiler.addNumber("pipeline-denoise-delayed", delayed_pixel_count);
+    }
+
+    // Detect the floor before the filter, which can invalidate the floor pixels themselves
+    // when the region starts above the floor, and would leave a higher surface to get detected as the floor.
+    const auto floor_start{tt::TimePoint::now()};
+    const auto floor{detect_floor_plane_from_kinect_frame(point_cloud_generator_, floor_detector_, floor_tracker_, kinect_frame, depth_image_span)};
+    profiler.addNumber("pipeline-floor", floor_start.elapsed_time().ms());
+    if (floor_tracker_)
+        profiler.addNumber("pipeline-floor-verified", floor_tracker_->verified() ? 1 : 0);
+    // Kept when detection fails, so the region stays anchored to the last floor.
+    if (floor)
+        last_floor_ = floor;
+
+    // Also before the mapping, so color pixels outside the region stay black.
+    if (region_of_interest_filter_) {
+        const auto region_of_interest_start{tt::TimePoint::now()};
+        const int invalidated_pixel_count{region_of_interest_filter_->filter(depth_image_span, last_floor_)};
+        profiler.addNumber("pipeline-roi", region_of_interest_start.elapsed_time().ms());
+        profiler.addNumber("pipeline-roi-invalidated", invalidated_pixel_count);
+    }
+
     // Map color pixels to depth pixels.
     auto transformation_start{tt::TimePoint::now()};
-    const auto color_image_from_depth_camera{transformation_.color_image_to_depth_camera(kinect_frame.depth_image, kinect_frame.color_image)};
+    auto color_image_from_depth_camera{transformation_.color_image_to_depth_camera(kinect_frame.depth_image, kinect_frame.color_image)};
     profiler.addNumber("pipeline-mapping", transformation_start.elapsed_time().ms());
 
+    if (depth_masked_color_) {
+        const auto color_fill_start{tt::TimePoint::now()};
+        const int filled_pixel_count{fill_color_pixels_without_depth(color_image_from_depth_camera.get_buffer(),
+                                                                     color_image_from_depth_camera.get_stride_bytes(),
+                                                                     depth_image_span,
+                                                                     calibration_.depth_camera_calibration.resolution_width,
+                                                                     calibration_.depth_camera_calibration.resolution_height)};
+        profiler.addNumber("pipeline-colorfill", color_fill_start.elapsed_time().ms());
+        profiler.addNumber("pipeline-colorfill-pixel", filled_pixel_count);
+    }
+
     // Convert Kinect color pixels from BGRA to YUV420 for VP8.
+    // A crop only needs an offset to the buffer since the stride stays the same.
     const auto yuv_conversion_start{tt::TimePoint::now()};
-    const auto yuv_image{tt::YuvFrame::createFromAzureKinectBgraBuffer(color_image_from_depth_camera.get_buffer(),
-                                                                       color_image_from_depth_camera.get_width_pixels(),
-                                                                       color_image_from_depth_camera.get_height_pixels(),
-                                                                       color_image_from_depth_camera.get_stride_bytes())};
+    const int color_stride{color_image_from_depth_camera.get_stride_bytes()};
+    const int color_offset{crop_ ? crop_->y * color_stride + crop_->x * 4 : 0};
+    const auto yuv_image{tt::YuvFrame::createFromAzureKinectBgraBuffer(color_image_from_depth_camera.get_buffer() + color_offset,
+                                                                       width_, height_, color_stride)};
     profiler.addNumber("pipeline-yuv", yuv_conversion_start.elapsed_time().ms());
 
-    // VP8 compress color pixels.
+    // VP8 or VP9 compress color pixels.
     const auto color_encoder_start{tt::TimePoint::now()};
-    const auto vp8_frame{color_encoder_.encode(yuv_image, keyframe)};
+    const auto vp8_frame{color_encoder->encode(yuv_image, keyframe)};
     profiler.addNumber("pipeline-vp8", color_encoder_start.elapsed_time().ms());
 
+    // Crop and quantize depth pixels into separate buffers.
+    gsl::span<int16_t> depth_encoder_span{depth_image_span};
+    if (crop_) {
+        crop_depth_pixels(depth_image_span, calibration_.depth_camera_calibration.resolution_width, *crop_, cropped_depth_pixels_);
+        depth_encoder_span = cropped_depth_pixels_;
+    }
+
+    if (depth_quantization != DepthQuantization::None) {
+        const auto depth_quantization_start{tt::TimePoint::now()};
+        depth_quantizer_.quantize(depth_encoder_span, depth_codes_);
+        depth_encoder_span = depth_codes_;
+        profiler.addNumber("pipeline-quantization", depth_quantization_start.elapsed_time().ms());
+    }
+
+    // Keyframes refresh every stripe, so only other frames take a turn.
+    std::optional<int> refreshed_stripe_index;
+    if (intra_refresh_ && depth_codec != DepthCodec::Trvl && !keyframe) {
+        refreshed_stripe_index = next_refreshed_stripe_index_;
+        next_refreshed_stripe_index_ = (next_refreshed_stripe_index_ + 1) % tiled_depth_encoder_it->second.stripe_count();
+    }
+
     // TRVL compress depth pixels.
     const auto depth_encoder_start{tt::TimePoint::now()};
-    const auto trvl_frame{depth_encoder_.encode(depth_image_span, keyframe)};
+    const auto trvl_frame{depth_codec == DepthCodec::Trvl ? depth_encoder_.encode(depth_encoder_span, keyframe)
+                                                          : tiled_depth_encoder_it->second.encode(depth_encoder_span, keyframe,
+                                                                                                  depth_codec == DepthCodec::TiledTrvlZstd ? std::optional<int>{KH_TILED_TRVL_ZSTD_LEVEL}
+                                                                                                                                           : std::nullopt,
+                                                                                                  refreshed_stripe_index)};
     profiler.addNumber("pipeline-trvl", depth_encoder_start.elapsed_time().ms());
 
-    // Try obtaining floor.
-    const auto floor_start{tt::TimePoint::now()};
-    const auto floor{detect_floor_plane_from_kinect_frame(point_cloud_generator_, kinect_frame, calibration_)};
-    profiler.addNumber("pipeline-floor", depth_encoder_start.elapsed_time().ms());
-
     // Updating variables for profiling.
     profiler.addNumber("pipeline-frame", 1);
     profiler.addNumber("pipeline-keyframe", keyframe ? 1 : 0);
     profiler.addNumber("pipeline-vp8byte", vp8_frame.size());
     profiler.addNumber("pipeline-trvlbyte", trvl_frame.size());
+    // For the variance of frame sizes, which keyframes raise and intra refresh lowers.
+    const float frame_kilobytes{(vp8_frame.size() + trvl_frame.size()) / 1024.0f};
+    profiler.addNumber("pipeline-framekilobyte", frame_kilobytes);
+    profiler.addNumber("pipeline-framekilobyte-squared", frame_kilobytes * frame_kilobytes);
 
-    return VideoPipelineFrame{last_frame_id_, kinect_frame.time_point, keyframe, vp8_frame, trvl_frame, floor};
+    return VideoPipelineFrame{last_frame_id_, kinect_frame.time_point, keyframe, color_codec, depth_codec, depth_quantization, vp8_frame, trvl_frame, floor};
 }
 }
\ No newline at end of file
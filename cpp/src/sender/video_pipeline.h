@@ -1,43 +1,116 @@
 #pragma once
 
+#include <map>
 #include "native/tt_native.h"
 #include "native/profiler.h"
+#include "color_encoder.h"
+#include "depth_denoiser.h"
+#include "depth_masked_color.h"
+#include "depth_ray_table.h"
+#include "floor_detector.h"
+#include "floor_tracker.h"
 #include "occlusion_remover.h"
+#include "point_cloud_generator.h"
+#include "region_of_interest_filter.h"
 #include "win32/kh_kinect.h"
-
-// These header files are from a Microsoft's Azure Kinect sample project.
-#include "external/PointCloudGenerator.h"
-#include "external/FloorDetector.h"
+#include "utils/depth_quantizer.h"
+#include "utils/extension_packets.h"
+#include "utils/tiled_trvl.h"
 
 namespace kh
 {
+// Parameters of the TRVL depth encoders.
+constexpr short TRVL_CHANGE_THRESHOLD{10};
+//constexpr int TRVL_INVALID_THRESHOLD{2};
+// Tolerating invalid pixels leaves black colored points left when combined with RGBD mapping.
+constexpr int TRVL_INVALID_THRESHOLD{1};
+
 struct VideoPipelineFrame
 {
     int frame_id{0};
     tt::TimePoint time_point{};
     bool keyframe{false};
+    ColorCodec color_codec{ColorCodec::Vp8};
+    DepthCodec depth_codec{DepthCodec::Trvl};
+    DepthQuantization depth_quantization{DepthQuantization::None};
     std::vector<std::byte> vp8_frame{};
     std::vector<std::byte> trvl_frame{};
     std::optional<std::array<float, 4>> floor{};
 };
 
+struct VideoPipelineOptions
+{
+    // Depth pixels get temporally filtered before the color mapping and the encoders.
+    bool depth_denoising{false};
+    // Color pixels without valid depth get filled with neighboring colors before VP8 encoding.
+    bool depth_masked_color{false};
+    // Depth pixels outside get invalidated and, with a crop, only the pixels inside it get encoded.
+    std::optional<RegionOfInterest> region_of_interest{};
+    // libvpx settings of each color codec. Without one, create_color_encoder() picks the default.
+    std::optional<ColorEncoderProfile> vp8_profile{};
+    std::optional<ColorEncoderProfile> vp9_profile{};
+    // Tiled TRVL frames refresh a stripe each in turns, which a receiver skipping frames needs to recover without keyframes.
+    // Tiled color encoders refresh a stripe each through the intra_refresh of their profile.
+    bool intra_refresh{false};
+    // The floor plane gets kept across frames and verified each frame instead of getting detected from scratch.
+    bool floor_tracking{false};
+    // The folder of the DepthRayTable cache files. Without one, the table gets computed at each launch.
+    std::optional<std::string> depth_ray_table_folder_path{};
+};
+
+// Returns the intrinsics of the pixels inside a crop, which only differ in their principal point.
+// This lets receivers unproject cropped frames without knowing about the crop.
+tt::KinectIntrinsics crop_kinect_intrinsics(const tt::KinectIntrinsics& intrinsics, const DepthCrop& crop);
+
 class VideoPipeline
 {
 public:
     // Color encoder also uses the depth width/height since color pixels get transformed to the depth camera.
-    VideoPipeline(k4a::calibration calibration);
+    VideoPipeline(k4a::calibration calibration, const VideoPipelineOptions& options);
+    // The size of encoded frames, which is smaller than the depth camera resolution with a crop.
+    int width() { return width_; }
+    int height() { return height_; }
     int last_frame_id() { return last_frame_id_; }
     tt::TimePoint last_frame_time() { return last_frame_time_; }
+    // Whether the DepthRayTable got mapped from a cache file instead of getting computed.
+    bool depth_ray_table_mapped() { return depth_ray_table_->mapped(); }
+    // Switching codecs or depth_quantization makes the frame a keyframe since encoders of different codecs do not share their previous frames.
+    // Encoders stay alive once created, so switching back does not create them again.
+    // Depth quantization requires a tiled TRVL codec.
     VideoPipelineFrame process(KinectFrame& kinect_frame,
                                bool keyframe,
+                               ColorCodec color_codec,
+                               DepthCodec depth_codec,
+                               DepthQuantization depth_quantization,
                                tt::Profiler& profiler);
 private:
     k4a::calibration calibration_;
     k4a::transformation transformation_;
-    tt::Vp8Encoder color_encoder_;
+    std::shared_ptr<const DepthRayTable> depth_ray_table_;
+    std::optional<DepthCrop> crop_;
+    int width_;
+    int height_;
+    std::optional<ColorEncoderProfile> vp8_profile_;
+    std::optional<ColorEncoderProfile> vp9_profile_;
+    std::map<ColorCodec, std::unique_ptr<ColorEncoder>> color_encoders_;
+    ColorCodec last_color_codec_;
     tt::TrvlEncoder depth_encoder_;
+    std::map<DepthQuantization, TiledTrvlEncoder> tiled_depth_encoders_;
+    DepthCodec last_depth_codec_;
+    DepthQuantization last_depth_quantization_;
+    bool intra_refresh_;
+    int next_refreshed_stripe_index_;
+    DepthQuantizer depth_quantizer_;
+    std::vector<int16_t> depth_codes_;
     OcclusionRemover occlusion_remover_;
-    Samples::PointCloudGenerator point_cloud_generator_;
+    std::optional<DepthDenoiser> depth_denoiser_;
+    bool depth_masked_color_;
+    std::optional<RegionOfInterestFilter> region_of_interest_filter_;
+    std::vector<int16_t> cropped_depth_pixels_;
+    std::optional<std::array<float, 4>> last_floor_;
+    PointCloudGenerator point_cloud_generator_;
+    FloorDetector floor_detector_;
+    std::optional<FloorTracker> floor_tracker_;
     int last_frame_id_;
     tt::TimePoint last_frame_time_;
 };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <tuple>
+#include <unordered_map>
 #include "native/tt_native.h"
 
 namespace kh
@@ -28,11 +30,29 @@ public:
         video_frame_packets_.insert({frame_id, VideoFramePackets(std::move(video_packets), std::move(parity_packets))});
     }
 
+    // For a relay receiving packets one by one from its upstream sender.
+    // Packets not received yet are left empty, and RetransmissionScheduler waits for them.
+    // Returns false for a duplicate or invalid packet.
+    bool add_video_packet(int frame_id, int packet_index, int video_packet_count, tt::Packet&& video_packet)
+    {
+        return set_packet(find_or_add(frame_id, video_packet_count).video_packets, packet_index, std::move(video_packet));
+    }
+
+    bool add_parity_packet(int frame_id, int packet_index, int video_packet_count, tt::Packet&& parity_packet)
+    {
+        return set_packet(find_or_add(frame_id, video_packet_count).parity_packets, packet_index, std::move(parity_packet));
+    }
+
     auto find(int frame_id)
     {
         return video_frame_packets_.find(frame_id);
     }
 
+    auto begin()
+    {
+        return video_frame_packets_.begin();
+    }
+
     auto end()
     {
         return video_frame_packets_.end();
@@ -50,6 +70,27 @@ public:
     }
 
 private:
+    VideoFramePackets& find_or_add(int frame_id, int video_packet_count)
+    {
+        auto video_frame_packets_it{video_frame_packets_.find(frame_id)};
+        if (video_frame_packets_it == video_frame_packets_.end()) {
+            // A parity packet covers tt::KH_FEC_GROUP_SIZE video packets.
+            const int parity_packet_count{(video_packet_count - 1) / tt::KH_FEC_GROUP_SIZE + 1};
+            std::tie(video_frame_packets_it, std::ignore) = video_frame_packets_.insert({frame_id, VideoFramePackets(std::vector<tt::Packet>(video_packet_count, tt::Packet{0}),
+                                                                                                                   std::vector<tt::Packet>(parity_packet_count, tt::Packet{0}))});
+        }
+        return video_frame_packets_it->second;
+    }
+
+    static bool set_packet(std::vector<tt::Packet>& packets, int packet_index, tt::Packet&& packet)
+    {
+        if (packet_index < 0 || packet_index >= packets.size() || !packets[packet_index].bytes.empty())
+            return false;
+
+        packets[packet_index] = std::move(packet);
+        return true;
+    }
+
     std::unordered_map<int, VideoFramePackets> video_frame_packets_;
 };
 }
\ No newline at end of file
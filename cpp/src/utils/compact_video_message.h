@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include "utils/extension_packets.h"
+
+namespace kh
+{
+// A video message leaving the properties in SessionInfo out of its header, which only has the version of the SessionInfo.
+// Messages from telepresence-toolkit start with a float time stamp,
+// so a compact message starts with a NaN bit pattern that no time stamp can be.
+constexpr uint32_t KH_COMPACT_VIDEO_MESSAGE_MAGIC{0x7FC04B48};
+
+// A message with the codecs to decode its frames.
+struct VideoMessage
+{
+    tt::VideoSenderMessage sender_message;
+    ColorCodec color_codec;
+    DepthCodec depth_codec;
+    DepthQuantization depth_quantization;
+    bool intra_refresh;
+};
+
+inline std::vector<std::byte> create_compact_video_message_bytes(int session_info_version,
+                                                                 float frame_time_stamp,
+                                                                 bool keyframe,
+                                                                 gsl::span<const std::byte> color_encoder_frame,
+                                                                 gsl::span<const std::byte> depth_encoder_frame,
+                                                                 std::optional<std::array<float, 4>> floor)
+{
+    std::vector<std::byte> bytes;
+    bytes.reserve(32 + color_encoder_frame.size() + depth_encoder_frame.size());
+    append_to_extension_packet_bytes(bytes, KH_COMPACT_VIDEO_MESSAGE_MAGIC);
+    append_to_extension_packet_bytes(bytes, session_info_version);
+    append_to_extension_packet_bytes(bytes, frame_time_stamp);
+    append_to_extension_packet_bytes(bytes, keyframe);
+    append_to_extension_packet_bytes(bytes, gsl::narrow<int>(color_encoder_frame.size()));
+    bytes.insert(bytes.end(), color_encoder_frame.begin(), color_encoder_frame.end());
+    append_to_extension_packet_bytes(bytes, gsl::narrow<int>(depth_encoder_frame.size()));
+    bytes.insert(bytes.end(), depth_encoder_frame.begin(), depth_encoder_frame.end());
+    append_to_extension_packet_bytes(bytes, floor.has_value());
+    if (floor)
+        append_to_extension_packet_bytes(bytes, *floor);
+    return bytes;
+}
+
+inline bool is_compact_video_message(gsl::span<const std::byte> message_bytes)
+{
+    if (message_bytes.size() < sizeof(KH_COMPACT_VIDEO_MESSAGE_MAGIC))
+        return false;
+
+    size_t cursor{0};
+    return read_from_extension_packet_bytes<uint32_t>(message_bytes, cursor) == KH_COMPACT_VIDEO_MESSAGE_MAGIC;
+}
+
+inline gsl::span<const std::byte> read_frame_from_compact_video_message(gsl::span<const std::byte> message_bytes, size_t& cursor)
+{
+    const int frame_size{read_from_extension_packet_bytes<int>(message_bytes, cursor)};
+    if (frame_size < 0 || cursor + frame_size > message_bytes.size())
+        throw std::runtime_error("Compact video message is shorter than expected.");
+
+    auto frame{message_bytes.subspan(cursor, frame_size)};
+    cursor += frame_size;
+    return frame;
+}
+
+// Reads both compact messages and ones from telepresence-toolkit.
+// A compact message gets filled with the SessionInfo of its version,
+// and std::nullopt means that SessionInfo has not arrived yet.
+inline std::optional<VideoMessage> read_video_message(gsl::span<const std::byte> message_bytes,
+                                                      const std::optional<SessionInfo>& session_info)
+{
+    if (!is_compact_video_message(message_bytes))
+        return VideoMessage{tt::read_video_sender_message(message_bytes), ColorCodec::Vp8, DepthCodec::Trvl, DepthQuantization::None, false};
+
+    size_t cursor{sizeof(KH_COMPACT_VIDEO_MESSAGE_MAGIC)};
+    const int session_info_version{read_from_extension_packet_bytes<int>(message_bytes, cursor)};
+    if (!session_info || session_info->version != session_info_version)
+        return std::nullopt;
+
+    tt::VideoSenderMessage sender_message;
+    sender_message.frame_time_stamp = read_from_extension_packet_bytes<float>(message_bytes, cursor);
+    sender_message.keyframe = read_from_extension_packet_bytes<bool>(message_bytes, cursor);
+    sender_message.width = session_info->width;
+    sender_message.height = session_info->height;
+    sender_message.intrinsics = session_info->intrinsics;
+    const auto color_encoder_frame{read_frame_from_compact_video_message(message_bytes, cursor)};
+    sender_message.color_encoder_frame.assign(color_encoder_frame.begin(), color_encoder_frame.end());
+    const auto depth_encoder_frame{read_frame_from_compact_video_message(message_bytes, cursor)};
+    sender_message.depth_encoder_frame.assign(depth_encoder_frame.begin(), depth_encoder_frame.end());
+    if (read_from_extension_packet_bytes<bool>(message_bytes, cursor))
+        sender_message.floor = read_from_extension_packet_bytes<std::array<float, 4>>(message_bytes, cursor);
+
+    return VideoMessage{std::move(sender_message), session_info->color_codec, session_info->depth_codec, session_info->depth_quantization, session_info->intra_refresh};
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "native/tt_native.h"
+
+namespace kh
+{
+// The noise of a time-of-flight depth grows with the square of the distance,
+// so millimeters over-spend bits on far pixels and a fixed TRVL change threshold under-filters near ones.
+// Quantizing to codes with steps following the noise lets a single threshold in codes fit every distance.
+// Steps are 1 mm until the knee, the square root of the scale (about 1.4 m),
+// and beyond it codes are linear in inverse depth (e.g., steps of 2 mm at 2 m and 8 mm at 4 m).
+constexpr float KH_DEPTH_QUANTIZATION_SCALE{2000000.0f};
+// The TRVL change threshold for quantized depth pixels, in codes instead of millimeters.
+constexpr short KH_QUANTIZED_TRVL_CHANGE_THRESHOLD{3};
+
+// Both directions are lookup tables.
+// Each code dequantizes to the middle of the millimeters quantized to it,
+// so quantizing a dequantized code gives back the same code.
+class DepthQuantizer
+{
+public:
+    DepthQuantizer()
+        : quantization_table_(std::numeric_limits<uint16_t>::max() + 1)
+        , dequantization_table_{}
+    {
+        const float knee{std::sqrt(KH_DEPTH_QUANTIZATION_SCALE)};
+        const float max_code{knee + KH_DEPTH_QUANTIZATION_SCALE / knee};
+        std::vector<int> min_depths;
+        std::vector<int> max_depths;
+        // Code 0 stays as an invalid pixel and so do depth pixels beyond the range of int16_t.
+        for (int depth{1}; depth <= std::numeric_limits<int16_t>::max(); ++depth) {
+            const float code{depth <= knee ? depth : max_code - KH_DEPTH_QUANTIZATION_SCALE / depth};
+            const auto rounded_code{gsl::narrow<int16_t>(std::lround(code))};
+            quantization_table_[depth] = rounded_code;
+
+            if (rounded_code >= static_cast<int>(min_depths.size())) {
+                min_depths.resize(rounded_code + 1, depth);
+                max_depths.resize(rounded_code + 1, depth);
+            }
+            max_depths[rounded_code] = depth;
+        }
+
+        dequantization_table_.resize(min_depths.size());
+        for (size_t code{1}; code < dequantization_table_.size(); ++code)
+            dequantization_table_[code] = gsl::narrow<int16_t>((min_depths[code] + max_depths[code]) / 2);
+    }
+
+    // Pixels are in millimeters as int16_t while they are uint16_t from the Kinect.
+    void quantize(gsl::span<const int16_t> depth_pixels, gsl::span<int16_t> codes) const
+    {
+        for (size_t i{0}; i < depth_pixels.size(); ++i)
+            codes[i] = quantization_table_[static_cast<uint16_t>(depth_pixels[i])];
+    }
+
+    // Codes outside the table, which only a corrupted frame can have, become invalid pixels.
+    void dequantize(gsl::span<int16_t> pixels) const
+    {
+        const auto code_count{gsl::narrow<uint16_t>(dequantization_table_.size())};
+        for (auto& pixel : pixels) {
+            const auto code{static_cast<uint16_t>(pixel)};
+            pixel = code < code_count ? dequantization_table_[code] : 0;
+        }
+    }
+
+private:
+    std::vector<int16_t> quantization_table_;
+    std::vector<int16_t> dequantization_table_;
+};
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "native/tt_native.h"
+
+namespace kh
+{
+// Packets extending the protocol of telepresence-toolkit.
+// They follow the layout of the packets from telepresence-toolkit,
+// an int32 sender/receiver ID followed by an int32 packet type,
+// with types starting from 100 not to overlap the ones from telepresence-toolkit.
+// This lets peers without the extensions (e.g., KHViewer) ignore them as packets of an unknown type.
+enum class ExtensionSenderPacketType : int32_t
+{
+    MulticastGroup = 100,
+    SessionInfo = 101,
+    AudioBundle = 102,
+};
+
+enum class ExtensionReceiverPacketType : int32_t
+{
+    MulticastJoin = 100,
+    KeyframeRequest = 101,
+    SessionInfoAck = 102,
+};
+
+// Packets shorter than the ID and the type get dropped without reading them.
+// Longer packets that still fail to get read make the readers throw std::runtime_error,
+// which the packet classifiers catch to drop the packet, so a malformed datagram does not stop a loop.
+constexpr size_t KH_PACKET_HEADER_SIZE{sizeof(int32_t) * 2};
+
+struct MulticastGroupSenderPacket
+{
+    int sender_id;
+    asio::ip::udp::endpoint multicast_endpoint;
+};
+
+// Tiled color codecs split a frame into horizontal stripes, each with its own encoder/decoder, like tiled TRVL.
+enum class ColorCodec : int32_t
+{
+    Vp8 = 0,
+    Vp9 = 1,
+    TiledVp8 = 2,
+    TiledVp9 = 3,
+};
+
+enum class DepthCodec : int32_t
+{
+    Trvl = 0,
+    TiledTrvl = 1,
+    TiledTrvlZstd = 2,
+};
+
+// Quantization of depth pixels before a tiled TRVL codec.
+enum class DepthQuantization : int32_t
+{
+    None = 0,
+    InverseDepth = 1,
+};
+
+// Properties of a video stream that stay the same through a session.
+// Sent once per version instead of with every frame.
+// The codecs are for compact video messages since messages from telepresence-toolkit always use the default ones.
+// Receivers only acknowledge a SessionInfo with codecs they support,
+// so receivers without the codecs keep getting messages from telepresence-toolkit.
+// With intra_refresh, tiled color codecs and tiled TRVL codecs encode a stripe of each frame like in a keyframe in turns,
+// so receivers can skip missing frames instead of waiting for a keyframe once both codecs are tiled.
+struct SessionInfo
+{
+    int version;
+    int width;
+    int height;
+    tt::KinectIntrinsics intrinsics;
+    ColorCodec color_codec;
+    DepthCodec depth_codec;
+    DepthQuantization depth_quantization;
+    bool intra_refresh;
+};
+
+// Acknowledging this version withdraws an earlier acknowledgement,
+// since versions are sender IDs, which are never negative.
+constexpr int KH_WITHDRAWN_SESSION_INFO_VERSION{-1};
+
+// A receiver this many frames behind the sender catches up,
+// by jumping to a keyframe the sender sends for it, or, with intra refresh of both codecs, by skipping missing frames.
+constexpr int KH_CATCH_UP_FRAME_ID_DIFF{5};
+
+inline bool is_tiled_color_codec(ColorCodec color_codec)
+{
+    return color_codec == ColorCodec::TiledVp8 || color_codec == ColorCodec::TiledVp9;
+}
+
+// Only stripes of tiled codecs get refreshed, and frames of other codecs need the frames before them.
+inline bool is_intra_refreshed(ColorCodec color_codec, DepthCodec depth_codec, bool intra_refresh)
+{
+    return intra_refresh && is_tiled_color_codec(color_codec) && depth_codec != DepthCodec::Trvl;
+}
+
+// An AudioBundle packet carries up to this many consecutive Opus frames.
+constexpr int KH_MAX_AUDIO_BUNDLE_FRAME_COUNT{3};
+
+// When the last sample of an audio frame got captured, in milliseconds from the start of the session of the sender,
+// which is also the clock of the time stamps of video frames.
+// Frames after it are KH_AUDIO_FRAME_MS apart.
+// The sender ID tells apart frames of senders getting mixed by one receiver.
+struct AudioFrameTimeStamp
+{
+    int sender_id;
+    int frame_id;
+    float time_stamp;
+};
+
+struct AudioBundleSenderPacket
+{
+    AudioFrameTimeStamp first_frame_time_stamp;
+    std::vector<tt::AudioSenderPacket> audio_packets;
+};
+
+template<typename T>
+void append_to_extension_packet_bytes(std::vector<std::byte>& bytes, const T& value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    const size_t cursor{bytes.size()};
+    bytes.resize(cursor + sizeof(T));
+    memcpy(bytes.data() + cursor, &value, sizeof(T));
+}
+
+template<typename T>
+T read_from_extension_packet_bytes(gsl::span<const std::byte> bytes, size_t& cursor)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (cursor + sizeof(T) > bytes.size())
+        throw std::runtime_error("Extension packet is shorter than expected.");
+
+    T value;
+    memcpy(&value, bytes.data() + cursor, sizeof(T));
+    cursor += sizeof(T);
+    return value;
+}
+
+inline ExtensionSenderPacketType get_extension_sender_packet_type(gsl::span<const std::byte> packet_bytes)
+{
+    size_t cursor{sizeof(int32_t)};
+    return read_from_extension_packet_bytes<ExtensionSenderPacketType>(packet_bytes, cursor);
+}
+
+inline ExtensionReceiverPacketType get_extension_receiver_packet_type(gsl::span<const std::byte> packet_bytes)
+{
+    size_t cursor{sizeof(int32_t)};
+    return read_from_extension_packet_bytes<ExtensionReceiverPacketType>(packet_bytes, cursor);
+}
+
+inline std::vector<std::byte> create_multicast_group_sender_packet_bytes(int sender_id, const asio::ip::udp::endpoint& multicast_endpoint)
+{
+    std::vector<std::byte> bytes;
+    append_to_extension_packet_bytes(bytes, sender_id);
+    append_to_extension_packet_bytes(bytes, ExtensionSenderPacketType::MulticastGroup);
+    append_to_extension_packet_bytes(bytes, multicast_endpoint.address().to_v4().to_bytes());
+    append_to_extension_packet_bytes(bytes, multicast_endpoint.port());
+    return bytes;
+}
+
+inline MulticastGroupSenderPacket read_multicast_group_sender_packet(gsl::span<const std::byte> packet_bytes)
+{
+    size_t cursor{0};
+    MulticastGroupSenderPacket multicast_group_packet;
+    multicast_group_packet.sender_id = read_from_extension_packet_bytes<int>(packet_bytes, cursor);
+    read_from_extension_packet_bytes<ExtensionSenderPacketType>(packet_bytes, cursor);
+    const auto address_bytes{read_from_extension_packet_bytes<asio::ip::address_v4::bytes_type>(packet_bytes, cursor)};
+    const auto port{read_from_extension_packet_bytes<unsigned short>(packet_bytes, cursor)};
+    multicast_group_packet.multicast_endpoint = asio::ip::udp::endpoint{asio::ip::address_v4{address_bytes}, port};
+    return multicast_group_packet;
+}
+
+// The sender sends this packet to a receiver until it gets acknowledged
+// since lost session info would leave the receiver unable to read frames.
+inline std::vector<std::byte> create_session_info_sender_packet_bytes(int sender_id, const SessionInfo& session_info)
+{
+    std::vector<std::byte> bytes;
+    append_to_extension_packet_bytes(bytes, sender_id);
+    append_to_extension_packet_bytes(bytes, ExtensionSenderPacketType::SessionInfo);
+    append_to_extension_packet_bytes(bytes, session_info.version);
+    append_to_extension_packet_bytes(bytes, session_info.width);
+    append_to_extension_packet_bytes(bytes, session_info.height);
+    append_to_extension_packet_bytes(bytes, session_info.intrinsics);
+    append_to_extension_packet_bytes(bytes, session_info.color_codec);
+    append_to_extension_packet_bytes(bytes, session_info.depth_codec);
+    append_to_extension_packet_bytes(bytes, session_info.depth_quantization);
+    append_to_extension_packet_bytes(bytes, session_info.intra_refresh);
+    return bytes;
+}
+
+inline SessionInfo read_session_info_sender_packet(gsl::span<const std::byte> packet_bytes)
+{
+    size_t cursor{sizeof(int32_t) + sizeof(ExtensionSenderPacketType)};
+    SessionInfo session_info;
+    session_info.version = read_from_extension_packet_bytes<int>(packet_bytes, cursor);
+    session_info.width = read_from_extension_packet_bytes<int>(packet_bytes, cursor);
+    session_info.height = read_from_extension_packet_bytes<int>(packet_bytes, cursor);
+    session_info.intrinsics = read_from_extension_packet_bytes<tt::KinectIntrinsics>(packet_bytes, cursor);
+    session_info.color_codec = read_from_extension_packet_bytes<ColorCodec>(packet_bytes, cursor);
+    session_info.depth_codec = read_from_extension_packet_bytes<DepthCodec>(packet_bytes, cursor);
+    session_info.depth_quantization = read_from_extension_packet_bytes<DepthQuantization>(packet_bytes, cursor);
+    session_info.intra_refresh = read_from_extension_packet_bytes<bool>(packet_bytes, cursor);
+    return session_info;
+}
+
+// Consecutive Opus frames of the sender in one packet, which cuts the packet rate of audio
+// at the cost of frames waiting for the last one of their bundle.
+// Only for receivers acknowledging a SessionInfo since the others cannot read extension packets.
+// Unlike audio packets from telepresence-toolkit, bundles carry the time stamps receivers need to synchronize video to audio.
+// The bundle gets written into bytes instead of a new vector to let the sender reuse its capacity.
+inline void begin_audio_bundle_sender_packet_bytes(std::vector<std::byte>& bytes, AudioFrameTimeStamp first_frame_time_stamp)
+{
+    bytes.clear();
+    append_to_extension_packet_bytes(bytes, first_frame_time_stamp.sender_id);
+    append_to_extension_packet_bytes(bytes, ExtensionSenderPacketType::AudioBundle);
+    append_to_extension_packet_bytes(bytes, first_frame_time_stamp.frame_id);
+    append_to_extension_packet_bytes(bytes, first_frame_time_stamp.time_stamp);
+    append_to_extension_packet_bytes(bytes, int32_t{0});
+}
+
+// Appends the frame after the ones already in the bundle.
+inline void append_to_audio_bundle_sender_packet_bytes(std::vector<std::byte>& bytes, gsl::span<const std::byte> opus_frame)
+{
+    constexpr size_t FRAME_COUNT_CURSOR{sizeof(int32_t) * 3 + sizeof(float)};
+    size_t cursor{FRAME_COUNT_CURSOR};
+    const int32_t frame_count{read_from_extension_packet_bytes<int32_t>(bytes, cursor) + 1};
+    memcpy(bytes.data() + FRAME_COUNT_CURSOR, &frame_count, sizeof(frame_count));
+
+    append_to_extension_packet_bytes(bytes, gsl::narrow<int32_t>(opus_frame.size()));
+    bytes.insert(bytes.end(), opus_frame.begin(), opus_frame.end());
+}
+
+// Returns the frames of the bundle as packets from telepresence-toolkit, so receivers handle them the same.
+inline AudioBundleSenderPacket read_audio_bundle_sender_packet(gsl::span<const std::byte> packet_bytes)
+{
+    size_t cursor{0};
+    const int sender_id{read_from_extension_packet_bytes<int>(packet_bytes, cursor)};
+    read_from_extension_packet_bytes<ExtensionSenderPacketType>(packet_bytes, cursor);
+    const int first_frame_id{read_from_extension_packet_bytes<int>(packet_bytes, cursor)};
+    const float first_frame_time_stamp{read_from_extension_packet_bytes<float>(packet_bytes, cursor)};
+    const int frame_count{read_from_extension_packet_bytes<int32_t>(packet_bytes, cursor)};
+    if (frame_count < 0 || frame_count > KH_MAX_AUDIO_BUNDLE_FRAME_COUNT)
+        throw std::runtime_error("AudioBundle packet has an invalid frame count.");
+
+    std::vector<tt::AudioSenderPacket> audio_packets(frame_count);
+    for (int i{0}; i < frame_count; ++i) {
+        const int opus_frame_size{read_from_extension_packet_bytes<int32_t>(packet_bytes, cursor)};
+        if (opus_frame_size < 0 || cursor + opus_frame_size > packet_bytes.size())
+            throw std::runtime_error("Extension packet is shorter than expected.");
+
+        auto& audio_packet{audio_packets[i]};
+        audio_packet.sender_id = sender_id;
+        audio_packet.type = tt::SenderPacketType::Audio;
+        audio_packet.frame_id = first_frame_id + i;
+        audio_packet.opus_frame.assign(packet_bytes.begin() + cursor, packet_bytes.begin() + cursor + opus_frame_size);
+        cursor += opus_frame_size;
+    }
+    return AudioBundleSenderPacket{AudioFrameTimeStamp{sender_id, first_frame_id, first_frame_time_stamp}, std::move(audio_packets)};
+}
+
+// A receiver keeps sending this packet until it receives a MulticastGroup packet
+// since packets from unconnected receivers get ignored by the sender.
+inline std::vector<std::byte> create_multicast_join_receiver_packet_bytes(int receiver_id)
+{
+    std::vector<std::byte> bytes;
+    append_to_extension_packet_bytes(bytes, receiver_id);
+    append_to_extension_packet_bytes(bytes, ExtensionReceiverPacketType::MulticastJoin);
+    return bytes;
+}
+
+// Asks the sender to make its next frame a keyframe.
+// A relay sends this when a receiver connects to it since the sender cannot tell about the new receiver.
+inline std::vector<std::byte> create_keyframe_request_receiver_packet_bytes(int receiver_id)
+{
+    std::vector<std::byte> bytes;
+    append_to_extension_packet_bytes(bytes, receiver_id);
+    append_to_extension_packet_bytes(bytes, ExtensionReceiverPacketType::KeyframeRequest);
+    return bytes;
+}
+
+inline std::vector<std::byte> create_session_info_ack_receiver_packet_bytes(int receiver_id, int session_info_version)
+{
+    std::vector<std::byte> bytes;
+    append_to_extension_packet_bytes(bytes, receiver_id);
+    append_to_extension_packet_bytes(bytes, ExtensionReceiverPacketType::SessionInfoAck);
+    append_to_extension_packet_bytes(bytes, session_info_version);
+    return bytes;
+}
+
+inline int read_session_info_ack_receiver_packet_version(gsl::span<const std::byte> packet_bytes)
+{
+    size_t cursor{sizeof(int32_t) + sizeof(ExtensionReceiverPacketType)};
+    return read_from_extension_packet_bytes<int>(packet_bytes, cursor);
+}
+}
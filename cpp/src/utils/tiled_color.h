@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include "utils/extension_packets.h"
+
+namespace kh
+{
+// Tiled color codecs split a frame into horizontal stripes, each encoded by its own VP8 or VP9 encoder,
+// so intra refresh can encode one stripe per frame as a keyframe of its encoder while the others stay inter frames.
+// Unlike the refresh modes of libvpx, which only lower the quantizer of some macroblocks,
+// a refreshed stripe does not reference earlier frames, so it repairs a decoder that missed them.
+// A frame has the number of stripes, the index of the refreshed stripe (-1 for none), the byte size of each stripe,
+// and then the frames of the stripes, as in tiled TRVL.
+constexpr int KH_TILED_COLOR_STRIPE_COUNT{8};
+// Stripes span whole macroblock rows, so none gets encoded with padding rows in the middle of the frame.
+constexpr int KH_TILED_COLOR_STRIPE_ROW_ALIGNMENT{16};
+
+struct TiledColorStripe
+{
+    int row;
+    int row_count;
+};
+
+// Macroblock rows get spread over the stripes as evenly as possible, and frames with fewer macroblock rows get fewer stripes.
+inline std::vector<TiledColorStripe> create_tiled_color_stripes(int height)
+{
+    const int macroblock_row_count{(height + KH_TILED_COLOR_STRIPE_ROW_ALIGNMENT - 1) / KH_TILED_COLOR_STRIPE_ROW_ALIGNMENT};
+    const int stripe_count{std::min(KH_TILED_COLOR_STRIPE_COUNT, macroblock_row_count)};
+    std::vector<TiledColorStripe> stripes;
+    int row{0};
+    for (int i{0}; i < stripe_count; ++i) {
+        const int stripe_macroblock_row_count{macroblock_row_count / stripe_count + (i < macroblock_row_count % stripe_count ? 1 : 0)};
+        const int row_count{std::min(stripe_macroblock_row_count * KH_TILED_COLOR_STRIPE_ROW_ALIGNMENT, height - row)};
+        stripes.push_back(TiledColorStripe{row, row_count});
+        row += row_count;
+    }
+    return stripes;
+}
+
+inline std::vector<std::byte> create_tiled_color_frame(const std::vector<std::vector<std::byte>>& stripe_frames, std::optional<int> refreshed_stripe_index)
+{
+    size_t frame_size{sizeof(int) * (stripe_frames.size() + 2)};
+    for (auto& stripe_frame : stripe_frames)
+        frame_size += stripe_frame.size();
+
+    std::vector<std::byte> frame;
+    frame.reserve(frame_size);
+    append_to_extension_packet_bytes(frame, gsl::narrow<int>(stripe_frames.size()));
+    append_to_extension_packet_bytes(frame, refreshed_stripe_index.value_or(-1));
+    for (auto& stripe_frame : stripe_frames)
+        append_to_extension_packet_bytes(frame, gsl::narrow<int>(stripe_frame.size()));
+    for (auto& stripe_frame : stripe_frames)
+        frame.insert(frame.end(), stripe_frame.begin(), stripe_frame.end());
+    return frame;
+}
+
+struct TiledColorFrame
+{
+    int refreshed_stripe_index;
+    std::vector<gsl::span<const std::byte>> stripe_frames;
+};
+
+inline TiledColorFrame read_tiled_color_frame(gsl::span<const std::byte> frame)
+{
+    size_t cursor{0};
+    const int stripe_count{read_from_extension_packet_bytes<int>(frame, cursor)};
+    if (stripe_count <= 0 || cursor + sizeof(int) * (stripe_count + 1) > frame.size())
+        throw std::runtime_error("Tiled color frame is shorter than expected.");
+
+    TiledColorFrame tiled_color_frame{read_from_extension_packet_bytes<int>(frame, cursor), {}};
+    std::vector<int> stripe_frame_sizes(stripe_count);
+    for (auto& stripe_frame_size : stripe_frame_sizes)
+        stripe_frame_size = read_from_extension_packet_bytes<int>(frame, cursor);
+
+    for (int stripe_frame_size : stripe_frame_sizes) {
+        if (stripe_frame_size < 0 || cursor + stripe_frame_size > frame.size())
+            throw std::runtime_error("Tiled color frame is shorter than expected.");
+
+        tiled_color_frame.stripe_frames.push_back(frame.subspan(cursor, stripe_frame_size));
+        cursor += stripe_frame_size;
+    }
+    return tiled_color_frame;
+}
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <zstd.h>
+#include "utils/extension_packets.h"
+#include "utils/worker_thread_pool.h"
+
+namespace kh
+{
+// Tiled TRVL splits a depth frame into horizontal stripes, each with its own TRVL encoder/decoder,
+// so the stripes get encoded and decoded in parallel by a WorkerThreadPool that lives as long as the encoder/decoder.
+// A frame has the number of stripes, the index of the refreshed stripe, the byte size of each stripe, and then the TRVL bytes of the stripes.
+// The refreshed stripe, if any (-1 otherwise), gets encoded like in a keyframe,
+// so refreshing a stripe per frame repairs a decoder that missed frames within KH_TILED_TRVL_STRIPE_COUNT frames without a keyframe.
+// Optionally, the TRVL bytes of each stripe get compressed again with zstd,
+// which trades CPU time for the bandwidth TRVL's nibble coding leaves.
+constexpr int KH_TILED_TRVL_STRIPE_COUNT{8};
+// Low levels of zstd keep up with the frame rate.
+constexpr int KH_TILED_TRVL_ZSTD_LEVEL{1};
+// TRVL spends at most a nibble on each run length and a few nibbles on each value,
+// which bounds the TRVL bytes of a stripe when the size comes from the network.
+constexpr size_t KH_TRVL_MAX_BYTES_PER_PIXEL{4};
+
+struct TiledTrvlStripe
+{
+    int pixel_offset;
+    int pixel_count;
+};
+
+inline std::vector<TiledTrvlStripe> create_tiled_trvl_stripes(int width, int height)
+{
+    std::vector<TiledTrvlStripe> stripes;
+    const int stripe_row_count{(height + KH_TILED_TRVL_STRIPE_COUNT - 1) / KH_TILED_TRVL_STRIPE_COUNT};
+    for (int row{0}; row < height; row += stripe_row_count)
+        stripes.push_back(TiledTrvlStripe{row * width, std::min(stripe_row_count, height - row) * width});
+    return stripes;
+}
+
+struct ZstdCompressionContextDeleter
+{
+    void operator()(ZSTD_CCtx* context) { ZSTD_freeCCtx(context); }
+};
+
+struct ZstdDecompressionContextDeleter
+{
+    void operator()(ZSTD_DCtx* context) { ZSTD_freeDCtx(context); }
+};
+
+class TiledTrvlEncoder
+{
+public:
+    TiledTrvlEncoder(int width, int height, short change_threshold, int invalid_threshold)
+        : stripes_{create_tiled_trvl_stripes(width, height)}
+        , encoders_{}
+        , compression_contexts_{}
+        , stripe_frames_(stripes_.size())
+        , worker_thread_pool_{std::make_unique<WorkerThreadPool>(gsl::narrow<int>(stripes_.size()) - 1)}
+    {
+        encoders_.reserve(stripes_.size());
+        for (auto& stripe : stripes_) {
+            encoders_.emplace_back(stripe.pixel_count, change_threshold, invalid_threshold);
+            compression_contexts_.emplace_back(ZSTD_createCCtx());
+        }
+    }
+
+    int stripe_count() { return gsl::narrow<int>(stripes_.size()); }
+
+    // Without zstd_level, stripes are left as TRVL bytes.
+    std::vector<std::byte> encode(gsl::span<int16_t> depth_pixels, bool keyframe, std::optional<int> zstd_level, std::optional<int> refreshed_stripe_index)
+    {
+        // The first stripe gets encoded in this thread while the others are in worker threads.
+        worker_thread_pool_->run([&](int i) { encode_stripe(depth_pixels, keyframe || refreshed_stripe_index == i, zstd_level, i); });
+
+        size_t frame_size{sizeof(int) * (stripe_frames_.size() + 2)};
+        for (auto& stripe_frame : stripe_frames_)
+            frame_size += stripe_frame.size();
+
+        std::vector<std::byte> frame;
+        frame.reserve(frame_size);
+        append_to_extension_packet_bytes(frame, gsl::narrow<int>(stripe_frames_.size()));
+        append_to_extension_packet_bytes(frame, refreshed_stripe_index.value_or(-1));
+        for (auto& stripe_frame : stripe_frames_)
+            append_to_extension_packet_bytes(frame, gsl::narrow<int>(stripe_frame.size()));
+        for (auto& stripe_frame : stripe_frames_)
+            frame.insert(frame.end(), stripe_frame.begin(), stripe_frame.end());
+        return frame;
+    }
+
+private:
+    void encode_stripe(gsl::span<int16_t> depth_pixels, bool keyframe, std::optional<int> zstd_level, size_t index)
+    {
+        auto& stripe{stripes_[index]};
+        auto trvl_frame{encoders_[index].encode(depth_pixels.subspan(stripe.pixel_offset, stripe.pixel_count), keyframe)};
+        if (!zstd_level) {
+            stripe_frames_[index] = std::move(trvl_frame);
+            return;
+        }
+
+        auto& stripe_frame{stripe_frames_[index]};
+        stripe_frame.resize(ZSTD_compressBound(trvl_frame.size()));
+        const size_t stripe_frame_size{ZSTD_compressCCtx(compression_contexts_[index].get(),
+                                                         stripe_frame.data(), stripe_frame.size(),
+                                                         trvl_frame.data(), trvl_frame.size(),
+                                                         *zstd_level)};
+        if (ZSTD_isError(stripe_frame_size))
+            throw std::runtime_error(std::string("ZSTD_compressCCtx() failed in TiledTrvlEncoder: ") + ZSTD_getErrorName(stripe_frame_size));
+
+        stripe_frame.resize(stripe_frame_size);
+    }
+
+    std::vector<TiledTrvlStripe> stripes_;
+    std::vector<tt::TrvlEncoder> encoders_;
+    std::vector<std::unique_ptr<ZSTD_CCtx, ZstdCompressionContextDeleter>> compression_contexts_;
+    std::vector<std::vector<std::byte>> stripe_frames_;
+    // In a std::unique_ptr to keep the encoder movable.
+    std::unique_ptr<WorkerThreadPool> worker_thread_pool_;
+};
+
+class TiledTrvlDecoder
+{
+public:
+    TiledTrvlDecoder(int width, int height)
+        : stripes_{create_tiled_trvl_stripes(width, height)}
+        , decoders_{}
+        , decompression_contexts_{}
+        , stripe_frames_(stripes_.size())
+        , worker_thread_pool_{std::make_unique<WorkerThreadPool>(gsl::narrow<int>(stripes_.size()) - 1)}
+    {
+        decoders_.reserve(stripes_.size());
+        for (auto& stripe : stripes_) {
+            decoders_.emplace_back(stripe.pixel_count);
+            decompression_contexts_.emplace_back(ZSTD_createDCtx());
+        }
+    }
+
+    std::vector<int16_t> decode(gsl::span<const std::byte> frame, bool keyframe, bool zstd_compressed)
+    {
+        size_t cursor{0};
+        if (read_from_extension_packet_bytes<int>(frame, cursor) != gsl::narrow<int>(stripes_.size()))
+            throw std::runtime_error("Stripe count mismatch in TiledTrvlDecoder::decode().");
+
+        const int refreshed_stripe_index{read_from_extension_packet_bytes<int>(frame, cursor)};
+
+        std::vector<int> stripe_frame_sizes(stripes_.size());
+        for (auto& stripe_frame_size : stripe_frame_sizes)
+            stripe_frame_size = read_from_extension_packet_bytes<int>(frame, cursor);
+
+        std::vector<gsl::span<const std::byte>> encoded_stripe_frames;
+        for (int stripe_frame_size : stripe_frame_sizes) {
+            if (stripe_frame_size < 0 || cursor + stripe_frame_size > frame.size())
+                throw std::runtime_error("Tiled TRVL frame is shorter than expected.");
+
+            encoded_stripe_frames.push_back(frame.subspan(cursor, stripe_frame_size));
+            cursor += stripe_frame_size;
+        }
+
+        std::vector<int16_t> depth_pixels(stripes_.back().pixel_offset + stripes_.back().pixel_count);
+        worker_thread_pool_->run([&](int i) {
+            decode_stripe(encoded_stripe_frames[i], depth_pixels, keyframe || refreshed_stripe_index == i, zstd_compressed, i);
+        });
+
+        return depth_pixels;
+    }
+
+private:
+    void decode_stripe(gsl::span<const std::byte> encoded_stripe_frame,
+                       std::vector<int16_t>& depth_pixels,
+                       bool keyframe,
+                       bool zstd_compressed,
+                       size_t index)
+    {
+        auto& stripe_frame{stripe_frames_[index]};
+        if (zstd_compressed) {
+            const auto trvl_frame_size{ZSTD_getFrameContentSize(encoded_stripe_frame.data(), encoded_stripe_frame.size())};
+            if (trvl_frame_size == ZSTD_CONTENTSIZE_UNKNOWN || trvl_frame_size == ZSTD_CONTENTSIZE_ERROR)
+                throw std::runtime_error("Invalid zstd frame in TiledTrvlDecoder.");
+            // Checked before allocating since the size is from the network.
+            if (trvl_frame_size > stripes_[index].pixel_count * KH_TRVL_MAX_BYTES_PER_PIXEL)
+                throw std::runtime_error("zstd frame larger than its stripe in TiledTrvlDecoder.");
+
+            stripe_frame.resize(trvl_frame_size);
+            const size_t decompressed_size{ZSTD_decompressDCtx(decompression_contexts_[index].get(),
+                                                               stripe_frame.data(), stripe_frame.size(),
+                                                               encoded_stripe_frame.data(), encoded_stripe_frame.size())};
+            if (ZSTD_isError(decompressed_size))
+                throw std::runtime_error(std::string("ZSTD_decompressDCtx() failed in TiledTrvlDecoder: ") + ZSTD_getErrorName(decompressed_size));
+        } else {
+            stripe_frame.assign(encoded_stripe_frame.begin(), encoded_stripe_frame.end());
+        }
+
+        const auto stripe_pixels{decoders_[index].decode(stripe_frame, keyframe)};
+        std::copy(stripe_pixels.begin(), stripe_pixels.end(), depth_pixels.begin() + stripes_[index].pixel_offset);
+    }
+
+    std::vector<TiledTrvlStripe> stripes_;
+    std::vector<tt::TrvlDecoder> decoders_;
+    std::vector<std::unique_ptr<ZSTD_DCtx, ZstdDecompressionContextDeleter>> decompression_contexts_;
+    // Kept to reuse their memory.
+    std::vector<std::vector<std::byte>> stripe_frames_;
+    std::unique_ptr<WorkerThreadPool> worker_thread_pool_;
+};
+}
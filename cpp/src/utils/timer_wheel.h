@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "native/tt_native.h"
+
+namespace kh
+{
+// A hashed timer wheel.
+// Scheduling and expiring a timer costs O(1) regardless of the number of timers,
+// which matters when there is a timer per remote peer and there are hundreds of them.
+// Timers fire at the first tick after they are due, so their resolution is tick_sec.
+// Ticks follow the clock instead of calls of advance(), so the owner can stop calling it while idle.
+template<typename T>
+class TimerWheel
+{
+public:
+    TimerWheel(float tick_sec, int slot_count)
+        : tick_sec_{tick_sec}
+        , slots_(slot_count)
+        , start_time_{tt::TimePoint::now()}
+        , current_tick_{0}
+    {
+    }
+
+    void schedule(T value, float delay_sec)
+    {
+        // Round up to not let a timer fire earlier than requested.
+        const int64_t delay_ticks{std::max<int64_t>(1, static_cast<int64_t>(std::ceil(delay_sec / tick_sec_)))};
+        // Counting from the clock, since current_tick_ lags behind it when advance() has not been called for a while.
+        const int64_t due_tick{std::max(current_tick_, clock_tick()) + delay_ticks};
+        slots_[due_tick % slots_.size()].push_back(Timer{due_tick, std::move(value)});
+    }
+
+    // Moves values of the timers that are due to expired_values.
+    void advance(std::vector<T>& expired_values)
+    {
+        const int64_t target_tick{clock_tick()};
+        // After an idle period, visiting every slot once finds all the due timers
+        // instead of walking each tick that passed.
+        const int64_t visited_slot_count{std::min<int64_t>(target_tick - current_tick_, slots_.size())};
+        for (int64_t tick{current_tick_ + 1}; tick <= current_tick_ + visited_slot_count; ++tick) {
+            // A slot also contains timers due after more rounds of the wheel.
+            auto& slot{slots_[tick % slots_.size()]};
+            for (size_t i{0}; i < slot.size();) {
+                if (slot[i].due_tick > target_tick) {
+                    ++i;
+                    continue;
+                }
+
+                expired_values.push_back(std::move(slot[i].value));
+                slot[i] = std::move(slot.back());
+                slot.pop_back();
+            }
+        }
+        current_tick_ = std::max(current_tick_, target_tick);
+    }
+
+private:
+    int64_t clock_tick() const
+    {
+        return static_cast<int64_t>(start_time_.elapsed_time().sec() / tick_sec_);
+    }
+
+    struct Timer
+    {
+        int64_t due_tick;
+        T value;
+    };
+
+    const float tick_sec_;
+    std::vector<std::vector<Timer>> slots_;
+    const tt::TimePoint start_time_;
+    int64_t current_tick_;
+};
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kh
+{
+// Threads that stay alive across frames to run the parts of each frame in parallel,
+// which saves starting a thread per part per frame.
+// run() calls task with each index from 0 to worker_count, with index 0 on the calling thread,
+// and returns once every call returned, rethrowing the first exception among them.
+class WorkerThreadPool
+{
+public:
+    explicit WorkerThreadPool(int worker_count)
+        : mutex_{}
+        , start_condition_{}
+        , done_condition_{}
+        , task_{nullptr}
+        , generation_{0}
+        , pending_worker_count_{0}
+        , exception_{}
+        , stopped_{false}
+        , threads_{}
+    {
+        // Started after the other members get initialized.
+        for (int i{0}; i < worker_count; ++i)
+            threads_.emplace_back([this, i] { work(i + 1); });
+    }
+
+    ~WorkerThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stopped_ = true;
+        }
+        start_condition_.notify_all();
+        for (auto& thread : threads_)
+            thread.join();
+    }
+
+    WorkerThreadPool(const WorkerThreadPool&) = delete;
+    WorkerThreadPool& operator=(const WorkerThreadPool&) = delete;
+
+    void run(const std::function<void(int)>& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            task_ = &task;
+            ++generation_;
+            pending_worker_count_ = static_cast<int>(threads_.size());
+            exception_ = nullptr;
+        }
+        start_condition_.notify_all();
+
+        std::exception_ptr caller_exception;
+        try {
+            task(0);
+        } catch (...) {
+            caller_exception = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock{mutex_};
+        done_condition_.wait(lock, [this] { return pending_worker_count_ == 0; });
+        task_ = nullptr;
+        if (caller_exception)
+            std::rethrow_exception(caller_exception);
+        if (exception_)
+            std::rethrow_exception(exception_);
+    }
+
+private:
+    void work(int index)
+    {
+        int last_generation{0};
+        std::unique_lock<std::mutex> lock{mutex_};
+        while (true) {
+            start_condition_.wait(lock, [this, last_generation] { return stopped_ || generation_ != last_generation; });
+            if (stopped_)
+                return;
+
+            last_generation = generation_;
+            const auto task{task_};
+            lock.unlock();
+            std::exception_ptr exception;
+            try {
+                (*task)(index);
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            lock.lock();
+
+            if (exception && !exception_)
+                exception_ = exception;
+            if (--pending_worker_count_ == 0)
+                done_condition_.notify_one();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable start_condition_;
+    std::condition_variable done_condition_;
+    const std::function<void(int)>* task_;
+    int generation_;
+    int pending_worker_count_;
+    std::exception_ptr exception_;
+    bool stopped_;
+    std::vector<std::thread> threads_;
+};
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <thread>
+
+namespace kh
+{
+// Calls tick every interval on its own thread until destroyed,
+// which lets audio get encoded or decoded at the pace of the audio device instead of the main loop.
+// An exception from tick stops the thread and gets rethrown by rethrow_if_failed() on the thread of the owner.
+class AudioThread
+{
+public:
+    AudioThread(std::function<void()> tick, std::chrono::milliseconds interval)
+        : stopped_{false}
+        , failed_{false}
+        , exception_{}
+        , thread_{[this, tick{std::move(tick)}, interval] { run(tick, interval); }}
+    {
+    }
+
+    ~AudioThread()
+    {
+        stopped_ = true;
+        thread_.join();
+    }
+
+    AudioThread(const AudioThread&) = delete;
+    AudioThread& operator=(const AudioThread&) = delete;
+
+    void rethrow_if_failed() const
+    {
+        if (failed_)
+            std::rethrow_exception(exception_);
+    }
+
+private:
+    void run(const std::function<void()>& tick, std::chrono::milliseconds interval)
+    {
+        try {
+            auto tick_time{std::chrono::steady_clock::now()};
+            while (!stopped_) {
+                tick();
+                tick_time += interval;
+                std::this_thread::sleep_until(tick_time);
+            }
+        } catch (...) {
+            // failed_ gets set after exception_, so the owner reads exception_ only once it is set.
+            exception_ = std::current_exception();
+            failed_ = true;
+        }
+    }
+
+    std::atomic<bool> stopped_;
+    std::atomic<bool> failed_;
+    std::exception_ptr exception_;
+    // Last to start after the other members get initialized.
+    std::thread thread_;
+};
+}
@@ -0,0 +1,65 @@
+#include "mapped_file.h"
+
+#include <windows.h>
+
+namespace kh
+{
+std::optional<MappedFile> MappedFile::open(const std::string& path)
+{
+    // FILE_SHARE_DELETE lets another process replace the file while it is mapped.
+    HANDLE file{CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)};
+    if (file == INVALID_HANDLE_VALUE)
+        return std::nullopt;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return std::nullopt;
+    }
+
+    HANDLE mapping{CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)};
+    if (!mapping) {
+        CloseHandle(file);
+        return std::nullopt;
+    }
+
+    const void* view{MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)};
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return std::nullopt;
+    }
+
+    return MappedFile{file, mapping, static_cast<const std::byte*>(view), gsl::narrow<size_t>(size.QuadPart)};
+}
+
+MappedFile::MappedFile(void* file, void* mapping, const std::byte* view, size_t size)
+    : file_{file}
+    , mapping_{mapping}
+    , view_{view}
+    , size_{size}
+{
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : file_{other.file_}
+    , mapping_{other.mapping_}
+    , view_{other.view_}
+    , size_{other.size_}
+{
+    other.file_ = nullptr;
+    other.mapping_ = nullptr;
+    other.view_ = nullptr;
+    other.size_ = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    if (view_)
+        UnmapViewOfFile(view_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    if (file_)
+        CloseHandle(file_);
+}
+}
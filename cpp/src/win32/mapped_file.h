@@ -0,0 +1,30 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include "native/tt_native.h"
+
+namespace kh
+{
+// A read-only memory mapping of a whole file.
+// Processes mapping the same file share its pages instead of each reading a copy.
+class MappedFile
+{
+public:
+    // Returns std::nullopt when the file does not exist or is empty.
+    static std::optional<MappedFile> open(const std::string& path);
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+    gsl::span<const std::byte> bytes() const { return {view_, size_}; }
+
+private:
+    MappedFile(void* file, void* mapping, const std::byte* view, size_t size);
+
+    void* file_;
+    void* mapping_;
+    const std::byte* view_;
+    size_t size_;
+};
+}
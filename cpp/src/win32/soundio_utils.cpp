@@ -1,9 +1,30 @@
 #include "soundio_utils.h"
 
+#include <cstring>
+#include <emmintrin.h>
 #include <iostream>
 
 namespace kh
 {
+namespace
+{
+// Whether the samples of a frame are next to each other in areas, with the same step between frames.
+bool are_channel_areas_adjacent(const SoundIoChannelArea* areas, int channel_count, int bytes_per_sample)
+{
+    for (int ch{1}; ch < channel_count; ++ch) {
+        if (areas[ch].ptr != areas[0].ptr + ch * bytes_per_sample || areas[ch].step != areas[0].step)
+            return false;
+    }
+    return true;
+}
+
+// Whether the fast paths for pairs of 4-byte samples apply.
+bool are_channel_areas_float_stereo(const SoundIoChannelArea* areas, int channel_count, int bytes_per_sample)
+{
+    return channel_count == 2 && bytes_per_sample == sizeof(float) && are_channel_areas_adjacent(areas, channel_count, bytes_per_sample);
+}
+}
+
 SoundIoHandle create_sound_io_handle()
 {
     auto sound_io{soundio_create()};
@@ -55,6 +76,15 @@ SoundIoOutStreamHandle create_sound_io_outstream(const SoundIoDeviceHandle& devi
     return {soundio_outstream_create(device.get()), &soundio_outstream_destroy};
 }
 
+SoundIoRingBufferHandle create_sound_io_ring_buffer(const SoundIoHandle& sound_io, int capacity)
+{
+    auto ring_buffer{soundio_ring_buffer_create(sound_io.get(), capacity)};
+    if (!ring_buffer)
+        throw std::runtime_error("Failed in soundio_ring_buffer_create()...");
+
+    return {ring_buffer, &soundio_ring_buffer_destroy};
+}
+
 SoundIoDeviceHandle find_kinect_microphone(const SoundIoHandle& sound_io)
 {
     auto input_devices{get_sound_io_input_devices(sound_io)};
@@ -71,7 +101,8 @@ SoundIoDeviceHandle find_kinect_microphone(const SoundIoHandle& sound_io)
 
 SoundIoInStreamHandle create_kinect_microphone_stream(const SoundIoHandle& sound_io,
                                                       void (*read_callback)(struct SoundIoInStream*, int frame_count_min, int frame_count_max),
-                                                      void (*overflow_callback)(struct SoundIoInStream*))
+                                                      void (*overflow_callback)(struct SoundIoInStream*),
+                                                      void* userdata)
 {
     auto kinect_microphone_stream{create_sound_io_instream(find_kinect_microphone(sound_io))};
     // These settings came from tools/k4aviewer/k4amicrophone.cpp of Azure-Kinect-Sensor-SDK.
@@ -81,6 +112,7 @@ SoundIoInStreamHandle create_kinect_microphone_stream(const SoundIoHandle& sound
     kinect_microphone_stream->software_latency = KH_LATENCY_SECONDS;
     kinect_microphone_stream->read_callback = read_callback;
     kinect_microphone_stream->overflow_callback = overflow_callback;
+    kinect_microphone_stream->userdata = userdata;
 
     if (int error = soundio_instream_open(kinect_microphone_stream.get()))
         throw std::runtime_error(std::string("Failed to open AudioInStream: ") + std::to_string(error));
@@ -96,7 +128,8 @@ SoundIoInStreamHandle create_kinect_microphone_stream(const SoundIoHandle& sound
 
 SoundIoOutStreamHandle create_default_speaker_stream(const SoundIoHandle& sound_io,
                                                      void (*write_callback)(struct SoundIoOutStream*, int frame_count_min, int frame_count_max),
-                                                     void (*underflow_callback)(struct SoundIoOutStream*))
+                                                     void (*underflow_callback)(struct SoundIoOutStream*),
+                                                     void* userdata)
 {
     auto default_speaker_stream(create_sound_io_outstream(get_sound_io_default_output_device(sound_io)));
     // These settings are those generic and similar to Azure Kinect's.
@@ -107,6 +140,7 @@ SoundIoOutStreamHandle create_default_speaker_stream(const SoundIoHandle& sound_
     default_speaker_stream.get()->software_latency = KH_LATENCY_SECONDS;
     default_speaker_stream.get()->write_callback = write_callback;
     default_speaker_stream.get()->underflow_callback = underflow_callback;
+    default_speaker_stream.get()->userdata = userdata;
 
     if (int error = soundio_outstream_open(default_speaker_stream.get()))
         throw std::runtime_error(std::string("Failed to open AudioOutStream: ") + std::to_string(error));
@@ -118,6 +152,77 @@ SoundIoOutStreamHandle create_default_speaker_stream(const SoundIoHandle& sound_
     return default_speaker_stream;
 }
 
+void read_channel_areas(const SoundIoChannelArea* areas, int channel_count, int bytes_per_sample, int frame_count, char* samples)
+{
+    const int bytes_per_frame{channel_count * bytes_per_sample};
+    if (!are_channel_areas_float_stereo(areas, channel_count, bytes_per_sample)) {
+        for (int frame{0}; frame < frame_count; ++frame) {
+            for (int ch{0}; ch < channel_count; ++ch) {
+                memcpy(samples, areas[ch].ptr + frame * areas[ch].step, bytes_per_sample);
+                samples += bytes_per_sample;
+            }
+        }
+        return;
+    }
+
+    const char* source{areas[0].ptr};
+    const int step{areas[0].step};
+    if (step == bytes_per_frame) {
+        memcpy(samples, source, static_cast<size_t>(frame_count) * bytes_per_frame);
+        return;
+    }
+
+    // Two frames at a time, each an 8-byte pair of samples, into 16 bytes of samples.
+    int frame{0};
+    for (; frame + 1 < frame_count; frame += 2) {
+        const __m128i first{_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + frame * step))};
+        const __m128i second{_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + (frame + 1) * step))};
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + frame * bytes_per_frame), _mm_unpacklo_epi64(first, second));
+    }
+    if (frame < frame_count)
+        memcpy(samples + frame * bytes_per_frame, source + frame * step, bytes_per_frame);
+}
+
+void write_channel_areas(const char* samples, int channel_count, int bytes_per_sample, int frame_count, SoundIoChannelArea* areas)
+{
+    const int bytes_per_frame{channel_count * bytes_per_sample};
+    if (!are_channel_areas_float_stereo(areas, channel_count, bytes_per_sample)) {
+        for (int frame{0}; frame < frame_count; ++frame) {
+            for (int ch{0}; ch < channel_count; ++ch) {
+                memcpy(areas[ch].ptr + frame * areas[ch].step, samples, bytes_per_sample);
+                samples += bytes_per_sample;
+            }
+        }
+        return;
+    }
+
+    char* destination{areas[0].ptr};
+    const int step{areas[0].step};
+    if (step == bytes_per_frame) {
+        memcpy(destination, samples, static_cast<size_t>(frame_count) * bytes_per_frame);
+        return;
+    }
+
+    // Each 8-byte pair of samples gets stored into its frame.
+    for (int frame{0}; frame < frame_count; ++frame) {
+        const __m128i pair{_mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples + frame * bytes_per_frame))};
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + frame * step), pair);
+    }
+}
+
+void clear_channel_areas(int channel_count, int bytes_per_sample, int frame_count, SoundIoChannelArea* areas)
+{
+    if (are_channel_areas_adjacent(areas, channel_count, bytes_per_sample) && areas[0].step == channel_count * bytes_per_sample) {
+        memset(areas[0].ptr, 0, static_cast<size_t>(frame_count) * areas[0].step);
+        return;
+    }
+
+    for (int frame{0}; frame < frame_count; ++frame) {
+        for (int ch{0}; ch < channel_count; ++ch)
+            memset(areas[ch].ptr + frame * areas[ch].step, 0, bytes_per_sample);
+    }
+}
+
 void write_instream_to_buffer(SoundIoInStream* instream, int frame_count_min, int frame_count_max, SoundIoRingBuffer* ring_buffer, int channel_count)
 {
     SoundIoChannelArea* areas;
@@ -158,14 +263,10 @@ void write_instream_to_buffer(SoundIoInStream* instream, int frame_count_min, in
             memset(write_ptr, 0, static_cast<long long>(frame_count) * bytes_per_frame);
             std::cout << "Dropped " << frame_count << " frames due to internal overflow\n";
         } else {
-            for (int frame = 0; frame < frame_count; frame += 1) {
-                for (int ch = 0; ch < KH_CHANNEL_COUNT; ch += 1) {
-                    memcpy(write_ptr, areas[ch].ptr, instream->bytes_per_sample);
-                    areas[ch].ptr += areas[ch].step;
-                    write_ptr += instream->bytes_per_sample;
-                }
-            }
+            read_channel_areas(areas, channel_count, instream->bytes_per_sample, frame_count, write_ptr);
         }
+        // Also past the hole, which the silence above fills.
+        write_ptr += static_cast<long long>(frame_count) * bytes_per_frame;
 
         if ((err = soundio_instream_end_read(instream))) {
             std::cout << "end read error: " << soundio_strerror(err);
@@ -205,12 +306,7 @@ void write_buffer_to_outstream(SoundIoOutStream* outstream, int frame_count_min,
             }
             if (frame_count <= 0)
                 return;
-            for (int frame = 0; frame < frame_count; frame += 1) {
-                for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-                    memset(areas[ch].ptr, 0, outstream->bytes_per_sample);
-                    areas[ch].ptr += areas[ch].step;
-                }
-            }
+            clear_channel_areas(outstream->layout.channel_count, outstream->bytes_per_sample, frame_count, areas);
             if ((err = soundio_outstream_end_write(outstream))) {
                 std::cout << "end write error: " << soundio_strerror(err);
                 abort();
@@ -233,13 +329,8 @@ void write_buffer_to_outstream(SoundIoOutStream* outstream, int frame_count_min,
         if (frame_count <= 0)
             break;
 
-        for (int frame = 0; frame < frame_count; frame += 1) {
-            for (int ch = 0; ch < outstream->layout.channel_count; ch += 1) {
-                memcpy(areas[ch].ptr, read_ptr, outstream->bytes_per_sample);
-                areas[ch].ptr += areas[ch].step;
-                read_ptr += outstream->bytes_per_sample;
-            }
-        }
+        write_channel_areas(read_ptr, outstream->layout.channel_count, outstream->bytes_per_sample, frame_count, areas);
+        read_ptr += static_cast<long long>(frame_count) * outstream->bytes_per_frame;
 
         if ((err = soundio_outstream_end_write(outstream))) {
             std::cout << "end write error: " << soundio_strerror(err);
@@ -29,20 +29,35 @@ typedef std::unique_ptr<SoundIo, std::function<void(SoundIo*)>> SoundIoHandle;
 typedef std::unique_ptr<SoundIoDevice, std::function<void(SoundIoDevice*)>> SoundIoDeviceHandle;
 typedef std::unique_ptr<SoundIoInStream, std::function<void(SoundIoInStream*)>> SoundIoInStreamHandle;
 typedef std::unique_ptr<SoundIoOutStream, std::function<void(SoundIoOutStream*)>> SoundIoOutStreamHandle;
+typedef std::unique_ptr<SoundIoRingBuffer, std::function<void(SoundIoRingBuffer*)>> SoundIoRingBufferHandle;
 
 SoundIoHandle create_sound_io_handle();
 std::vector<SoundIoDeviceHandle> get_sound_io_input_devices(const SoundIoHandle& sound_io);
 SoundIoDeviceHandle get_sound_io_default_output_device(const SoundIoHandle& sound_io);
 SoundIoInStreamHandle create_sound_io_instream(const SoundIoDeviceHandle& device);
 SoundIoOutStreamHandle create_sound_io_outstream(const SoundIoDeviceHandle& device);
+// A lock-free queue of bytes for a single reader and a single writer, such as a soundio callback and an audio thread.
+SoundIoRingBufferHandle create_sound_io_ring_buffer(const SoundIoHandle& sound_io, int capacity);
 
 SoundIoDeviceHandle find_kinect_microphone(const SoundIoHandle& sound_io);
+// userdata becomes the userdata of the stream, which lets the callbacks find the instance owning the stream.
 SoundIoInStreamHandle create_kinect_microphone_stream(const SoundIoHandle& sound_io,
                                                       void (*read_callback)(struct SoundIoInStream*, int frame_count_min, int frame_count_max),
-                                                      void (*overflow_callback)(struct SoundIoInStream*));
+                                                      void (*overflow_callback)(struct SoundIoInStream*),
+                                                      void* userdata);
 SoundIoOutStreamHandle create_default_speaker_stream(const SoundIoHandle& sound_io,
                                                      void (*write_callback)(struct SoundIoOutStream*, int frame_count_min, int frame_count_max),
-                                                     void (*underflow_callback)(struct SoundIoOutStream*));
+                                                     void (*underflow_callback)(struct SoundIoOutStream*),
+                                                     void* userdata);
+
+// Copies frame_count frames of the first channel_count channels of areas into interleaved samples, or back into areas.
+// Pairs of 4-byte samples, which are the float32 stereo of the Kinect microphone and the speakers,
+// take block copies when areas are interleaved stereo and SSE2 gathers or scatters of sample pairs
+// when they are interleaved with more channels, like the 7.0 layout of the Kinect microphone.
+// Other layouts get copied a sample at a time.
+void read_channel_areas(const SoundIoChannelArea* areas, int channel_count, int bytes_per_sample, int frame_count, char* samples);
+void write_channel_areas(const char* samples, int channel_count, int bytes_per_sample, int frame_count, SoundIoChannelArea* areas);
+void clear_channel_areas(int channel_count, int bytes_per_sample, int frame_count, SoundIoChannelArea* areas);
 
 // These functions are from example/sio_microphone.c of libsoundio (https://github.com/andrewrk/libsoundio).
 void write_instream_to_buffer(SoundIoInStream* instream, int frame_count_min, int frame_count_max, SoundIoRingBuffer* ring_buffer, int channel_count);